@@ -0,0 +1,19 @@
+#version 130
+
+in vec3 normal;
+in float fog_depth;
+
+out vec4 output_colour;
+
+uniform vec2 fog_range;
+uniform vec3 sky_colour;
+
+void main()
+{
+	vec3 base = vec3(0.16, 0.51, 0.16);
+	vec3 light_dir = normalize(vec3(0.4, 0.3, 1.0));
+	float light = 0.4 + 0.6 * max(dot(normalize(normal), light_dir), 0.0);
+
+	float fog = clamp((fog_depth - fog_range.x) / (fog_range.y - fog_range.x), 0.0, 1.0);
+	output_colour = vec4(mix(base * light, sky_colour, fog), 1.0);
+}
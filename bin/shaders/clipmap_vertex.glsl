@@ -0,0 +1,44 @@
+#version 130
+
+// Grid position in quads from the level origin
+in vec2 grid_pos;
+
+out vec3 normal;
+out float fog_depth;
+
+uniform mat4 mat_mvp;
+uniform vec2 level_origin;		// Sample index of the first grid vertex
+uniform float level_spacing;	// World units between samples
+uniform float tex_size;
+uniform float grid_size;
+uniform float morph_enabled;	// 0 for the coarsest level
+uniform sampler2D heights;
+uniform sampler2D heights_coarse;
+
+float sampleHeight(vec2 s)
+{
+	return textureLod(heights, (s + 0.5) / tex_size, 0.0).r;
+}
+
+void main()
+{
+	vec2 s = level_origin + grid_pos;
+	float h = sampleHeight(s);
+
+	// Blend into the coarser level towards the edge of the grid, so the
+	// outermost vertices lie on its edges and there are no cracks
+	vec2 edge = min(grid_pos, vec2(grid_size) - grid_pos);
+	float alpha = morph_enabled * clamp(1.0 - min(edge.x, edge.y) / (grid_size * 0.125), 0.0, 1.0);
+	if (alpha > 0.0)
+	{
+		float h_coarse = textureLod(heights_coarse, (s * 0.5 + 0.5) / tex_size, 0.0).r;
+		h = mix(h, h_coarse, alpha);
+	}
+
+	float dx = sampleHeight(s + vec2(1.0, 0.0)) - sampleHeight(s - vec2(1.0, 0.0));
+	float dy = sampleHeight(s + vec2(0.0, 1.0)) - sampleHeight(s - vec2(0.0, 1.0));
+	normal = normalize(vec3(-dx, -dy, 2.0 * level_spacing));
+
+	gl_Position = mat_mvp * vec4(s * level_spacing, h, 1.0);
+	fog_depth = gl_Position.w;
+}
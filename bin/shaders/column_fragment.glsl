@@ -0,0 +1,19 @@
+#version 330
+
+flat in int face;
+in float fog_depth;
+
+out vec4 output_colour;
+
+uniform vec3 top_colour;
+uniform vec2 fog_range;
+uniform vec3 sky_colour;
+
+void main()
+{
+	// Same shading as the CellMesh palette
+	float shade = face == 0 ? 1.0 : (face == 1 ? 0.8 : 0.7);
+
+	float fog = clamp((fog_depth - fog_range.x) / (fog_range.y - fog_range.x), 0.0, 1.0);
+	output_colour = vec4(mix(top_colour * shade, sky_colour, fog), 1.0);
+}
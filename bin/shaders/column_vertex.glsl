@@ -0,0 +1,72 @@
+#version 330
+
+// Zone position of the cell, once per instance
+layout(location = 0) in uvec2 cell;
+
+flat out int face;
+out float fog_depth;
+
+uniform mat4 mat_mvp;
+uniform int lod;
+uniform ivec2 zone_size;		// In cells
+uniform usampler2D heights;		// Heights above the cell base, one mip level per LOD
+uniform sampler2D base_heights;	// One texel per cell
+
+const vec2 corners[6] = vec2[6](vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0));
+
+// Walls in CellMesh neighbour order (west, east, south, north). Each
+// wall goes from its start to its end corner of the column, left to
+// right as seen from outside
+const ivec2 wall_dirs[4] = ivec2[4](ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1), ivec2(0, 1));
+const vec4 wall_ends[4] = vec4[4](vec4(0.0, 1.0, 0.0, 0.0), vec4(1.0, 0.0, 1.0, 1.0), vec4(0.0, 0.0, 1.0, 0.0), vec4(1.0, 1.0, 0.0, 1.0));
+
+void main()
+{
+	// Each column is 30 vertices: the top quad then the four walls
+	int dim = 32 >> lod;
+	int column = gl_VertexID / 30;
+	int f = (gl_VertexID / 6) % 5;
+	vec2 corner = corners[gl_VertexID % 6];
+
+	ivec2 cell_pos = ivec2(cell);
+	ivec2 s = cell_pos * dim + ivec2(column % dim, column / dim);
+	float size = 32.0 / float(dim);
+	vec2 origin = vec2(s) * size;
+	float top = texelFetch(base_heights, cell_pos, 0).r + float(texelFetch(heights, s, lod).r);
+
+	vec3 position;
+	if (f == 0)
+	{
+		position = vec3(origin + corner * size, top);
+		face = 0;
+	}
+	else
+	{
+		int side = f - 1;
+		ivec2 ns = s + wall_dirs[side];
+
+		// Walls go down to the neighbouring column, or 0 at the zone edge
+		float bottom = 0.0;
+		if (all(greaterThanEqual(ns, ivec2(0))) && all(lessThan(ns, zone_size * dim)))
+		{
+			ivec2 neighbour = ns / dim;
+			float base = texelFetch(base_heights, neighbour, 0).r;
+			bottom = base + float(texelFetch(heights, ns, lod).r);
+
+			// A neighbouring cell may be drawn at another LOD, so go down
+			// to its base to be sure there's no gap
+			if (neighbour != cell_pos)
+				bottom = min(bottom, base);
+		}
+
+		// Hidden (or the neighbour's to draw), collapse it
+		bottom = min(bottom, top);
+
+		vec4 ends = wall_ends[side];
+		position = vec3(origin + mix(ends.xy, ends.zw, corner.x) * size, mix(bottom, top, corner.y));
+		face = side < 2 ? 1 : 2;
+	}
+
+	gl_Position = mat_mvp * vec4(position, 1.0);
+	fog_depth = gl_Position.w;
+}
@@ -0,0 +1,334 @@
+
+/*******************************************************************
+ * Voxigine - A simple voxel engine
+ * Copyright(C) 2014 Simon Judd
+ *
+ * Email:       sirjuddington@gmail.com
+ * Web:         https://github.com/sirjuddington/Voxigine
+ * Filename:    Bench.cpp
+ * Description: Headless benchmarks for world generation, LOD and
+ *              mesh building. Built without SFML or OpenGL (see
+ *              VOXIGINE_HEADLESS) so it can run anywhere, results
+ *              are written as JSON for regression tracking
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************/
+
+
+/*******************************************************************
+ * INCLUDES
+ *******************************************************************/
+#include "Main.h"
+#include "Console.h"
+#include "World/Zone.h"
+#include "World/Cell.h"
+#include "Renderer/CellMesh.h"
+#include "Utilities/Random.h"
+#include "Utilities/ThreadPool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdlib>
+#include <new>
+
+
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+namespace Global
+{
+	int log_verbosity = 1;
+	bool debug = false;
+}
+
+namespace Bench
+{
+	// Every allocation made through operator new is counted
+	std::atomic<uint64_t>	n_allocs(0);
+	std::atomic<uint64_t>	alloc_bytes(0);
+
+	struct result_t
+	{
+		string		name;
+		uint64_t	ops;
+		double		seconds;
+		uint64_t	allocs;
+		uint64_t	bytes;
+		string		item_name;		// What [items] counts, if anything
+		double		items;
+	};
+
+	vector<result_t>	results;
+	volatile float		sink;		// Keeps results of reads from being optimised out
+}
+
+
+/*******************************************************************
+ * ALLOCATION COUNTING
+ *******************************************************************/
+
+void* operator new(size_t size)
+{
+	Bench::n_allocs++;
+	Bench::alloc_bytes += size;
+	void* ptr = malloc(size > 0 ? size : 1);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void operator delete(void* ptr) throw()
+{
+	free(ptr);
+}
+
+// Compilers with sized deallocation call this instead when the size is
+// known, it has to be replaced too or it won't match operator new
+void operator delete(void* ptr, size_t) throw()
+{
+	free(ptr);
+}
+
+
+/*******************************************************************
+ * BENCH NAMESPACE FUNCTIONS
+ *******************************************************************/
+namespace Bench
+{
+	/* Bench::run
+	 * Runs [func], which does [ops] operations, and records how long
+	 * it took and how much it allocated as benchmark [name]
+	 *******************************************************************/
+	template<class F> result_t& run(string name, uint64_t ops, F func)
+	{
+		uint64_t allocs = n_allocs;
+		uint64_t bytes = alloc_bytes;
+		auto start = std::chrono::steady_clock::now();
+
+		func();
+
+		result_t result;
+		result.name = name;
+		result.ops = ops;
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		result.allocs = n_allocs - allocs;
+		result.bytes = alloc_bytes - bytes;
+		result.items = 0;
+		results.push_back(result);
+
+		logMessage(1, "%s: %1.1fns/op", CHR(name), result.seconds * 1e9 / ops);
+		return results.back();
+	}
+
+	/* Bench::generateZone
+	 * Generates [zone] on [n_threads] threads (0 = one per hardware
+	 * thread) as benchmark [name]
+	 *******************************************************************/
+	void generateZone(Zone& zone, string name, unsigned n_threads)
+	{
+		// Same landscape every run
+		Random::init();
+
+		uint64_t cells = zone.getWidth() * zone.getHeight();
+		result_t& result = run(name, cells, [&zone, n_threads]() { zone.generateTestLandscape(n_threads); });
+		result.item_name = "samples";
+		result.items = (double)cells * 32 * 32;
+	}
+
+	/* Bench::buildMeshes
+	 * Builds meshes for every cell in [zone] at [lod_level], with all
+	 * neighbours at the same LOD, as the renderer's mesh jobs would.
+	 * One mesh is reused throughout, so once it has grown to fit this
+	 * only counts the allocations building itself makes
+	 *******************************************************************/
+	void buildMeshes(Zone& zone, uint8_t lod_level, bool compact)
+	{
+		uint8_t neighbour_lods[4] = { lod_level, lod_level, lod_level, lod_level };
+		uint64_t vertices = 0;
+		uint64_t cells = zone.getWidth() * zone.getHeight();
+
+		CellMesh mesh;
+		result_t& result = run(S_FMT("mesh_build_lod%d%s", lod_level, compact ? "_compact" : ""), cells, [&]()
+		{
+			for (unsigned y = 0; y < zone.getHeight(); y++)
+			{
+				for (unsigned x = 0; x < zone.getWidth(); x++)
+				{
+					mesh.build(zone, zone.getCell(x, y), lod_level, neighbour_lods, compact);
+					vertices += mesh.numVertices();
+				}
+			}
+		});
+		result.item_name = "vertices";
+		result.items = (double)vertices;
+	}
+
+	/* Bench::writeJson
+	 * Writes all results to [fp] as JSON
+	 *******************************************************************/
+	void writeJson(FILE* fp, unsigned zone_size)
+	{
+		fprintf(fp, "{\n  \"zone_size\": %d,\n  \"threads\": %d,\n  \"benchmarks\": [\n", zone_size, ThreadPool::hardwareThreads());
+		for (unsigned a = 0; a < results.size(); a++)
+		{
+			const result_t& r = results[a];
+			fprintf(fp, "    { \"name\": \"%s\", \"ops\": %llu, \"seconds\": %1.6f, \"ns_per_op\": %1.2f, \"ops_per_sec\": %1.1f, "
+				"\"allocs\": %llu, \"allocs_per_op\": %1.3f, \"bytes_per_op\": %1.1f",
+				CHR(r.name), (unsigned long long)r.ops, r.seconds, r.seconds * 1e9 / r.ops, r.seconds > 0 ? r.ops / r.seconds : 0.0,
+				(unsigned long long)r.allocs, (double)r.allocs / r.ops, (double)r.bytes / r.ops);
+			if (!r.item_name.empty())
+				fprintf(fp, ", \"%s\": %1.0f, \"%s_per_sec\": %1.1f", CHR(r.item_name), r.items, CHR(r.item_name), r.seconds > 0 ? r.items / r.seconds : 0.0);
+			fprintf(fp, " }%s\n", a + 1 < results.size() ? "," : "");
+		}
+		fprintf(fp, "  ]\n}\n");
+	}
+}
+
+
+/*******************************************************************
+ * FUNCTIONS
+ *******************************************************************/
+
+/* main
+ * Runs all benchmarks on a zone of [argv[1]] x [argv[1]] cells
+ * (default 64) and writes the results to [argv[2]], or stdout
+ *******************************************************************/
+int main(int argc, char** argv)
+{
+	unsigned zone_size = argc > 1 ? atoi(argv[1]) : 64;
+	if (zone_size == 0)
+		zone_size = 64;
+
+	// Zone generation, single threaded and on all threads
+	Zone zone(zone_size, zone_size);
+	{
+		Zone zone_st(zone_size, zone_size);
+		Bench::generateZone(zone_st, "zone_generate_1t", 1);
+	}
+	Bench::generateZone(zone, "zone_generate_mt", 0);
+
+	// LOD generation
+	const unsigned lod_repeats = 4;
+	uint64_t cells = zone_size * zone_size;
+	Bench::run("cell_generate_lod", cells * lod_repeats, [&zone, zone_size, lod_repeats]()
+	{
+		for (unsigned r = 0; r < lod_repeats; r++)
+			for (unsigned y = 0; y < zone_size; y++)
+				for (unsigned x = 0; x < zone_size; x++)
+					zone.getCell(x, y)->generateLod();
+	});
+
+	// Mesh building at each LOD, in both vertex formats if the zone is
+	// small enough for packed vertices
+	for (uint8_t lod = 0; lod < NUM_LODS; lod++)
+	{
+		Bench::buildMeshes(zone, lod, false);
+		if (CellMesh::canPack(zone))
+			Bench::buildMeshes(zone, lod, true);
+	}
+
+	// Height reads, in row order and at random (the coordinates are
+	// generated up front so only the reads are timed)
+	unsigned samples = zone_size * 32;
+	Bench::run("height_at_sequential", (uint64_t)samples * samples, [&zone, samples]()
+	{
+		float sum = 0;
+		for (unsigned y = 0; y < samples; y++)
+			for (unsigned x = 0; x < samples; x++)
+				sum += zone.heightAt(x, y);
+		Bench::sink = sum;
+	});
+
+	const unsigned n_random = 1 << 22;
+	vector<uint32_t> coords = Random::generateUnsignedArray(n_random * 2, 0, samples - 1);
+	Bench::run("height_at_random", n_random, [&zone, &coords, n_random]()
+	{
+		float sum = 0;
+		for (unsigned a = 0; a < n_random; a++)
+			sum += zone.heightAt(coords[a * 2], coords[a * 2 + 1]);
+		Bench::sink = sum;
+	});
+
+	// Write results
+	FILE* fp = argc > 2 ? fopen(argv[2], "wt") : stdout;
+	if (!fp)
+	{
+		logMessage(1, "Unable to open %s", argv[2]);
+		return 1;
+	}
+	Bench::writeJson(fp, zone_size);
+	if (fp != stdout)
+		fclose(fp);
+
+	return 0;
+}
+
+/* formatString
+ * Formats a string, using c-style % arguments
+ *******************************************************************/
+string formatString(const string fmt, ...)
+{
+	std::vector<char> str(100, '\0');
+	va_list ap;
+
+	while (1)
+	{
+		va_start(ap, fmt);
+		auto n = vsnprintf(str.data(), str.size(), fmt.c_str(), ap);
+		va_end(ap);
+
+		if ((n > -1) && (size_t(n) < str.size()))
+			return str.data();
+
+		if (n > -1)
+			str.resize(n + 1);
+		else
+			str.resize(str.size() * 2);
+	}
+}
+
+/* logMessage
+ * Writes a log message to stderr, so stdout is left for the results
+ *******************************************************************/
+void logMessage(unsigned level, const string message, ...)
+{
+	if ((int)level > Global::log_verbosity)
+		return;
+
+	va_list ap;
+	va_start(ap, message);
+	vfprintf(stderr, message.c_str(), ap);
+	va_end(ap);
+	fprintf(stderr, "\n");
+}
+
+
+/*******************************************************************
+ * CONSOLE
+ *******************************************************************/
+
+// There's no console here, but commands are still defined in the
+// linked code and anything logged to it goes to stderr
+Console::Command::Command(string name, void(*commandFunc)(vector<string>), int min_args, bool show_in_list)
+{
+	this->name = name;
+	this->commandFunc = commandFunc;
+	this->min_args = min_args;
+	this->show_in_list = show_in_list;
+}
+
+void Console::logMessage(string message)
+{
+	fprintf(stderr, "%s\n", CHR(message));
+}
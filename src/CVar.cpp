@@ -165,6 +165,30 @@ void read_cvar(string name, string value)
 	}
 }
 
+/* get_saved_cvars
+ * Adds the name and value of every saved cvar to [names] and [values],
+ * in a form read_cvar will take. Floats are written in full so they
+ * read back exactly
+ *******************************************************************/
+void get_saved_cvars(vector<string>& names, vector<string>& values)
+{
+	for (uint16_t c = 0; c < n_cvars; c++)
+	{
+		if (!(cvars[c]->flags & CVAR_SAVE))
+			continue;
+
+		names.push_back(cvars[c]->name);
+		if (cvars[c]->type == CVAR_INTEGER)
+			values.push_back(S_FMT("%d", cvars[c]->GetValue().Int));
+		else if (cvars[c]->type == CVAR_BOOLEAN)
+			values.push_back(S_FMT("%d", cvars[c]->GetValue().Bool));
+		else if (cvars[c]->type == CVAR_FLOAT)
+			values.push_back(S_FMT("%1.17g", cvars[c]->GetValue().Float));
+		else
+			values.push_back(((CStringCVar*)cvars[c])->value);
+	}
+}
+
 
 /*******************************************************************
  * C<TYPE>CVAR CLASS FUNCTIONS
@@ -90,6 +90,7 @@ void save_cvars(FILE* fp);
 void read_cvar(string name, string value);
 CVar* get_cvar(string name);
 void get_cvar_list(vector<string>& list);
+void get_saved_cvars(vector<string>& names, vector<string>& values);
 
 class CStringCVar : public CVar
 {
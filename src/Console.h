@@ -2,10 +2,14 @@
 #ifndef	__CONSOLE_H__
 #define	__CONSOLE_H__
 
+// Input and drawing aren't available in headless builds (ie. the
+// benchmarks), only commands and the log
+#ifndef VOXIGINE_HEADLESS
 #include <SFML/Window/Event.hpp>
 
 // Forward declarations
 namespace sf { class RenderWindow; }
+#endif
 
 namespace Console
 {
@@ -42,11 +46,13 @@ namespace Console
 	unsigned	numPrevCommands();
 	bool		isActive();
 	void		activate(bool enable = true);
+#ifndef VOXIGINE_HEADLESS
 	bool		handleKeyPress(sf::Event::KeyEvent& event);
 	bool		handleText(sf::Event::TextEvent& event);
 
 	// Drawing
 	void	draw(sf::RenderWindow* window);
+#endif
 };
 
 // Define for neat console command definitions
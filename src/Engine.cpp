@@ -33,10 +33,21 @@
 #include "Console.h"
 #include "Utilities/Tokenizer.h"
 #include "Renderer/StandardRenderer.h"
+#include "Renderer/ShaderRenderer.h"
+#include "Renderer/ClipmapRenderer.h"
+#include "Renderer/GLState.h"
 #include "Game/Player.h"
+#include "Game/CameraPath.h"
+#include "Game/InputRecording.h"
+#include "World/Zone.h"
 #include "Utilities/Random.h"
+#include "Utilities/ThreadPool.h"
+#include "Utilities/Profiler.h"
+#include "Utilities/Math.h"
 #include <SFML/Graphics.hpp>
 #include <fstream>
+#include <algorithm>
+#include <thread>
 
 
 /*******************************************************************
@@ -47,12 +58,57 @@ namespace Engine
 	sf::RenderWindow*	window = nullptr;
 	std::ofstream		log;
 	sf::Clock			clock;
+	sf::Clock			pace_clock;
 	sf::Time			elapsed;
-	sf::Time			frame_time = sf::seconds(1.0f / 60.0f);
-	float				frame_mult = 1.0f;
+	sf::Time			tick_time = sf::seconds(1.0f / 60.0f);
+	float				tick_mult = 1.0f;	// Tick length relative to 60 per second, movement speeds are per 60th
+	unsigned			tick_rate = 60;
+	sf::Time			next_frame;			// When the next frame can start (see vid_max_framerate)
 	Renderer*			renderer = nullptr;
 	Player				player;
 	bool				mouse_locked = false;
+	bool				running = false;
+	int					mouse_x = 0;	// Mouse movement since the last tick
+	int					mouse_y = 0;
+
+	// Player eye position and direction before the last tick, the
+	// camera is drawn between this and the current position
+	fpoint3_t			last_eye;
+	fpoint3_t			last_direction;
+
+	// Benchmark run timings (see bench_flythrough and replay)
+	struct bench_run_t
+	{
+		string			name;
+		uint64_t		frame_start;
+		vector<float>	frame_ms;
+		unsigned		cells_meshed;
+		uint64_t		bytes_uploaded;
+		string			results_file;
+		bool			exit;		// Exit when done (started from the command line)
+	};
+	bench_run_t*		bench_run = nullptr;
+
+	// Flythrough benchmark (see bench_flythrough)
+	CameraPath*			flythrough = nullptr;
+	unsigned			flythrough_tick = 0;
+	unsigned			flythrough_ticks = 0;
+
+	// Input recording and replay (see record_start and replay)
+	InputRecording*		recording = nullptr;
+	InputRecording*		replay = nullptr;
+	vector<string>		replay_cvar_names;		// Values to restore after a replay
+	vector<string>		replay_cvar_values;
+
+	// Run requested by a console command, started at the beginning of
+	// the next frame rather than part way through this one's ticks
+	struct start_request_t
+	{
+		int		type;			// START_*
+		string	file;			// Path, recording or replay file
+		string	results_file;
+	};
+	start_request_t		start_request = { START_NONE, "", "" };
 }
 CVAR(Int, vid_win_width, 1024, CVAR_SAVE|CVAR_LOCKED)
 CVAR(Int, vid_win_height, 768, CVAR_SAVE|CVAR_LOCKED)
@@ -61,10 +117,19 @@ CVAR(Int, vid_fs_height, -1, CVAR_SAVE|CVAR_LOCKED)
 CVAR(Bool, vid_fullscreen, false, CVAR_SAVE|CVAR_LOCKED)
 CVAR(Int, vid_aa_level, 0, CVAR_SAVE)
 CVAR(Bool, vid_vsync, true, CVAR_SAVE)
-CVAR(Int, vid_max_framerate, 120, CVAR_SAVE)
+CVAR(Int, vid_max_framerate, 120, CVAR_SAVE)	// 0 = unlimited
+CVAR(Int, sim_tick_rate, 60, CVAR_SAVE|CVAR_LOCKED)
+CVAR(Bool, sim_interpolate, true, CVAR_SAVE)
 CVAR(Float, mouse_sensitivity, 0.3f, CVAR_SAVE)
 CVAR(Bool, test_slow, false, CVAR_SAVE)
 CVAR(Float, max_view_distance, 2048, CVAR_SAVE)
+CVAR(Int, render_path, 0, CVAR_SAVE|CVAR_LOCKED)	// 0 = cell meshes, 1 = shader columns, 2 = shader clipmap
+EXTERN_CVAR(Int, random_seed)
+extern Zone test_zone;
+extern bool test_zone_regenerated;
+
+// Ticks run in a single frame before the simulation is slowed down
+#define MAX_TICKS_PER_FRAME	8
 
 
 /*******************************************************************
@@ -87,6 +152,11 @@ bool Engine::init()
 	if (!loadConfig())
 		logMessage(1, "Unable to open voxigine.cfg, will be created on exit");
 
+	// Init profiler
+	Profiler::init();
+
+	setTickRate(sim_tick_rate);
+
 	createWindow();
 
 	// Init GLEW
@@ -96,8 +166,15 @@ bool Engine::init()
 	Random::init();
 
 	// Create/init renderer
-	renderer = new StandardRenderer();
-	renderer->init();
+	if (render_path == 1)
+		renderer = new ShaderRenderer();
+	else if (render_path == 2)
+		renderer = new ClipmapRenderer();
+	else
+		renderer = new StandardRenderer();
+	if (!renderer->init())
+		logMessage(1, "Error: Renderer initialisation failed");
+	snapCamera();
 
 	return true;
 }
@@ -135,7 +212,6 @@ bool Engine::createWindow()
 	else
 		window = new sf::RenderWindow(sf::VideoMode(vid_win_width, vid_win_height), "Voxigine", sf::Style::Default, settings);
 	window->setVerticalSyncEnabled(vid_vsync);
-	//window->setFramerateLimit(vid_max_framerate);
 
 	logMessage(1, "Set video mode to: %dx%d (%s)", window->getSize().x, window->getSize().y, vid_fullscreen ? "fullscreen" : "windowed");
 	logMessage(1, "Antialiasing level: %dx", window->getSettings().antialiasingLevel);
@@ -199,53 +275,96 @@ void Engine::saveConfig()
  *******************************************************************/
 bool Engine::mainLoop()
 {
+	// Collect the last frame's timings before starting this one
+	Profiler::nextFrame();
+	PROF_SCOPE("Engine::mainLoop");
+
+	// Anything requested last frame starts before this frame's ticks.
+	// On the first frame it was requested from the command line, which
+	// bench runs can tell by running still being false
+	if (start_request.type != START_NONE)
+		startRequested();
+
+	running = true;
 	elapsed += clock.restart();
 
-	int loopn = 0;
-	while (elapsed >= frame_time)
-	{
-		//if (loopn > 0)
-		//	logMessage(0, "%d: elapsed %dms, frametime %dms", loopn, elapsed.asMilliseconds(), frame_time.asMilliseconds());
+	// If ticks can't keep up, slow the simulation down rather than
+	// trying to catch up, which would make each frame slower still
+	if (elapsed > tick_time * (float)MAX_TICKS_PER_FRAME)
+		elapsed = tick_time * (float)MAX_TICKS_PER_FRAME;
 
-		elapsed -= frame_time;
+	// Flythroughs and replays don't depend on how long frames take, so
+	// every run draws the same frames
+	bool bench_frame = (bench_run != nullptr);
+	if (bench_frame && bench_run->frame_start == 0)
+		bench_run->frame_start = Profiler::now();
 
-		// Calculate frame multiplier
-		frame_mult = 1.0f;
-		//if (elapsed < frame_time)
-		//	frame_mult = (float)elapsed.asMilliseconds() / (float)frame_time.asMilliseconds();
+	// Process window events every frame, whether or not a tick runs.
+	// Mouse movement is kept until the next tick
+	if (!processEvents())
+		return false;
 
-		// Process window events
-		if (!processEvents())
-			return false;
+	// Mouse cursor lock
+	if (mouse_locked)
+		sf::Mouse::setPosition(sf::Vector2i(window->getSize().x / 2, window->getSize().y / 2), *window);
+
+	// How far between the last tick and the next the frame is drawn
+	float fraction = 0.0f;
+
+	// A flythrough moves on exactly one tick per frame
+	if (flythrough)
+	{
+		elapsed = sf::Time::Zero;
+
+		fpoint3_t position, direction;
+		flythrough->sample(flythrough_tick * tick_time.asSeconds(), position, direction);
+		player.setPosition(position);
+		player.setDirection(direction);
+		snapCamera();
+		flythrough_tick++;
+	}
+
+	// A replay runs the ticks recorded for the frame, and draws it as
+	// far towards the next tick as it was when recorded
+	else if (replay)
+	{
+		elapsed = sf::Time::Zero;
 
-		// Mouse cursor lock
-		if (mouse_locked)
-			sf::Mouse::setPosition(sf::Vector2i(window->getSize().x / 2, window->getSize().y / 2), *window);
+		vector<tick_input_t> ticks;
+		replay->readFrame(ticks, fraction);
+		for (unsigned a = 0; a < ticks.size(); a++)
+			tick(ticks[a]);
+	}
 
-		// Temporary movement keys
-		if (!Console::isActive())
+	else
+	{
+		while (elapsed >= tick_time)
 		{
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::W))
-				player.move(0.3f * frame_mult);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::S))
-				player.move(-0.3f * frame_mult);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::A))
-				player.strafe(-0.3f * frame_mult);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::D))
-				player.strafe(0.3f * frame_mult);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left))
-				player.turn(-1.0f * frame_mult);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right))
-				player.turn(1.0f * frame_mult);
-
-			renderer->getCamera().set(player.getEyePosition(), player.getDirection());
+			elapsed -= tick_time;
+
+			tick_input_t input = readInput();
+			if (recording)
+				recording->addTick(input);
+			tick(input);
 		}
 
-		loopn++;
+		fraction = elapsed.asSeconds() / tick_time.asSeconds();
+		if (recording)
+			recording->endFrame(fraction);
 	}
+
+	// Draw from between the last two ticks, as far along as the time
+	// left over, so the camera moves smoothly whatever the framerate
+	float alpha = sim_interpolate ? fraction : 1.0f;
+	fpoint3_t eye = last_eye + (player.getEyePosition() - last_eye) * alpha;
+	fpoint3_t direction = (last_direction + (player.getDirection() - last_direction) * alpha).normalize();
+	if (direction.magnitude() == 0.0f)
+		direction = player.getDirection();
+	renderer->getCamera().set(eye, direction);
 
 	window->clear(sf::Color::Black);
 
+	GLState::nextFrame();
 	renderer->renderScene(window->getSize().x, window->getSize().y);
 
 	if (test_slow)
@@ -253,24 +372,490 @@ bool Engine::mainLoop()
 
 	if (Console::isActive())
 	{
+		PROF_SCOPE("Console::draw");
+
+		// SFML draws from client memory, and changes GL state without
+		// the renderer knowing
+		GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+		GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		GLState::useProgram(0);
 		window->resetGLStates();
 		Console::draw(window);
+		GLState::invalidate();
 	}
 
-	//int ms = clock.getElapsedTime().asMilliseconds() - last_time.asMilliseconds();
-	//last_time = clock.getElapsedTime();
-
-	window->display();
+	{
+		PROF_SCOPE("Engine::display");
+		window->display();
+	}
+
+	if (bench_frame && bench_run)
+	{
+		uint64_t now = Profiler::now();
+		bench_run->frame_ms.push_back((float)Profiler::ticksToMs(now - bench_run->frame_start));
+		bench_run->frame_start = now;
+	}
+
+	if (flythrough && flythrough_tick > flythrough_ticks)
+		return stopFlythrough();
+	if (replay && replay->finished())
+		return stopReplay();
+
+	// Benchmarks run as fast as they can
+	if (!bench_run)
+		waitForNextFrame();
+
+	return true;
+}
+
+/* Engine::waitForNextFrame
+ * Waits until the next frame is due, if vid_max_framerate is set.
+ * Most of the wait is slept and the rest spun, as sleeps can overrun
+ * by a millisecond or more
+ *******************************************************************/
+void Engine::waitForNextFrame()
+{
+	PROF_SCOPE("Engine::waitForNextFrame");
+
+	sf::Time now = pace_clock.getElapsedTime();
+	if (vid_max_framerate <= 0)
+	{
+		next_frame = now;
+		return;
+	}
+
+	// Frames are due at regular intervals rather than an interval
+	// after each one finishes, so the rate doesn't drift. If a frame
+	// was so slow the next one's already overdue, start again from now
+	sf::Time interval = sf::seconds(1.0f / vid_max_framerate);
+	next_frame += interval;
+	if (next_frame < now)
+	{
+		if (now - next_frame > interval)
+			next_frame = now;
+		return;
+	}
+
+	if (next_frame - now > sf::milliseconds(2))
+		sf::sleep(next_frame - now - sf::milliseconds(2));
+	while (pace_clock.getElapsedTime() < next_frame)
+		std::this_thread::yield();
+}
+
+/* Engine::setTickRate
+ * Sets the simulation to run at [rate] ticks per second
+ *******************************************************************/
+void Engine::setTickRate(unsigned rate)
+{
+	tick_rate = (unsigned)Math::clamp(rate, 10, 1000);
+	tick_time = sf::seconds(1.0f / tick_rate);
+	tick_mult = 60.0f / tick_rate;
+}
+
+/* Engine::snapCamera
+ * Stops the camera drawing between the last two ticks until the next
+ * one, for when the player is moved other than by a tick
+ *******************************************************************/
+void Engine::snapCamera()
+{
+	last_eye = player.getEyePosition();
+	last_direction = player.getDirection();
+}
+
+/* Engine::readInput
+ * Returns the player's input for this tick, from the keyboard and the
+ * mouse movement since the last tick
+ *******************************************************************/
+tick_input_t Engine::readInput()
+{
+	tick_input_t input;
+
+	// Temporary movement keys
+	if (!Console::isActive())
+	{
+		if (sf::Keyboard::isKeyPressed(sf::Keyboard::W))
+			input.keys |= INPUT_FORWARD;
+		if (sf::Keyboard::isKeyPressed(sf::Keyboard::S))
+			input.keys |= INPUT_BACK;
+		if (sf::Keyboard::isKeyPressed(sf::Keyboard::A))
+			input.keys |= INPUT_STRAFE_LEFT;
+		if (sf::Keyboard::isKeyPressed(sf::Keyboard::D))
+			input.keys |= INPUT_STRAFE_RIGHT;
+		if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left))
+			input.keys |= INPUT_TURN_LEFT;
+		if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right))
+			input.keys |= INPUT_TURN_RIGHT;
+	}
+
+	input.mouse_x = (int16_t)Math::clamp(mouse_x, -32768, 32767);
+	input.mouse_y = (int16_t)Math::clamp(mouse_y, -32768, 32767);
+	mouse_x = 0;
+	mouse_y = 0;
+
+	return input;
+}
+
+/* Engine::tick
+ * Runs one simulation tick with the player's [input]. Everything that
+ * changes the world goes through here, so replaying the same input
+ * gives the same results
+ *******************************************************************/
+void Engine::tick(const tick_input_t& input)
+{
+	snapCamera();
+
+	// Mouselook, the mouse moves the same amount however long the tick
+	if (input.mouse_x != 0)
+		player.turn((float)input.mouse_x * (float)mouse_sensitivity);
+	if (input.mouse_y != 0)
+		player.pitch(-(float)input.mouse_y * ((float)mouse_sensitivity * 0.02f));
+
+	// Movement
+	if (input.keys & INPUT_FORWARD)
+		player.move(0.3f * tick_mult);
+	if (input.keys & INPUT_BACK)
+		player.move(-0.3f * tick_mult);
+	if (input.keys & INPUT_STRAFE_LEFT)
+		player.strafe(-0.3f * tick_mult);
+	if (input.keys & INPUT_STRAFE_RIGHT)
+		player.strafe(0.3f * tick_mult);
+	if (input.keys & INPUT_TURN_LEFT)
+		player.turn(-1.0f * tick_mult);
+	if (input.keys & INPUT_TURN_RIGHT)
+		player.turn(1.0f * tick_mult);
+}
+
+/* Engine::resetWorld
+ * Regenerates the zone from random_seed, so everything from here on
+ * runs the same way each time
+ *******************************************************************/
+void Engine::resetWorld()
+{
+	// Nothing can be reading the zone while it changes
+	renderer->finishMeshing();
+
+	Random::init();
+	test_zone.generateTestLandscape();
+	test_zone_regenerated = true;
+}
+
+/* Engine::startBenchRun
+ * Starts timing frames for a benchmark run called [name] (a flythrough
+ * or replay), reporting them to [results_file] if given when done
+ *******************************************************************/
+void Engine::startBenchRun(string name, string results_file)
+{
+	delete bench_run;
+	bench_run = new bench_run_t();
+	bench_run->name = name;
+	bench_run->frame_start = 0;
+	bench_run->cells_meshed = renderer->numCellsMeshed();
+	bench_run->bytes_uploaded = renderer->numBytesUploaded();
+	bench_run->results_file = results_file;
+	bench_run->exit = !running;
+
+	// Frames shouldn't wait on anything but the renderer
+	window->setVerticalSyncEnabled(false);
+	Console::activate(false);
+	lockMouse(false);
+	Profiler::reset();
+}
+
+/* Engine::endBenchRun
+ * Ends the current benchmark run and reports the results. Returns
+ * false if the engine should exit
+ *******************************************************************/
+bool Engine::endBenchRun()
+{
+	if (!bench_run)
+		return true;
+
+	// Frame time percentiles (nearest rank)
+	vector<float> sorted = bench_run->frame_ms;
+	std::sort(sorted.begin(), sorted.end());
+	unsigned n_frames = sorted.size();
+	auto percentile = [&sorted, n_frames](double p) { return n_frames > 0 ? sorted[(unsigned)ceil(p * n_frames) - 1] : 0.0f; };
+
+	double total = 0;
+	for (unsigned a = 0; a < n_frames; a++)
+		total += sorted[a];
+	double avg = n_frames > 0 ? total / n_frames : 0.0;
+	float p50 = percentile(0.5);
+	float p95 = percentile(0.95);
+	float p99 = percentile(0.99);
+	float longest = n_frames > 0 ? sorted.back() : 0.0f;
+
+	// Hitches are frames over twice the median, or over 50ms
+	unsigned hitches = 0;
+	unsigned hitches_50ms = 0;
+	for (unsigned a = 0; a < n_frames; a++)
+	{
+		if (sorted[a] > p50 * 2.0f)
+			hitches++;
+		if (sorted[a] > 50.0f)
+			hitches_50ms++;
+	}
+
+	unsigned cells_meshed = renderer->numCellsMeshed() - bench_run->cells_meshed;
+	uint64_t bytes_uploaded = renderer->numBytesUploaded() - bench_run->bytes_uploaded;
+
+	logMessage(1, "%s: %d frames in %1.2fs", CHR(bench_run->name), n_frames, total / 1000.0);
+	logMessage(1, "Frame time avg %1.2fms, p50 %1.2fms, p95 %1.2fms, p99 %1.2fms, max %1.2fms", avg, p50, p95, p99, longest);
+	logMessage(1, "%d hitches (over 2x median), %d over 50ms", hitches, hitches_50ms);
+	logMessage(1, "%d cells meshed, %1.2fMB uploaded", cells_meshed, (double)bytes_uploaded / (1024.0 * 1024.0));
+
+	if (!bench_run->results_file.empty())
+	{
+		FILE* fp = fopen(CHR(bench_run->results_file), "wt");
+		if (fp)
+		{
+			fprintf(fp, "{\n  \"name\": \"%s\",\n  \"render_path\": %d,\n  \"random_seed\": %d,\n  \"frames\": %d,\n  \"seconds\": %1.3f,\n",
+				CHR(bench_run->name), (int)render_path, (int)random_seed, n_frames, total / 1000.0);
+			fprintf(fp, "  \"frame_ms\": { \"avg\": %1.3f, \"p50\": %1.3f, \"p95\": %1.3f, \"p99\": %1.3f, \"max\": %1.3f },\n", avg, p50, p95, p99, longest);
+			fprintf(fp, "  \"hitches\": %d,\n  \"hitches_50ms\": %d,\n  \"cells_meshed\": %d,\n  \"bytes_uploaded\": %llu\n}\n", hitches, hitches_50ms, cells_meshed, (unsigned long long)bytes_uploaded);
+			fclose(fp);
+			logMessage(1, "Wrote results to %s", CHR(bench_run->results_file));
+		}
+		else
+			logMessage(1, "Unable to open %s", CHR(bench_run->results_file));
+	}
+
+	bool exit = bench_run->exit;
+	delete bench_run;
+	bench_run = nullptr;
+	window->setVerticalSyncEnabled(vid_vsync);
+
+	if (exit)
+	{
+		window->close();
+		return false;
+	}
 
 	return true;
 }
 
+/* Engine::startFlythrough
+ * Starts the flythrough benchmark along the path in [path_file],
+ * writing the results to [results_file] if given. The zone is
+ * regenerated from random_seed first so every run sees the same world
+ *******************************************************************/
+bool Engine::startFlythrough(string path_file, string results_file)
+{
+	if (bench_run || recording)
+	{
+		logMessage(1, "Can't start a flythrough while recording or running a benchmark");
+		return false;
+	}
+
+	flythrough = new CameraPath();
+	if (!flythrough->open(path_file))
+	{
+		delete flythrough;
+		flythrough = nullptr;
+		return false;
+	}
+
+	logMessage(1, "Starting flythrough of %s (%1.1fs, random_seed %d)", CHR(path_file), flythrough->duration(), (int)random_seed);
+
+	resetWorld();
+	flythrough_tick = 0;
+	flythrough_ticks = (unsigned)ceil(flythrough->duration() / tick_time.asSeconds());
+	startBenchRun("Flythrough", results_file);
+	bench_run->frame_ms.reserve(flythrough_ticks + 1);
+
+	return true;
+}
+
+/* Engine::stopFlythrough
+ * Ends the flythrough benchmark and reports the results. Returns false
+ * if the engine should exit
+ *******************************************************************/
+bool Engine::stopFlythrough()
+{
+	if (!flythrough)
+		return true;
+
+	delete flythrough;
+	flythrough = nullptr;
+	return endBenchRun();
+}
+
+/* Engine::startRecording
+ * Starts recording the player's input to [filename], from a freshly
+ * regenerated zone
+ *******************************************************************/
+bool Engine::startRecording(string filename)
+{
+	if (bench_run || recording)
+	{
+		logMessage(1, "Already recording or running a benchmark");
+		return false;
+	}
+
+	// Directions go through the same conversion as they will on replay,
+	// and frames before the first tick are drawn from where it starts
+	player.setDirection(player.getDirection());
+	snapCamera();
+
+	InputRecording::header_t header;
+	header.tick_rate = tick_rate;
+	header.random_seed = random_seed;
+	header.position = player.getPosition();
+	header.direction = player.getDirection();
+	get_saved_cvars(header.cvar_names, header.cvar_values);
+
+	recording = new InputRecording();
+	if (!recording->create(filename, header))
+	{
+		logMessage(1, "Unable to open %s for recording", CHR(filename));
+		delete recording;
+		recording = nullptr;
+		return false;
+	}
+
+	resetWorld();
+	logMessage(1, "Recording input to %s (random_seed %d)", CHR(filename), (int)random_seed);
+
+	return true;
+}
+
+/* Engine::stopRecording
+ * Finishes the current input recording
+ *******************************************************************/
+void Engine::stopRecording()
+{
+	if (!recording)
+		return;
+
+	recording->close();
+	logMessage(1, "Recorded %d ticks over %d frames", recording->numTicks(), recording->numFrames());
+	delete recording;
+	recording = nullptr;
+}
+
+/* Engine::startReplay
+ * Replays the input recording in [filename] frame by frame, from the
+ * same starting point, writing the frame time results to
+ * [results_file] if given. Recorded cvars are applied for the replay
+ *******************************************************************/
+bool Engine::startReplay(string filename, string results_file)
+{
+	if (bench_run || recording)
+	{
+		logMessage(1, "Can't start a replay while recording or running a benchmark");
+		return false;
+	}
+
+	InputRecording::header_t header;
+	replay = new InputRecording();
+	if (!replay->open(filename, header))
+	{
+		delete replay;
+		replay = nullptr;
+		return false;
+	}
+
+	// Ticks must be the same length as when recorded
+	setTickRate(header.tick_rate);
+
+	// Apply the recorded cvars, keeping the current values to restore
+	// afterwards. Locked ones can't change now, so just say if they
+	// differ
+	replay_cvar_names.clear();
+	replay_cvar_values.clear();
+	get_saved_cvars(replay_cvar_names, replay_cvar_values);
+	for (unsigned a = 0; a < header.cvar_names.size(); a++)
+	{
+		CVar* cvar = get_cvar(header.cvar_names[a]);
+		if (!cvar)
+			continue;
+
+		if (cvar->flags & CVAR_LOCKED)
+		{
+			for (unsigned b = 0; b < replay_cvar_names.size(); b++)
+				if (replay_cvar_names[b] == header.cvar_names[a] && replay_cvar_values[b] != header.cvar_values[a])
+					logMessage(1, "Warning: recorded with %s %s (currently %s)", CHR(header.cvar_names[a]), CHR(header.cvar_values[a]), CHR(replay_cvar_values[b]));
+		}
+		else
+			read_cvar(header.cvar_names[a], header.cvar_values[a]);
+	}
+	random_seed = header.random_seed;
+
+	logMessage(1, "Replaying %s (random_seed %d)", CHR(filename), header.random_seed);
+
+	resetWorld();
+	player.setPosition(header.position);
+	player.setDirection(header.direction);
+	snapCamera();
+	startBenchRun("Replay", results_file);
+
+	return true;
+}
+
+/* Engine::stopReplay
+ * Ends the current replay, reports the results and restores the cvars
+ * it changed. Returns false if the engine should exit
+ *******************************************************************/
+bool Engine::stopReplay()
+{
+	if (!replay)
+		return true;
+
+	logMessage(1, "Replayed %d ticks over %d frames", replay->numTicks(), replay->numFrames());
+	delete replay;
+	replay = nullptr;
+	setTickRate(sim_tick_rate);
+
+	for (unsigned a = 0; a < replay_cvar_names.size(); a++)
+	{
+		CVar* cvar = get_cvar(replay_cvar_names[a]);
+		if (cvar && !(cvar->flags & CVAR_LOCKED))
+			read_cvar(replay_cvar_names[a], replay_cvar_values[a]);
+	}
+
+	return endBenchRun();
+}
+
+/* Engine::requestStart
+ * Requests a run of [type] (START_*) with [file] and [results_file],
+ * to start at the beginning of the next frame. Replaces any request
+ * not yet started
+ *******************************************************************/
+void Engine::requestStart(int type, string file, string results_file)
+{
+	start_request.type = type;
+	start_request.file = file;
+	start_request.results_file = results_file;
+}
+
+/* Engine::startRequested
+ * Starts the run requested with requestStart, if any. The time taken
+ * to start it (regenerating the zone) is not simulated
+ *******************************************************************/
+void Engine::startRequested()
+{
+	start_request_t request = start_request;
+	start_request.type = START_NONE;
+
+	if (request.type == START_FLYTHROUGH)
+		startFlythrough(request.file, request.results_file);
+	else if (request.type == START_RECORDING)
+		startRecording(request.file);
+	else if (request.type == START_REPLAY)
+		startReplay(request.file, request.results_file);
+
+	clock.restart();
+	elapsed = sf::Time::Zero;
+}
+
 /* Engine::processEvents
  * Polls and processes any SFML window events. Returns false if the
  * main loop must exit
  *******************************************************************/
 bool Engine::processEvents()
 {
+	PROF_SCOPE("Engine::processEvents");
+
 	sf::Event event;
 	while (window->pollEvent(event))
 	{
@@ -317,13 +902,11 @@ bool Engine::processEvents()
 			int x_diff = event.mouseMove.x - (window->getSize().x / 2);
 			int y_diff = event.mouseMove.y - (window->getSize().y / 2);
 
+			// Applied in the next tick (see Engine::tick)
 			if (mouse_locked)
 			{
-				if (x_diff != 0)
-					player.turn((float)x_diff * (float)mouse_sensitivity * frame_mult);
-
-				if (y_diff != 0)
-					player.pitch(-(float)y_diff * ((float)mouse_sensitivity * 0.02f * frame_mult));
+				mouse_x += x_diff;
+				mouse_y += y_diff;
 			}
 		}
 	}
@@ -338,6 +921,12 @@ void Engine::shutDown()
 {
 	logMessage(1, "Exiting...");
 
+	// Finish anything still running, replays put back the cvars they
+	// changed before the config is saved
+	stopRecording();
+	stopReplay();
+	stopFlythrough();
+
 	saveConfig();
 
 	log.close();
@@ -404,6 +993,73 @@ CONSOLE_COMMAND(vid_setmode, 2, true)
 		Engine::createWindow();
 }
 
+/* bench_flythrough
+ * Flies along the path in [args[0]] at a fixed timestep and reports
+ * frame times, also writing them to [args[1]] if given. When run from
+ * the command line (+bench_flythrough) the engine exits once finished
+ *******************************************************************/
+CONSOLE_COMMAND(bench_flythrough, 1, true)
+{
+	Engine::requestStart(Engine::START_FLYTHROUGH, args[0], args.size() > 1 ? args[1] : "");
+}
+
+/* record_start
+ * Starts recording input to [args[0]], for replay later
+ *******************************************************************/
+CONSOLE_COMMAND(record_start, 1, true)
+{
+	Engine::requestStart(Engine::START_RECORDING, args[0]);
+}
+
+/* record_stop
+ * Stops recording input
+ *******************************************************************/
+CONSOLE_COMMAND(record_stop, 0, true)
+{
+	Engine::stopRecording();
+}
+
+/* replay
+ * Replays the input recorded in [args[0]] frame by frame, reporting
+ * frame times as bench_flythrough does (to [args[1]] if given)
+ *******************************************************************/
+CONSOLE_COMMAND(replay, 1, true)
+{
+	Engine::requestStart(Engine::START_REPLAY, args[0], args.size() > 1 ? args[1] : "");
+}
+
+/* gen_benchmark
+ * Regenerates the test zone with 1, 2, 4... threads up to [max] (or
+ * the number of hardware threads) and logs the throughput of each
+ *******************************************************************/
+CONSOLE_COMMAND(gen_benchmark, 0, true)
+{
+	// Nothing can be reading the zone while it changes
+	Engine::renderer->finishMeshing();
+
+	unsigned max_threads = ThreadPool::hardwareThreads();
+	if (args.size() > 0 && atoi(args[0].c_str()) > 0)
+		max_threads = atoi(args[0].c_str());
+
+	double rate_single = 0;
+	for (unsigned n = 1; ; n *= 2)
+	{
+		if (n > max_threads)
+			n = max_threads;
+
+		double rate = test_zone.generateTestLandscape(n);
+		if (n == 1)
+			rate_single = rate;
+		else if (rate_single > 0)
+			Console::logMessage(S_FMT("%d threads: %1.2fx single threaded", n, rate / rate_single));
+
+		if (n == max_threads)
+			break;
+	}
+
+	test_zone_regenerated = true;
+}
+
 /* fullscreen
  * Sets fullscreen or windowed mode
  *******************************************************************/
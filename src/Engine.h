@@ -2,8 +2,18 @@
 #ifndef __ENGINE_H__
 #define __ENGINE_H__
 
+struct tick_input_t;
 namespace Engine
 {
+	// Runs that can be requested with requestStart
+	enum
+	{
+		START_NONE = 0,
+		START_FLYTHROUGH,
+		START_RECORDING,
+		START_REPLAY,
+	};
+
 	bool	init();
 	bool	createWindow();
 	bool	loadConfig();
@@ -13,6 +23,22 @@ namespace Engine
 	void	shutDown();
 	void	resizeWindow(int width, int height);
 	void	lockMouse(bool lock);
+	tick_input_t	readInput();
+	void	tick(const tick_input_t& input);
+	void	resetWorld();
+	void	waitForNextFrame();
+	void	setTickRate(unsigned rate);
+	void	snapCamera();
+	void	startBenchRun(string name, string results_file);
+	bool	endBenchRun();
+	bool	startFlythrough(string path_file, string results_file = "");
+	bool	stopFlythrough();
+	bool	startRecording(string filename);
+	void	stopRecording();
+	bool	startReplay(string filename, string results_file = "");
+	bool	stopReplay();
+	void	requestStart(int type, string file, string results_file = "");
+	void	startRequested();
 }
 
 #endif//__ENGINE_H__
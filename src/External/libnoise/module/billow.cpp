@@ -31,7 +31,8 @@ Billow::Billow ():
   m_noiseQuality (DEFAULT_BILLOW_QUALITY     ),
   m_octaveCount  (DEFAULT_BILLOW_OCTAVE_COUNT),
   m_persistence  (DEFAULT_BILLOW_PERSISTENCE ),
-  m_seed         (DEFAULT_BILLOW_SEED)
+  m_seed         (DEFAULT_BILLOW_SEED),
+  m_is2D         (false)
 {
 }
 
@@ -58,7 +59,11 @@ double Billow::GetValue (double x, double y, double z) const
     // Get the coherent-noise value from the input value and add it to the
     // final result.
     seed = (m_seed + curOctave) & 0xffffffff;
-    signal = GradientCoherentNoise3D (nx, ny, nz, seed, m_noiseQuality);
+    if (m_is2D) {
+      signal = GradientCoherentNoise2D (nx, ny, seed, m_noiseQuality);
+    } else {
+      signal = GradientCoherentNoise3D (nx, ny, nz, seed, m_noiseQuality);
+    }
     signal = 2.0 * fabs (signal) - 1.0;
     value += signal * curPersistence;
 
@@ -72,3 +77,64 @@ double Billow::GetValue (double x, double y, double z) const
 
   return value;
 }
+
+void Billow::GetValues (const double* x, const double* y, const double* z,
+  double* out, int count) const
+{
+  // Each block of input values is run through one octave at a time so that
+  // the coherent-noise values for the whole block are generated by a single
+  // call to the batch coherent-noise function.
+  double bx[BATCH_BLOCK_SIZE], by[BATCH_BLOCK_SIZE], bz[BATCH_BLOCK_SIZE];
+  double nx[BATCH_BLOCK_SIZE], ny[BATCH_BLOCK_SIZE], nz[BATCH_BLOCK_SIZE];
+  double signal[BATCH_BLOCK_SIZE];
+
+  for (int start = 0; start < count; start += BATCH_BLOCK_SIZE) {
+    int n = count - start;
+    if (n > BATCH_BLOCK_SIZE) {
+      n = BATCH_BLOCK_SIZE;
+    }
+    double* value = out + start;
+    for (int i = 0; i < n; i++) {
+      bx[i] = x[start + i] * m_frequency;
+      by[i] = y[start + i] * m_frequency;
+      bz[i] = z[start + i] * m_frequency;
+      value[i] = 0.0;
+    }
+
+    double curPersistence = 1.0;
+    for (int curOctave = 0; curOctave < m_octaveCount; curOctave++) {
+
+      // Make sure that these floating-point values have the same range as a
+      // 32-bit integer so that we can pass them to the coherent-noise
+      // functions.
+      for (int i = 0; i < n; i++) {
+        nx[i] = MakeInt32Range (bx[i]);
+        ny[i] = MakeInt32Range (by[i]);
+        nz[i] = MakeInt32Range (bz[i]);
+      }
+
+      // Get the coherent-noise values from the input values and add them to
+      // the final results.
+      int seed = (m_seed + curOctave) & 0xffffffff;
+      if (m_is2D) {
+        GradientCoherentNoise2D (nx, ny, signal, n, seed, m_noiseQuality);
+      } else {
+        GradientCoherentNoise3D (nx, ny, nz, signal, n, seed,
+          m_noiseQuality);
+      }
+      for (int i = 0; i < n; i++) {
+        value[i] += (2.0 * fabs (signal[i]) - 1.0) * curPersistence;
+
+        // Prepare the next octave.
+        bx[i] *= m_lacunarity;
+        by[i] *= m_lacunarity;
+        bz[i] *= m_lacunarity;
+      }
+      curPersistence *= m_persistence;
+    }
+
+    for (int i = 0; i < n; i++) {
+      value[i] += 0.5;
+    }
+  }
+}
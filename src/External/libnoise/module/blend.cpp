@@ -20,6 +20,7 @@
 // off every 'zig'.)
 //
 
+#include "../misc.h"
 #include "blend.h"
 #include "../interp.h"
 
@@ -41,3 +42,26 @@ double Blend::GetValue (double x, double y, double z) const
   double alpha = (m_pSourceModule[2]->GetValue (x, y, z) + 1.0) / 2.0;
   return LinearInterp (v0, v1, alpha);
 }
+
+void Blend::GetValues (const double* x, const double* y, const double* z,
+  double* out, int count) const
+{
+  assert (m_pSourceModule[0] != NULL);
+  assert (m_pSourceModule[1] != NULL);
+  assert (m_pSourceModule[2] != NULL);
+
+  m_pSourceModule[0]->GetValues (x, y, z, out, count);
+
+  double v1[BATCH_BLOCK_SIZE];
+  double control[BATCH_BLOCK_SIZE];
+  for (int start = 0; start < count; start += BATCH_BLOCK_SIZE) {
+    int n = GetMin (count - start, BATCH_BLOCK_SIZE);
+    m_pSourceModule[1]->GetValues (x + start, y + start, z + start, v1, n);
+    m_pSourceModule[2]->GetValues (x + start, y + start, z + start, control,
+      n);
+    for (int i = 0; i < n; i++) {
+      double alpha = (control[i] + 1.0) / 2.0;
+      out[start + i] = LinearInterp (out[start + i], v1[i], alpha);
+    }
+  }
+}
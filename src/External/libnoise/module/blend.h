@@ -105,6 +105,9 @@ namespace noise
 
 	      virtual double GetValue (double x, double y, double z) const;
 
+        virtual void GetValues (const double* x, const double* y,
+          const double* z, double* out, int count) const;
+
         /// Sets the control module.
         ///
         /// @param controlModule The control module.
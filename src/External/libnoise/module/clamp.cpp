@@ -52,3 +52,18 @@ void Clamp::SetBounds (double lowerBound, double upperBound)
   m_lowerBound = lowerBound;
   m_upperBound = upperBound;
 }
+
+void Clamp::GetValues (const double* x, const double* y, const double* z,
+  double* out, int count) const
+{
+  assert (m_pSourceModule[0] != NULL);
+
+  m_pSourceModule[0]->GetValues (x, y, z, out, count);
+  for (int i = 0; i < count; i++) {
+    if (out[i] < m_lowerBound) {
+      out[i] = m_lowerBound;
+    } else if (out[i] > m_upperBound) {
+      out[i] = m_upperBound;
+    }
+  }
+}
@@ -37,3 +37,14 @@ double Exponent::GetValue (double x, double y, double z) const
   double value = m_pSourceModule[0]->GetValue (x, y, z);
   return (pow (fabs ((value + 1.0) / 2.0), m_exponent) * 2.0 - 1.0);
 }
+
+void Exponent::GetValues (const double* x, const double* y,
+  const double* z, double* out, int count) const
+{
+  assert (m_pSourceModule[0] != NULL);
+
+  m_pSourceModule[0]->GetValues (x, y, z, out, count);
+  for (int i = 0; i < count; i++) {
+    out[i] = (pow (fabs ((out[i] + 1.0) / 2.0), m_exponent) * 2.0 - 1.0);
+  }
+}
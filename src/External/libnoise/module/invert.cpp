@@ -35,3 +35,14 @@ double Invert::GetValue (double x, double y, double z) const
 
   return -(m_pSourceModule[0]->GetValue (x, y, z));
 }
+
+void Invert::GetValues (const double* x, const double* y, const double* z,
+  double* out, int count) const
+{
+  assert (m_pSourceModule[0] != NULL);
+
+  m_pSourceModule[0]->GetValues (x, y, z, out, count);
+  for (int i = 0; i < count; i++) {
+    out[i] = -out[i];
+  }
+}
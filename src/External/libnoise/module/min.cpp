@@ -39,3 +39,23 @@ double Min::GetValue (double x, double y, double z) const
   double v1 = m_pSourceModule[1]->GetValue (x, y, z);
   return GetMin (v0, v1);
 }
+
+void Min::GetValues (const double* x, const double* y, const double* z,
+  double* out, int count) const
+{
+  assert (m_pSourceModule[0] != NULL);
+  assert (m_pSourceModule[1] != NULL);
+
+  // Output values from the first source module go straight into the output
+  // array; the second source module is evaluated a block at a time.
+  m_pSourceModule[0]->GetValues (x, y, z, out, count);
+
+  double v1[BATCH_BLOCK_SIZE];
+  for (int start = 0; start < count; start += BATCH_BLOCK_SIZE) {
+    int n = GetMin (count - start, BATCH_BLOCK_SIZE);
+    m_pSourceModule[1]->GetValues (x + start, y + start, z + start, v1, n);
+    for (int i = 0; i < n; i++) {
+      out[start + i] = GetMin (out[start + i], v1[i]);
+    }
+  }
+}
@@ -44,3 +44,11 @@ Module::~Module ()
 {
   delete[] m_pSourceModule;
 }
+
+void Module::GetValues (const double* x, const double* y, const double* z,
+  double* out, int count) const
+{
+  for (int i = 0; i < count; i++) {
+    out[i] = GetValue (x[i], y[i], z[i]);
+  }
+}
@@ -43,6 +43,10 @@ namespace noise
     /// @addtogroup modules
     /// @{
 
+    /// Number of input values processed at a time by noise modules that need
+    /// temporary storage for batch evaluation with GetValues().
+    const int BATCH_BLOCK_SIZE = 256;
+
     /// Abstract base class for noise modules.
     ///
     /// A <i>noise module</i> is an object that calculates and outputs a value
@@ -295,6 +299,28 @@ namespace noise
         /// module, call the GetSourceModuleCount() method.
         virtual double GetValue (double x, double y, double z) const = 0;
 
+        /// Generates output values for a batch of input values.
+        ///
+        /// @param x An array of @a count @a x coordinates.
+        /// @param y An array of @a count @a y coordinates.
+        /// @param z An array of @a count @a z coordinates.
+        /// @param out An array that receives the @a count output values.
+        /// @param count The number of input values.
+        ///
+        /// @pre All source modules required by this noise module have been
+        /// passed to the SetSourceModule() method.
+        ///
+        /// Each output value is the same value GetValue() would return for
+        /// the corresponding input value.
+        ///
+        /// The default implementation calls GetValue() once per input value.
+        /// The generator modules override this method to run each octave
+        /// over the whole batch with the batch coherent-noise functions, and
+        /// most combiner, modifier and transformer modules override it to
+        /// pass whole batches to their source modules.
+        virtual void GetValues (const double* x, const double* y,
+          const double* z, double* out, int count) const;
+
         /// Connects a source module to this noise module.
         ///
         /// @param index An index value to assign to this source module.
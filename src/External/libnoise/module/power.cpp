@@ -19,6 +19,7 @@
 // The developer's email is angstrom@lionsanctuary.net
 //
 
+#include "../misc.h"
 #include "power.h"
 
 using namespace noise::module;
@@ -36,3 +37,23 @@ double Power::GetValue (double x, double y, double z) const
   return pow (m_pSourceModule[0]->GetValue (x, y, z),
     m_pSourceModule[1]->GetValue (x, y, z));
 }
+
+void Power::GetValues (const double* x, const double* y, const double* z,
+  double* out, int count) const
+{
+  assert (m_pSourceModule[0] != NULL);
+  assert (m_pSourceModule[1] != NULL);
+
+  // Output values from the first source module go straight into the output
+  // array; the second source module is evaluated a block at a time.
+  m_pSourceModule[0]->GetValues (x, y, z, out, count);
+
+  double v1[BATCH_BLOCK_SIZE];
+  for (int start = 0; start < count; start += BATCH_BLOCK_SIZE) {
+    int n = GetMin (count - start, BATCH_BLOCK_SIZE);
+    m_pSourceModule[1]->GetValues (x + start, y + start, z + start, v1, n);
+    for (int i = 0; i < n; i++) {
+      out[start + i] = pow (out[start + i], v1[i]);
+    }
+  }
+}
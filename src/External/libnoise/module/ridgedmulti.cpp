@@ -30,7 +30,8 @@ RidgedMulti::RidgedMulti ():
   m_lacunarity   (DEFAULT_RIDGED_LACUNARITY  ),
   m_noiseQuality (DEFAULT_RIDGED_QUALITY     ),
   m_octaveCount  (DEFAULT_RIDGED_OCTAVE_COUNT),
-  m_seed         (DEFAULT_RIDGED_SEED)
+  m_seed         (DEFAULT_RIDGED_SEED),
+  m_is2D         (false)
 {
   CalcSpectralWeights ();
 }
@@ -78,7 +79,11 @@ double RidgedMulti::GetValue (double x, double y, double z) const
 
     // Get the coherent-noise value.
     int seed = (m_seed + curOctave) & 0x7fffffff;
-    signal = GradientCoherentNoise3D (nx, ny, nz, seed, m_noiseQuality);
+    if (m_is2D) {
+      signal = GradientCoherentNoise2D (nx, ny, seed, m_noiseQuality);
+    } else {
+      signal = GradientCoherentNoise3D (nx, ny, nz, seed, m_noiseQuality);
+    }
 
     // Make the ridges.
     signal = fabs (signal);
@@ -112,3 +117,85 @@ double RidgedMulti::GetValue (double x, double y, double z) const
 
   return (value * 1.25) - 1.0;
 }
+
+void RidgedMulti::GetValues (const double* x, const double* y, const double* z,
+  double* out, int count) const
+{
+  // Each block of input values is run through one octave at a time so that
+  // the coherent-noise values for the whole block are generated by a single
+  // call to the batch coherent-noise function.
+  double bx[BATCH_BLOCK_SIZE], by[BATCH_BLOCK_SIZE], bz[BATCH_BLOCK_SIZE];
+  double nx[BATCH_BLOCK_SIZE], ny[BATCH_BLOCK_SIZE], nz[BATCH_BLOCK_SIZE];
+  double signal[BATCH_BLOCK_SIZE];
+  double weight[BATCH_BLOCK_SIZE];
+
+  for (int start = 0; start < count; start += BATCH_BLOCK_SIZE) {
+    int n = count - start;
+    if (n > BATCH_BLOCK_SIZE) {
+      n = BATCH_BLOCK_SIZE;
+    }
+    double* value = out + start;
+    for (int i = 0; i < n; i++) {
+      bx[i] = x[start + i] * m_frequency;
+      by[i] = y[start + i] * m_frequency;
+      bz[i] = z[start + i] * m_frequency;
+      value[i] = 0.0;
+      weight[i] = 1.0;
+    }
+
+    // These parameters should be user-defined; they may be exposed in a
+    // future version of libnoise.
+    double offset = 1.0;
+    double gain = 2.0;
+
+    for (int curOctave = 0; curOctave < m_octaveCount; curOctave++) {
+
+      // Make sure that these floating-point values have the same range as a
+      // 32-bit integer so that we can pass them to the coherent-noise
+      // functions.
+      for (int i = 0; i < n; i++) {
+        nx[i] = MakeInt32Range (bx[i]);
+        ny[i] = MakeInt32Range (by[i]);
+        nz[i] = MakeInt32Range (bz[i]);
+      }
+
+      // Get the coherent-noise values.
+      int seed = (m_seed + curOctave) & 0x7fffffff;
+      if (m_is2D) {
+        GradientCoherentNoise2D (nx, ny, signal, n, seed, m_noiseQuality);
+      } else {
+        GradientCoherentNoise3D (nx, ny, nz, signal, n, seed,
+          m_noiseQuality);
+      }
+      for (int i = 0; i < n; i++) {
+        // Make the ridges, square the signal to sharpen them and apply the
+        // weighting from the previous octave, as in GetValue().
+        double s = offset - fabs (signal[i]);
+        s *= s;
+        s *= weight[i];
+
+        // Weight successive contributions by the previous signal.
+        double w = s * gain;
+        if (w > 1.0) {
+          w = 1.0;
+        }
+        if (w < 0.0) {
+          w = 0.0;
+        }
+        weight[i] = w;
+
+        // Add the signal to the output value.
+        value[i] += (s * m_pSpectralWeights[curOctave]);
+
+        // Go to the next octave.
+        bx[i] *= m_lacunarity;
+        by[i] *= m_lacunarity;
+        bz[i] *= m_lacunarity;
+      }
+    }
+
+    for (int i = 0; i < n; i++) {
+      value[i] = (value[i] * 1.25) - 1.0;
+    }
+  }
+}
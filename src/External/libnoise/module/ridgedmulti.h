@@ -204,6 +204,33 @@ namespace noise
 
         virtual double GetValue (double x, double y, double z) const;
 
+        virtual void GetValues (const double* x, const double* y,
+          const double* z, double* out, int count) const;
+
+        /// Determines if this noise module generates two-dimensional noise.
+        ///
+        /// @returns
+        /// - @a true if two-dimensional noise is generated.
+        /// - @a false if three-dimensional noise is generated.
+        bool Is2D () const
+        {
+          return m_is2D;
+        }
+
+        /// Enables or disables two-dimensional noise generation.
+        ///
+        /// @param is2D Specifies whether to generate two-dimensional noise.
+        ///
+        /// In two-dimensional mode the @a z coordinate of each input value is
+        /// ignored and each octave uses GradientCoherentNoise2D(), which is
+        /// about twice as fast as the three-dimensional noise function.  This
+        /// is intended for height maps.  The output for a given seed is
+        /// deterministic but differs from the three-dimensional output.
+        void Set2D (bool is2D)
+        {
+          m_is2D = is2D;
+        }
+
         /// Sets the frequency of the first octave.
         ///
         /// @param frequency The frequency of the first octave.
@@ -298,6 +325,9 @@ namespace noise
         /// Seed value used by the ridged-multfractal-noise function.
         int m_seed;
 
+        /// Determines if two-dimensional noise is generated.
+        bool m_is2D;
+
     };
 
     /// @}
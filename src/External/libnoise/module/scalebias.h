@@ -101,6 +101,9 @@ namespace noise
 
         virtual double GetValue (double x, double y, double z) const;
 
+        virtual void GetValues (const double* x, const double* y,
+          const double* z, double* out, int count) const;
+
         /// Sets the bias to apply to the scaled output value from the source
         /// module.
         ///
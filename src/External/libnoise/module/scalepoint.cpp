@@ -20,6 +20,7 @@
 // off every 'zig'.)
 //
 
+#include "../misc.h"
 #include "scalepoint.h"
 
 using namespace noise::module;
@@ -39,3 +40,22 @@ double ScalePoint::GetValue (double x, double y, double z) const
   return m_pSourceModule[0]->GetValue (x * m_xScale, y * m_yScale,
     z * m_zScale);
 }
+
+void ScalePoint::GetValues (const double* x, const double* y,
+  const double* z, double* out, int count) const
+{
+  assert (m_pSourceModule[0] != NULL);
+
+  double sx[BATCH_BLOCK_SIZE];
+  double sy[BATCH_BLOCK_SIZE];
+  double sz[BATCH_BLOCK_SIZE];
+  for (int start = 0; start < count; start += BATCH_BLOCK_SIZE) {
+    int n = GetMin (count - start, BATCH_BLOCK_SIZE);
+    for (int i = 0; i < n; i++) {
+      sx[i] = x[start + i] * m_xScale;
+      sy[i] = y[start + i] * m_yScale;
+      sz[i] = z[start + i] * m_zScale;
+    }
+    m_pSourceModule[0]->GetValues (sx, sy, sz, out + start, n);
+  }
+}
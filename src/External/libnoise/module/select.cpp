@@ -21,6 +21,7 @@
 //
 
 #include "../interp.h"
+#include "../misc.h"
 #include "select.h"
 
 using namespace noise::module;
@@ -107,3 +108,60 @@ void Select::SetEdgeFalloff (double edgeFalloff)
   double boundSize = m_upperBound - m_lowerBound;
   m_edgeFalloff = (edgeFalloff > boundSize / 2)? boundSize / 2: edgeFalloff;
 }
+
+void Select::GetValues (const double* x, const double* y, const double* z,
+  double* out, int count) const
+{
+  assert (m_pSourceModule[0] != NULL);
+  assert (m_pSourceModule[1] != NULL);
+  assert (m_pSourceModule[2] != NULL);
+
+  // Both source modules are evaluated for every input value so that each
+  // can be called with whole blocks; the selection is then done per value
+  // exactly as in GetValue().
+  double v0[BATCH_BLOCK_SIZE];
+  double v1[BATCH_BLOCK_SIZE];
+  double control[BATCH_BLOCK_SIZE];
+  for (int start = 0; start < count; start += BATCH_BLOCK_SIZE) {
+    int n = GetMin (count - start, BATCH_BLOCK_SIZE);
+    const double* bx = x + start;
+    const double* by = y + start;
+    const double* bz = z + start;
+    m_pSourceModule[0]->GetValues (bx, by, bz, v0, n);
+    m_pSourceModule[1]->GetValues (bx, by, bz, v1, n);
+    m_pSourceModule[2]->GetValues (bx, by, bz, control, n);
+
+    for (int i = 0; i < n; i++) {
+      double controlValue = control[i];
+      double value;
+      if (m_edgeFalloff > 0.0) {
+        if (controlValue < (m_lowerBound - m_edgeFalloff)) {
+          value = v0[i];
+        } else if (controlValue < (m_lowerBound + m_edgeFalloff)) {
+          double lowerCurve = (m_lowerBound - m_edgeFalloff);
+          double upperCurve = (m_lowerBound + m_edgeFalloff);
+          double alpha = SCurve3 (
+            (controlValue - lowerCurve) / (upperCurve - lowerCurve));
+          value = LinearInterp (v0[i], v1[i], alpha);
+        } else if (controlValue < (m_upperBound - m_edgeFalloff)) {
+          value = v1[i];
+        } else if (controlValue < (m_upperBound + m_edgeFalloff)) {
+          double lowerCurve = (m_upperBound - m_edgeFalloff);
+          double upperCurve = (m_upperBound + m_edgeFalloff);
+          double alpha = SCurve3 (
+            (controlValue - lowerCurve) / (upperCurve - lowerCurve));
+          value = LinearInterp (v1[i], v0[i], alpha);
+        } else {
+          value = v0[i];
+        }
+      } else {
+        if (controlValue < m_lowerBound || controlValue > m_upperBound) {
+          value = v0[i];
+        } else {
+          value = v1[i];
+        }
+      }
+      out[start + i] = value;
+    }
+  }
+}
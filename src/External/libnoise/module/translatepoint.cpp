@@ -20,6 +20,7 @@
 // off every 'zig'.)
 //
 
+#include "../misc.h"
 #include "translatepoint.h"
 
 using namespace noise::module;
@@ -39,3 +40,22 @@ double TranslatePoint::GetValue (double x, double y, double z) const
   return m_pSourceModule[0]->GetValue (x + m_xTranslation, y + m_yTranslation,
     z + m_zTranslation);
 }
+
+void TranslatePoint::GetValues (const double* x, const double* y,
+  const double* z, double* out, int count) const
+{
+  assert (m_pSourceModule[0] != NULL);
+
+  double tx[BATCH_BLOCK_SIZE];
+  double ty[BATCH_BLOCK_SIZE];
+  double tz[BATCH_BLOCK_SIZE];
+  for (int start = 0; start < count; start += BATCH_BLOCK_SIZE) {
+    int n = GetMin (count - start, BATCH_BLOCK_SIZE);
+    for (int i = 0; i < n; i++) {
+      tx[i] = x[start + i] + m_xTranslation;
+      ty[i] = y[start + i] + m_yTranslation;
+      tz[i] = z[start + i] + m_zTranslation;
+    }
+    m_pSourceModule[0]->GetValues (tx, ty, tz, out + start, n);
+  }
+}
@@ -90,6 +90,9 @@ namespace noise
 
         virtual double GetValue (double x, double y, double z) const;
 
+        virtual void GetValues (const double* x, const double* y,
+          const double* z, double* out, int count) const;
+
         /// Returns the translation amount to apply to the @a x coordinate of
         /// the input value.
         ///
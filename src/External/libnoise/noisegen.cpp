@@ -24,6 +24,18 @@
 #include "interp.h"
 #include "vectortable.h"
 
+// Pick the widest SIMD instruction set the compiler is targeting for the
+// batch coherent-noise functions.  Define NOISE_NO_SIMD to disable.
+#if !defined (NOISE_NO_SIMD)
+#if defined (__AVX2__)
+#define NOISE_SIMD_AVX2
+#include <immintrin.h>
+#elif defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NOISE_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+#endif
+
 using namespace noise;
 
 // Specifies the version of the coherent-noise functions to use.
@@ -111,6 +123,437 @@ double noise::GradientCoherentNoise3D (double x, double y, double z, int seed,
   return LinearInterp (iy0, iy1, zs);
 }
 
+// Returns the index into the random vector table used by GradientNoise3D()
+// for the given integer coordinates.
+static inline int GradientVectorIndex (int ix, int iy, int iz, int seed)
+{
+  int vectorIndex = (
+      X_NOISE_GEN    * ix
+    + Y_NOISE_GEN    * iy
+    + Z_NOISE_GEN    * iz
+    + SEED_NOISE_GEN * seed)
+    & 0xffffffff;
+  vectorIndex ^= (vectorIndex >> SHIFT_NOISE_GEN);
+  vectorIndex &= 0xff;
+  return vectorIndex << 2;
+}
+
+#if defined (NOISE_SIMD_AVX2)
+
+// Maps the fractional parts in @a a onto an S-curve, matching the scalar
+// SCurve3()/SCurve5() functions operation-for-operation.
+static inline __m256d SCurveAVX2 (__m256d a, NoiseQuality noiseQuality)
+{
+  if (noiseQuality == QUALITY_STD) {
+    __m256d aa = _mm256_mul_pd (a, a);
+    return _mm256_mul_pd (aa, _mm256_sub_pd (_mm256_set1_pd (3.0),
+      _mm256_mul_pd (_mm256_set1_pd (2.0), a)));
+  } else if (noiseQuality == QUALITY_BEST) {
+    __m256d a3 = _mm256_mul_pd (_mm256_mul_pd (a, a), a);
+    __m256d a4 = _mm256_mul_pd (a3, a);
+    __m256d a5 = _mm256_mul_pd (a4, a);
+    return _mm256_add_pd (
+      _mm256_sub_pd (_mm256_mul_pd (_mm256_set1_pd (6.0), a5),
+        _mm256_mul_pd (_mm256_set1_pd (15.0), a4)),
+      _mm256_mul_pd (_mm256_set1_pd (10.0), a3));
+  }
+  return a;
+}
+
+static inline __m256d LinearInterpAVX2 (__m256d n0, __m256d n1, __m256d a)
+{
+  return _mm256_add_pd (
+    _mm256_mul_pd (_mm256_sub_pd (_mm256_set1_pd (1.0), a), n0),
+    _mm256_mul_pd (a, n1));
+}
+
+// Gradient noise at one cube corner for four input values.  The vector
+// table is sampled with AVX2 gathers.
+static inline __m256d GradientNoiseAVX2 (__m256d fx, __m256d fy, __m256d fz,
+  __m128i ix, __m128i iy, __m128i iz, __m256d dx, __m256d dy, __m256d dz,
+  __m128i seedTerm)
+{
+  __m128i index = _mm_add_epi32 (_mm_add_epi32 (_mm_add_epi32 (
+      _mm_mullo_epi32 (_mm_set1_epi32 (X_NOISE_GEN), ix),
+      _mm_mullo_epi32 (_mm_set1_epi32 (Y_NOISE_GEN), iy)),
+      _mm_mullo_epi32 (_mm_set1_epi32 (Z_NOISE_GEN), iz)),
+      seedTerm);
+  index = _mm_xor_si128 (index, _mm_srai_epi32 (index, SHIFT_NOISE_GEN));
+  index = _mm_slli_epi32 (_mm_and_si128 (index, _mm_set1_epi32 (0xff)), 2);
+
+  __m256d xg = _mm256_i32gather_pd (g_randomVectors, index, 8);
+  __m256d yg = _mm256_i32gather_pd (g_randomVectors + 1, index, 8);
+  __m256d zg = _mm256_i32gather_pd (g_randomVectors + 2, index, 8);
+
+  __m256d dot = _mm256_add_pd (_mm256_add_pd (
+    _mm256_mul_pd (xg, _mm256_sub_pd (fx, dx)),
+    _mm256_mul_pd (yg, _mm256_sub_pd (fy, dy))),
+    _mm256_mul_pd (zg, _mm256_sub_pd (fz, dz)));
+  return _mm256_mul_pd (dot, _mm256_set1_pd (2.12));
+}
+
+// Four-wide version of GradientCoherentNoise3D().
+static inline void GradientCoherentNoise3DAVX2 (const double* px,
+  const double* py, const double* pz, double* out, int seed,
+  NoiseQuality noiseQuality)
+{
+  __m256d x = _mm256_loadu_pd (px);
+  __m256d y = _mm256_loadu_pd (py);
+  __m256d z = _mm256_loadu_pd (pz);
+  __m256d zero = _mm256_setzero_pd ();
+  __m256d one = _mm256_set1_pd (1.0);
+
+  // Create the unit-length cube surrounding each input value.  This matches
+  // the scalar (x > 0.0? (int)x: (int)x - 1).
+  __m256d x0 = _mm256_sub_pd (_mm256_cvtepi32_pd (_mm256_cvttpd_epi32 (x)),
+    _mm256_and_pd (_mm256_cmp_pd (x, zero, _CMP_NGT_UQ), one));
+  __m256d y0 = _mm256_sub_pd (_mm256_cvtepi32_pd (_mm256_cvttpd_epi32 (y)),
+    _mm256_and_pd (_mm256_cmp_pd (y, zero, _CMP_NGT_UQ), one));
+  __m256d z0 = _mm256_sub_pd (_mm256_cvtepi32_pd (_mm256_cvttpd_epi32 (z)),
+    _mm256_and_pd (_mm256_cmp_pd (z, zero, _CMP_NGT_UQ), one));
+  __m256d x1 = _mm256_add_pd (x0, one);
+  __m256d y1 = _mm256_add_pd (y0, one);
+  __m256d z1 = _mm256_add_pd (z0, one);
+  __m128i ix0 = _mm256_cvttpd_epi32 (x0);
+  __m128i iy0 = _mm256_cvttpd_epi32 (y0);
+  __m128i iz0 = _mm256_cvttpd_epi32 (z0);
+  __m128i ix1 = _mm256_cvttpd_epi32 (x1);
+  __m128i iy1 = _mm256_cvttpd_epi32 (y1);
+  __m128i iz1 = _mm256_cvttpd_epi32 (z1);
+
+  __m256d xs = SCurveAVX2 (_mm256_sub_pd (x, x0), noiseQuality);
+  __m256d ys = SCurveAVX2 (_mm256_sub_pd (y, y0), noiseQuality);
+  __m256d zs = SCurveAVX2 (_mm256_sub_pd (z, z0), noiseQuality);
+
+  __m128i st = _mm_set1_epi32 (SEED_NOISE_GEN * seed);
+  __m256d n0, n1, ix0v, ix1v, iy0v, iy1v;
+  n0   = GradientNoiseAVX2 (x, y, z, ix0, iy0, iz0, x0, y0, z0, st);
+  n1   = GradientNoiseAVX2 (x, y, z, ix1, iy0, iz0, x1, y0, z0, st);
+  ix0v = LinearInterpAVX2 (n0, n1, xs);
+  n0   = GradientNoiseAVX2 (x, y, z, ix0, iy1, iz0, x0, y1, z0, st);
+  n1   = GradientNoiseAVX2 (x, y, z, ix1, iy1, iz0, x1, y1, z0, st);
+  ix1v = LinearInterpAVX2 (n0, n1, xs);
+  iy0v = LinearInterpAVX2 (ix0v, ix1v, ys);
+  n0   = GradientNoiseAVX2 (x, y, z, ix0, iy0, iz1, x0, y0, z1, st);
+  n1   = GradientNoiseAVX2 (x, y, z, ix1, iy0, iz1, x1, y0, z1, st);
+  ix0v = LinearInterpAVX2 (n0, n1, xs);
+  n0   = GradientNoiseAVX2 (x, y, z, ix0, iy1, iz1, x0, y1, z1, st);
+  n1   = GradientNoiseAVX2 (x, y, z, ix1, iy1, iz1, x1, y1, z1, st);
+  ix1v = LinearInterpAVX2 (n0, n1, xs);
+  iy1v = LinearInterpAVX2 (ix0v, ix1v, ys);
+
+  _mm256_storeu_pd (out, LinearInterpAVX2 (iy0v, iy1v, zs));
+}
+
+// Gradient noise at one square corner for four two-dimensional input
+// values.
+static inline __m256d GradientNoise2DAVX2 (__m256d fx, __m256d fy,
+  __m128i ix, __m128i iy, __m256d dx, __m256d dy, __m128i seedTerm)
+{
+  __m128i index = _mm_add_epi32 (_mm_add_epi32 (
+      _mm_mullo_epi32 (_mm_set1_epi32 (X_NOISE_GEN), ix),
+      _mm_mullo_epi32 (_mm_set1_epi32 (Y_NOISE_GEN), iy)),
+      seedTerm);
+  index = _mm_xor_si128 (index, _mm_srai_epi32 (index, SHIFT_NOISE_GEN));
+  index = _mm_slli_epi32 (_mm_and_si128 (index, _mm_set1_epi32 (0xff)), 2);
+
+  __m256d xg = _mm256_i32gather_pd (g_randomVectors, index, 8);
+  __m256d yg = _mm256_i32gather_pd (g_randomVectors + 1, index, 8);
+
+  __m256d dot = _mm256_add_pd (
+    _mm256_mul_pd (xg, _mm256_sub_pd (fx, dx)),
+    _mm256_mul_pd (yg, _mm256_sub_pd (fy, dy)));
+  return _mm256_mul_pd (dot, _mm256_set1_pd (2.12));
+}
+
+// Four-wide version of GradientCoherentNoise2D().
+static inline void GradientCoherentNoise2DAVX2 (const double* px,
+  const double* py, double* out, int seed, NoiseQuality noiseQuality)
+{
+  __m256d x = _mm256_loadu_pd (px);
+  __m256d y = _mm256_loadu_pd (py);
+  __m256d zero = _mm256_setzero_pd ();
+  __m256d one = _mm256_set1_pd (1.0);
+
+  __m256d x0 = _mm256_sub_pd (_mm256_cvtepi32_pd (_mm256_cvttpd_epi32 (x)),
+    _mm256_and_pd (_mm256_cmp_pd (x, zero, _CMP_NGT_UQ), one));
+  __m256d y0 = _mm256_sub_pd (_mm256_cvtepi32_pd (_mm256_cvttpd_epi32 (y)),
+    _mm256_and_pd (_mm256_cmp_pd (y, zero, _CMP_NGT_UQ), one));
+  __m256d x1 = _mm256_add_pd (x0, one);
+  __m256d y1 = _mm256_add_pd (y0, one);
+  __m128i ix0 = _mm256_cvttpd_epi32 (x0);
+  __m128i iy0 = _mm256_cvttpd_epi32 (y0);
+  __m128i ix1 = _mm256_cvttpd_epi32 (x1);
+  __m128i iy1 = _mm256_cvttpd_epi32 (y1);
+
+  __m256d xs = SCurveAVX2 (_mm256_sub_pd (x, x0), noiseQuality);
+  __m256d ys = SCurveAVX2 (_mm256_sub_pd (y, y0), noiseQuality);
+
+  __m128i st = _mm_set1_epi32 (SEED_NOISE_GEN * seed);
+  __m256d n0, n1, ix0v, ix1v;
+  n0   = GradientNoise2DAVX2 (x, y, ix0, iy0, x0, y0, st);
+  n1   = GradientNoise2DAVX2 (x, y, ix1, iy0, x1, y0, st);
+  ix0v = LinearInterpAVX2 (n0, n1, xs);
+  n0   = GradientNoise2DAVX2 (x, y, ix0, iy1, x0, y1, st);
+  n1   = GradientNoise2DAVX2 (x, y, ix1, iy1, x1, y1, st);
+  ix1v = LinearInterpAVX2 (n0, n1, xs);
+
+  _mm256_storeu_pd (out, LinearInterpAVX2 (ix0v, ix1v, ys));
+}
+
+#elif defined (NOISE_SIMD_SSE2)
+
+// Maps the fractional parts in @a a onto an S-curve, matching the scalar
+// SCurve3()/SCurve5() functions operation-for-operation.
+static inline __m128d SCurveSSE2 (__m128d a, NoiseQuality noiseQuality)
+{
+  if (noiseQuality == QUALITY_STD) {
+    __m128d aa = _mm_mul_pd (a, a);
+    return _mm_mul_pd (aa, _mm_sub_pd (_mm_set1_pd (3.0),
+      _mm_mul_pd (_mm_set1_pd (2.0), a)));
+  } else if (noiseQuality == QUALITY_BEST) {
+    __m128d a3 = _mm_mul_pd (_mm_mul_pd (a, a), a);
+    __m128d a4 = _mm_mul_pd (a3, a);
+    __m128d a5 = _mm_mul_pd (a4, a);
+    return _mm_add_pd (
+      _mm_sub_pd (_mm_mul_pd (_mm_set1_pd (6.0), a5),
+        _mm_mul_pd (_mm_set1_pd (15.0), a4)),
+      _mm_mul_pd (_mm_set1_pd (10.0), a3));
+  }
+  return a;
+}
+
+static inline __m128d LinearInterpSSE2 (__m128d n0, __m128d n1, __m128d a)
+{
+  return _mm_add_pd (_mm_mul_pd (_mm_sub_pd (_mm_set1_pd (1.0), a), n0),
+    _mm_mul_pd (a, n1));
+}
+
+// Gradient noise at one cube corner for two input values.  SSE2 has no
+// 32-bit multiply or gather, so the table lookups are done per lane.
+static inline __m128d GradientNoiseSSE2 (__m128d fx, __m128d fy, __m128d fz,
+  const int* ix, const int* iy, const int* iz, __m128d dx, __m128d dy,
+  __m128d dz, int seed)
+{
+  int i0 = GradientVectorIndex (ix[0], iy[0], iz[0], seed);
+  int i1 = GradientVectorIndex (ix[1], iy[1], iz[1], seed);
+  __m128d xg = _mm_set_pd (g_randomVectors[i1    ], g_randomVectors[i0    ]);
+  __m128d yg = _mm_set_pd (g_randomVectors[i1 + 1], g_randomVectors[i0 + 1]);
+  __m128d zg = _mm_set_pd (g_randomVectors[i1 + 2], g_randomVectors[i0 + 2]);
+
+  __m128d dot = _mm_add_pd (_mm_add_pd (
+    _mm_mul_pd (xg, _mm_sub_pd (fx, dx)),
+    _mm_mul_pd (yg, _mm_sub_pd (fy, dy))),
+    _mm_mul_pd (zg, _mm_sub_pd (fz, dz)));
+  return _mm_mul_pd (dot, _mm_set1_pd (2.12));
+}
+
+// Two-wide version of GradientCoherentNoise3D().
+static inline void GradientCoherentNoise3DSSE2 (const double* px,
+  const double* py, const double* pz, double* out, int seed,
+  NoiseQuality noiseQuality)
+{
+  __m128d x = _mm_loadu_pd (px);
+  __m128d y = _mm_loadu_pd (py);
+  __m128d z = _mm_loadu_pd (pz);
+  __m128d zero = _mm_setzero_pd ();
+  __m128d one = _mm_set1_pd (1.0);
+
+  // Create the unit-length cube surrounding each input value.  This matches
+  // the scalar (x > 0.0? (int)x: (int)x - 1).
+  __m128d x0 = _mm_sub_pd (_mm_cvtepi32_pd (_mm_cvttpd_epi32 (x)),
+    _mm_and_pd (_mm_cmpngt_pd (x, zero), one));
+  __m128d y0 = _mm_sub_pd (_mm_cvtepi32_pd (_mm_cvttpd_epi32 (y)),
+    _mm_and_pd (_mm_cmpngt_pd (y, zero), one));
+  __m128d z0 = _mm_sub_pd (_mm_cvtepi32_pd (_mm_cvttpd_epi32 (z)),
+    _mm_and_pd (_mm_cmpngt_pd (z, zero), one));
+  __m128d x1 = _mm_add_pd (x0, one);
+  __m128d y1 = _mm_add_pd (y0, one);
+  __m128d z1 = _mm_add_pd (z0, one);
+
+  int ix0[4], iy0[4], iz0[4], ix1[4], iy1[4], iz1[4];
+  _mm_storeu_si128 ((__m128i*)ix0, _mm_cvttpd_epi32 (x0));
+  _mm_storeu_si128 ((__m128i*)iy0, _mm_cvttpd_epi32 (y0));
+  _mm_storeu_si128 ((__m128i*)iz0, _mm_cvttpd_epi32 (z0));
+  _mm_storeu_si128 ((__m128i*)ix1, _mm_cvttpd_epi32 (x1));
+  _mm_storeu_si128 ((__m128i*)iy1, _mm_cvttpd_epi32 (y1));
+  _mm_storeu_si128 ((__m128i*)iz1, _mm_cvttpd_epi32 (z1));
+
+  __m128d xs = SCurveSSE2 (_mm_sub_pd (x, x0), noiseQuality);
+  __m128d ys = SCurveSSE2 (_mm_sub_pd (y, y0), noiseQuality);
+  __m128d zs = SCurveSSE2 (_mm_sub_pd (z, z0), noiseQuality);
+
+  __m128d n0, n1, ix0v, ix1v, iy0v, iy1v;
+  n0   = GradientNoiseSSE2 (x, y, z, ix0, iy0, iz0, x0, y0, z0, seed);
+  n1   = GradientNoiseSSE2 (x, y, z, ix1, iy0, iz0, x1, y0, z0, seed);
+  ix0v = LinearInterpSSE2 (n0, n1, xs);
+  n0   = GradientNoiseSSE2 (x, y, z, ix0, iy1, iz0, x0, y1, z0, seed);
+  n1   = GradientNoiseSSE2 (x, y, z, ix1, iy1, iz0, x1, y1, z0, seed);
+  ix1v = LinearInterpSSE2 (n0, n1, xs);
+  iy0v = LinearInterpSSE2 (ix0v, ix1v, ys);
+  n0   = GradientNoiseSSE2 (x, y, z, ix0, iy0, iz1, x0, y0, z1, seed);
+  n1   = GradientNoiseSSE2 (x, y, z, ix1, iy0, iz1, x1, y0, z1, seed);
+  ix0v = LinearInterpSSE2 (n0, n1, xs);
+  n0   = GradientNoiseSSE2 (x, y, z, ix0, iy1, iz1, x0, y1, z1, seed);
+  n1   = GradientNoiseSSE2 (x, y, z, ix1, iy1, iz1, x1, y1, z1, seed);
+  ix1v = LinearInterpSSE2 (n0, n1, xs);
+  iy1v = LinearInterpSSE2 (ix0v, ix1v, ys);
+
+  _mm_storeu_pd (out, LinearInterpSSE2 (iy0v, iy1v, zs));
+}
+
+// Gradient noise at one square corner for two two-dimensional input
+// values.
+static inline __m128d GradientNoise2DSSE2 (__m128d fx, __m128d fy,
+  const int* ix, const int* iy, __m128d dx, __m128d dy, int seed)
+{
+  int i0 = GradientVectorIndex (ix[0], iy[0], 0, seed);
+  int i1 = GradientVectorIndex (ix[1], iy[1], 0, seed);
+  __m128d xg = _mm_set_pd (g_randomVectors[i1    ], g_randomVectors[i0    ]);
+  __m128d yg = _mm_set_pd (g_randomVectors[i1 + 1], g_randomVectors[i0 + 1]);
+
+  __m128d dot = _mm_add_pd (
+    _mm_mul_pd (xg, _mm_sub_pd (fx, dx)),
+    _mm_mul_pd (yg, _mm_sub_pd (fy, dy)));
+  return _mm_mul_pd (dot, _mm_set1_pd (2.12));
+}
+
+// Two-wide version of GradientCoherentNoise2D().
+static inline void GradientCoherentNoise2DSSE2 (const double* px,
+  const double* py, double* out, int seed, NoiseQuality noiseQuality)
+{
+  __m128d x = _mm_loadu_pd (px);
+  __m128d y = _mm_loadu_pd (py);
+  __m128d zero = _mm_setzero_pd ();
+  __m128d one = _mm_set1_pd (1.0);
+
+  __m128d x0 = _mm_sub_pd (_mm_cvtepi32_pd (_mm_cvttpd_epi32 (x)),
+    _mm_and_pd (_mm_cmpngt_pd (x, zero), one));
+  __m128d y0 = _mm_sub_pd (_mm_cvtepi32_pd (_mm_cvttpd_epi32 (y)),
+    _mm_and_pd (_mm_cmpngt_pd (y, zero), one));
+  __m128d x1 = _mm_add_pd (x0, one);
+  __m128d y1 = _mm_add_pd (y0, one);
+
+  int ix0[4], iy0[4], ix1[4], iy1[4];
+  _mm_storeu_si128 ((__m128i*)ix0, _mm_cvttpd_epi32 (x0));
+  _mm_storeu_si128 ((__m128i*)iy0, _mm_cvttpd_epi32 (y0));
+  _mm_storeu_si128 ((__m128i*)ix1, _mm_cvttpd_epi32 (x1));
+  _mm_storeu_si128 ((__m128i*)iy1, _mm_cvttpd_epi32 (y1));
+
+  __m128d xs = SCurveSSE2 (_mm_sub_pd (x, x0), noiseQuality);
+  __m128d ys = SCurveSSE2 (_mm_sub_pd (y, y0), noiseQuality);
+
+  __m128d n0, n1, ix0v, ix1v;
+  n0   = GradientNoise2DSSE2 (x, y, ix0, iy0, x0, y0, seed);
+  n1   = GradientNoise2DSSE2 (x, y, ix1, iy0, x1, y0, seed);
+  ix0v = LinearInterpSSE2 (n0, n1, xs);
+  n0   = GradientNoise2DSSE2 (x, y, ix0, iy1, x0, y1, seed);
+  n1   = GradientNoise2DSSE2 (x, y, ix1, iy1, x1, y1, seed);
+  ix1v = LinearInterpSSE2 (n0, n1, xs);
+
+  _mm_storeu_pd (out, LinearInterpSSE2 (ix0v, ix1v, ys));
+}
+
+#endif
+
+void noise::GradientCoherentNoise3D (const double* x, const double* y,
+  const double* z, double* out, int count, int seed,
+  NoiseQuality noiseQuality)
+{
+  int i = 0;
+#if defined (NOISE_SIMD_AVX2)
+  for (; i + 4 <= count; i += 4) {
+    GradientCoherentNoise3DAVX2 (x + i, y + i, z + i, out + i, seed,
+      noiseQuality);
+  }
+#elif defined (NOISE_SIMD_SSE2)
+  for (; i + 2 <= count; i += 2) {
+    GradientCoherentNoise3DSSE2 (x + i, y + i, z + i, out + i, seed,
+      noiseQuality);
+  }
+#endif
+  for (; i < count; i++) {
+    out[i] = GradientCoherentNoise3D (x[i], y[i], z[i], seed, noiseQuality);
+  }
+}
+
+void noise::GradientCoherentNoise2D (const double* x, const double* y,
+  double* out, int count, int seed, NoiseQuality noiseQuality)
+{
+  int i = 0;
+#if defined (NOISE_SIMD_AVX2)
+  for (; i + 4 <= count; i += 4) {
+    GradientCoherentNoise2DAVX2 (x + i, y + i, out + i, seed, noiseQuality);
+  }
+#elif defined (NOISE_SIMD_SSE2)
+  for (; i + 2 <= count; i += 2) {
+    GradientCoherentNoise2DSSE2 (x + i, y + i, out + i, seed, noiseQuality);
+  }
+#endif
+  for (; i < count; i++) {
+    out[i] = GradientCoherentNoise2D (x[i], y[i], seed, noiseQuality);
+  }
+}
+
+double noise::GradientCoherentNoise2D (double x, double y, int seed,
+  NoiseQuality noiseQuality)
+{
+  // Create a unit-length square aligned along an integer boundary.  This
+  // square surrounds the input point.
+  int x0 = (x > 0.0? (int)x: (int)x - 1);
+  int x1 = x0 + 1;
+  int y0 = (y > 0.0? (int)y: (int)y - 1);
+  int y1 = y0 + 1;
+
+  // Map the difference between the coordinates of the input value and the
+  // coordinates of the square's lower-left vertex onto an S-curve.
+  double xs = 0, ys = 0;
+  switch (noiseQuality) {
+    case QUALITY_FAST:
+      xs = (x - (double)x0);
+      ys = (y - (double)y0);
+      break;
+    case QUALITY_STD:
+      xs = SCurve3 (x - (double)x0);
+      ys = SCurve3 (y - (double)y0);
+      break;
+    case QUALITY_BEST:
+      xs = SCurve5 (x - (double)x0);
+      ys = SCurve5 (y - (double)y0);
+      break;
+  }
+
+  // Calculate the noise values at each corner of the square and
+  // interpolate them (bilinear interpolation.)
+  double n0, n1, ix0, ix1;
+  n0   = GradientNoise2D (x, y, x0, y0, seed);
+  n1   = GradientNoise2D (x, y, x1, y0, seed);
+  ix0  = LinearInterp (n0, n1, xs);
+  n0   = GradientNoise2D (x, y, x0, y1, seed);
+  n1   = GradientNoise2D (x, y, x1, y1, seed);
+  ix1  = LinearInterp (n0, n1, xs);
+
+  return LinearInterp (ix0, ix1, ys);
+}
+
+double noise::GradientNoise2D (double fx, double fy, int ix, int iy,
+  int seed)
+{
+  // Pick a gradient vector the same way GradientNoise3D() does, then
+  // compute the dot product of its x and y components with the distance
+  // vector.
+  int vectorIndex = GradientVectorIndex (ix, iy, 0, seed);
+
+  double xvGradient = g_randomVectors[vectorIndex    ];
+  double yvGradient = g_randomVectors[vectorIndex + 1];
+
+  double xvPoint = (fx - (double)ix);
+  double yvPoint = (fy - (double)iy);
+
+  return ((xvGradient * xvPoint)
+    + (yvGradient * yvPoint)) * 2.12;
+}
+
 double noise::GradientNoise3D (double fx, double fy, double fz, int ix,
   int iy, int iz, int seed)
 {
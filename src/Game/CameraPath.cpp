@@ -0,0 +1,113 @@
+
+#include "Main.h"
+#include "CameraPath.h"
+#include "Utilities/Tokenizer.h"
+
+CameraPath::CameraPath()
+{
+	_speed = 30.0f;
+}
+
+/* CameraPath::open
+ * Reads the path from [filename], which is a list of
+ * 'point <x> <y> <z>' (player positions) and 'speed <units/sec>'
+ * entries. A speed applies from the previous point onwards. Returns
+ * false if the file couldn't be read or has less than two points
+ *******************************************************************/
+bool CameraPath::open(string filename)
+{
+	_points.clear();
+	_times.clear();
+	_speed = 30.0f;
+
+	Tokenizer tz;
+	if (!tz.openFile(filename))
+	{
+		logMessage(1, "Unable to open path file %s", CHR(filename));
+		return false;
+	}
+
+	string token = tz.getToken();
+	while (!token.empty())
+	{
+		if (token == "speed")
+		{
+			_speed = tz.getFloat();
+			if (_speed <= 0.0f)
+			{
+				logMessage(1, "Path file %s: invalid speed on line %d", CHR(filename), tz.lineNo());
+				return false;
+			}
+		}
+		else if (token == "point")
+		{
+			fpoint3_t point;
+			point.x = tz.getFloat();
+			point.y = tz.getFloat();
+			point.z = tz.getFloat();
+
+			// Skip points that don't go anywhere, there's no direction
+			// to face at them
+			if (!_points.empty() && (point - _points.back()).magnitude() < 0.001f)
+			{
+				token = tz.getToken();
+				continue;
+			}
+
+			_times.push_back(_points.empty() ? 0.0f : _times.back() + (point - _points.back()).magnitude() / _speed);
+			_points.push_back(point);
+		}
+		else
+		{
+			logMessage(1, "Path file %s: unknown keyword \"%s\" on line %d", CHR(filename), CHR(token), tz.lineNo());
+			return false;
+		}
+
+		token = tz.getToken();
+	}
+
+	if (_points.size() < 2)
+	{
+		logMessage(1, "Path file %s needs at least two points", CHR(filename));
+		return false;
+	}
+
+	return true;
+}
+
+/* CameraPath::sample
+ * Sets [position] and [direction] to where the player is on the path
+ * [time] seconds in, facing along it. Times outside the path are
+ * clamped to its ends
+ *******************************************************************/
+void CameraPath::sample(float time, fpoint3_t& position, fpoint3_t& direction)
+{
+	if (_points.size() < 2)
+		return;
+
+	// Find the segment [time] is in
+	unsigned seg = 0;
+	while (seg + 2 < _points.size() && time >= _times[seg + 1])
+		seg++;
+	float u = (time - _times[seg]) / (_times[seg + 1] - _times[seg]);
+	if (u < 0.0f)
+		u = 0.0f;
+	if (u > 1.0f)
+		u = 1.0f;
+
+	// The end points are doubled up so the path goes through them
+	fpoint3_t p0 = _points[seg > 0 ? seg - 1 : seg];
+	fpoint3_t p1 = _points[seg];
+	fpoint3_t p2 = _points[seg + 1];
+	fpoint3_t p3 = _points[seg + 2 < _points.size() ? seg + 2 : seg + 1];
+
+	// Catmull-Rom spline, and its derivative for the direction
+	fpoint3_t a = p1 * 2.0f;
+	fpoint3_t b = p2 - p0;
+	fpoint3_t c = p0 * 2.0f - p1 * 5.0f + p2 * 4.0f - p3;
+	fpoint3_t d = p1 * 3.0f - p0 - p2 * 3.0f + p3;
+	position = (a + b * u + c * (u * u) + d * (u * u * u)) * 0.5f;
+	direction = (b + c * (2.0f * u) + d * (3.0f * u * u)).normalize();
+	if (direction.magnitude() == 0.0f)
+		direction = (p2 - p1).normalize();
+}
@@ -0,0 +1,26 @@
+
+#ifndef __CAMERA_PATH_H__
+#define __CAMERA_PATH_H__
+
+// A scripted path for the player to follow (see bench_flythrough). The
+// path is a Catmull-Rom spline through a list of points, travelled at a
+// constant number of units per second between each pair of points
+class CameraPath
+{
+private:
+	vector<fpoint3_t>	_points;
+	vector<float>		_times;		// When each point is reached, in seconds
+	float				_speed;
+
+public:
+	CameraPath();
+	~CameraPath() {}
+
+	unsigned	numPoints() { return _points.size(); }
+	float		duration() { return _times.empty() ? 0.0f : _times.back(); }
+
+	bool	open(string filename);
+	void	sample(float time, fpoint3_t& position, fpoint3_t& direction);
+};
+
+#endif//__CAMERA_PATH_H__
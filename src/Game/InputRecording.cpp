@@ -0,0 +1,317 @@
+
+#include "Main.h"
+#include "InputRecording.h"
+
+#define RECORDING_VERSION	2
+
+// Set in a recorded tick's keys when mouse movement follows
+#define INPUT_MOUSE		0x80
+
+// A frame's tick count is a byte, this many means the frame carries on
+// in the next count
+#define MAX_FRAME_TICKS	255
+
+// Everything is written little endian, whatever the platform
+static void write8(FILE* fp, uint8_t value)
+{
+	fputc(value, fp);
+}
+
+static void write16(FILE* fp, uint16_t value)
+{
+	write8(fp, value & 0xFF);
+	write8(fp, value >> 8);
+}
+
+static void write32(FILE* fp, uint32_t value)
+{
+	write16(fp, value & 0xFFFF);
+	write16(fp, value >> 16);
+}
+
+static void writeFloat(FILE* fp, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	write32(fp, bits);
+}
+
+static bool read8(FILE* fp, uint8_t& value)
+{
+	int c = fgetc(fp);
+	value = (uint8_t)c;
+	return c != EOF;
+}
+
+static bool read16(FILE* fp, uint16_t& value)
+{
+	uint8_t lo, hi;
+	if (!read8(fp, lo) || !read8(fp, hi))
+		return false;
+	value = lo | (hi << 8);
+	return true;
+}
+
+static bool read32(FILE* fp, uint32_t& value)
+{
+	uint16_t lo, hi;
+	if (!read16(fp, lo) || !read16(fp, hi))
+		return false;
+	value = lo | ((uint32_t)hi << 16);
+	return true;
+}
+
+static bool readFloat(FILE* fp, float& value)
+{
+	uint32_t bits;
+	if (!read32(fp, bits))
+		return false;
+	memcpy(&value, &bits, 4);
+	return true;
+}
+
+static bool readString(FILE* fp, string& value, unsigned length)
+{
+	value.resize(length);
+	return length == 0 || fread(&value[0], 1, length, fp) == length;
+}
+
+InputRecording::InputRecording()
+{
+	_fp = nullptr;
+	_writing = false;
+	_finished = false;
+	_n_frames = 0;
+	_n_ticks = 0;
+}
+
+InputRecording::~InputRecording()
+{
+	close();
+}
+
+/* InputRecording::create
+ * Starts a new recording in [filename], beginning with [header].
+ * Returns false if the file couldn't be opened
+ *******************************************************************/
+bool InputRecording::create(string filename, const header_t& header)
+{
+	close();
+	_fp = fopen(CHR(filename), "wb");
+	if (!_fp)
+		return false;
+
+	_writing = true;
+	_finished = false;
+	_n_frames = 0;
+	_n_ticks = 0;
+
+	fwrite("VXIR", 1, 4, _fp);
+	write8(_fp, RECORDING_VERSION);
+	write16(_fp, header.tick_rate);
+	write32(_fp, header.random_seed);
+	writeFloat(_fp, header.position.x);
+	writeFloat(_fp, header.position.y);
+	writeFloat(_fp, header.position.z);
+	writeFloat(_fp, header.direction.x);
+	writeFloat(_fp, header.direction.y);
+	writeFloat(_fp, header.direction.z);
+
+	write16(_fp, header.cvar_names.size());
+	for (unsigned a = 0; a < header.cvar_names.size(); a++)
+	{
+		const string& name = header.cvar_names[a];
+		const string& value = header.cvar_values[a];
+		write8(_fp, name.size());
+		fwrite(name.data(), 1, name.size(), _fp);
+		write16(_fp, value.size());
+		fwrite(value.data(), 1, value.size(), _fp);
+	}
+
+	return true;
+}
+
+/* InputRecording::addTick
+ * Adds [input] to the current frame
+ *******************************************************************/
+void InputRecording::addTick(const tick_input_t& input)
+{
+	if (_writing)
+		_frame.push_back(input);
+}
+
+/* InputRecording::endFrame
+ * Writes out the ticks recorded since the last frame ended, and the
+ * [fraction] of a tick the frame was drawn past the last of them
+ *******************************************************************/
+void InputRecording::endFrame(float fraction)
+{
+	if (!_writing)
+		return;
+
+	unsigned n_ticks = _frame.size();
+	unsigned index = 0;
+	do
+	{
+		unsigned count = n_ticks - index < MAX_FRAME_TICKS ? n_ticks - index : MAX_FRAME_TICKS;
+		write8(_fp, count);
+		for (unsigned a = index; a < index + count; a++)
+		{
+			const tick_input_t& input = _frame[a];
+			bool mouse = input.mouse_x != 0 || input.mouse_y != 0;
+			write8(_fp, input.keys | (mouse ? INPUT_MOUSE : 0));
+			if (mouse)
+			{
+				write16(_fp, input.mouse_x);
+				write16(_fp, input.mouse_y);
+			}
+		}
+		index += count;
+
+		// A full count means the frame carries on, which needs another
+		// count even if it's 0
+		if (count < MAX_FRAME_TICKS)
+			break;
+	}
+	while (true);
+	writeFloat(_fp, fraction);
+
+	_n_frames++;
+	_n_ticks += n_ticks;
+	_frame.clear();
+}
+
+/* InputRecording::open
+ * Opens the recording in [filename] for replay, reading its header
+ * into [header]. Returns false if it isn't a valid recording
+ *******************************************************************/
+bool InputRecording::open(string filename, header_t& header)
+{
+	close();
+	_fp = fopen(CHR(filename), "rb");
+	if (!_fp)
+	{
+		logMessage(1, "Unable to open recording %s", CHR(filename));
+		return false;
+	}
+
+	_writing = false;
+	_finished = false;
+	_n_frames = 0;
+	_n_ticks = 0;
+
+	char magic[4];
+	uint8_t version = 0;
+	if (fread(magic, 1, 4, _fp) != 4 || memcmp(magic, "VXIR", 4) != 0 || !read8(_fp, version))
+	{
+		logMessage(1, "%s is not an input recording", CHR(filename));
+		close();
+		return false;
+	}
+	if (version != RECORDING_VERSION)
+	{
+		logMessage(1, "%s is recording version %d, only version %d is supported", CHR(filename), version, RECORDING_VERSION);
+		close();
+		return false;
+	}
+
+	uint16_t tick_rate, n_cvars;
+	uint32_t seed;
+	bool ok = read16(_fp, tick_rate) && read32(_fp, seed) &&
+		readFloat(_fp, header.position.x) && readFloat(_fp, header.position.y) && readFloat(_fp, header.position.z) &&
+		readFloat(_fp, header.direction.x) && readFloat(_fp, header.direction.y) && readFloat(_fp, header.direction.z) &&
+		read16(_fp, n_cvars);
+	header.tick_rate = tick_rate;
+	header.random_seed = (int)seed;
+
+	header.cvar_names.clear();
+	header.cvar_values.clear();
+	for (unsigned a = 0; ok && a < n_cvars; a++)
+	{
+		uint8_t name_length;
+		uint16_t value_length;
+		string name, value;
+		ok = read8(_fp, name_length) && readString(_fp, name, name_length) &&
+			read16(_fp, value_length) && readString(_fp, value, value_length);
+		header.cvar_names.push_back(name);
+		header.cvar_values.push_back(value);
+	}
+
+	if (!ok)
+	{
+		logMessage(1, "Recording %s is truncated", CHR(filename));
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+/* InputRecording::readFrame
+ * Reads the next frame's ticks into [ticks], and the fraction of a
+ * tick it was drawn past them into [fraction]. Returns false once the
+ * end of the recording is reached
+ *******************************************************************/
+bool InputRecording::readFrame(vector<tick_input_t>& ticks, float& fraction)
+{
+	ticks.clear();
+	if (!_fp || _writing || _finished)
+		return false;
+
+	uint8_t count;
+	do
+	{
+		if (!read8(_fp, count))
+		{
+			// The end of the file should only come between frames
+			_finished = true;
+			return false;
+		}
+
+		for (unsigned a = 0; a < count; a++)
+		{
+			tick_input_t input;
+			uint16_t mouse_x = 0, mouse_y = 0;
+			if (!read8(_fp, input.keys) || ((input.keys & INPUT_MOUSE) && !(read16(_fp, mouse_x) && read16(_fp, mouse_y))))
+			{
+				_finished = true;
+				return false;
+			}
+
+			input.keys &= ~INPUT_MOUSE;
+			input.mouse_x = (int16_t)mouse_x;
+			input.mouse_y = (int16_t)mouse_y;
+			ticks.push_back(input);
+		}
+	}
+	while (count == MAX_FRAME_TICKS);
+
+	if (!readFloat(_fp, fraction))
+	{
+		_finished = true;
+		return false;
+	}
+
+	_n_frames++;
+	_n_ticks += ticks.size();
+	return true;
+}
+
+/* InputRecording::close
+ * Closes the recording, writing out anything not yet written
+ *******************************************************************/
+void InputRecording::close()
+{
+	if (!_fp)
+		return;
+
+	// The frame being recorded was never drawn, replay it at the end
+	// of its last tick
+	if (_writing && !_frame.empty())
+		endFrame(1.0f);
+
+	fclose(_fp);
+	_fp = nullptr;
+	_writing = false;
+	_finished = true;
+}
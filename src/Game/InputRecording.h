@@ -0,0 +1,70 @@
+
+#ifndef __INPUT_RECORDING_H__
+#define __INPUT_RECORDING_H__
+
+// Movement keys held during a tick
+#define INPUT_FORWARD		0x01
+#define INPUT_BACK			0x02
+#define INPUT_STRAFE_LEFT	0x04
+#define INPUT_STRAFE_RIGHT	0x08
+#define INPUT_TURN_LEFT		0x10
+#define INPUT_TURN_RIGHT	0x20
+
+// Everything the player did in one simulation tick (see Engine::tick)
+struct tick_input_t
+{
+	uint8_t	keys;		// INPUT_* flags
+	int16_t	mouse_x;	// Mouse movement over the tick
+	int16_t	mouse_y;
+
+	tick_input_t() { keys = 0; mouse_x = mouse_y = 0; }
+};
+
+// A recording of the input for every tick, grouped into the frames the
+// ticks ran in, so a session can be replayed frame for frame. The file
+// starts with what's needed to get back to the same starting point
+// (seed, cvars and player position), then each frame is a tick count
+// and a byte per tick, plus the mouse movement if there was any, and
+// how far the frame was drawn towards the next tick
+class InputRecording
+{
+public:
+	struct header_t
+	{
+		unsigned		tick_rate;		// Ticks per second
+		int				random_seed;
+		fpoint3_t		position;		// Player position and direction
+		fpoint3_t		direction;
+		vector<string>	cvar_names;		// All saved cvars
+		vector<string>	cvar_values;
+	};
+
+private:
+	FILE*					_fp;
+	bool					_writing;
+	bool					_finished;
+	vector<tick_input_t>	_frame;		// Ticks recorded this frame
+	unsigned				_n_frames;
+	unsigned				_n_ticks;
+
+public:
+	InputRecording();
+	~InputRecording();
+
+	unsigned	numFrames() { return _n_frames; }
+	unsigned	numTicks() { return _n_ticks; }
+	bool		finished() { return _finished; }
+
+	// Recording
+	bool	create(string filename, const header_t& header);
+	void	addTick(const tick_input_t& input);
+	void	endFrame(float fraction);
+
+	// Replay
+	bool	open(string filename, header_t& header);
+	bool	readFrame(vector<tick_input_t>& ticks, float& fraction);
+
+	void	close();
+};
+
+#endif//__INPUT_RECORDING_H__
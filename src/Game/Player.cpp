@@ -6,6 +6,7 @@
 Player::Player()
 {
 	_facing.set(0.5f, 0.5f);
+	_pitch = 0.0f;
 	_flying = true;
 	updateVectors();
 }
@@ -71,6 +72,18 @@ void Player::pitch(float amount)
 	updateVectors();
 }
 
+void Player::setDirection(fpoint3_t direction)
+{
+	// Facing is the horizontal part, pitch the angle above it
+	float horizontal = sqrt(direction.x * direction.x + direction.y * direction.y);
+	if (horizontal > 0.0f)
+		_facing.set(direction.x, direction.y);
+	_pitch = atan2(direction.z, horizontal);
+
+	// Update vectors
+	updateVectors();
+}
+
 void Player::updateVectors()
 {
 	// Normalize direction
@@ -26,6 +26,8 @@ public:
 	void	strafe(float distance);
 	void	pitch(float amount);
 	void	updateVectors();
+	void	setPosition(fpoint3_t position) { _position = position; }
+	void	setDirection(fpoint3_t direction);
 };
 
 #endif//__PLAYER_H__
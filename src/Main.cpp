@@ -51,13 +51,30 @@ namespace Global
  *******************************************************************/
 
 /* main
- * The program entry point and main loop
+ * The program entry point and main loop. Any console commands given on
+ * the command line, each starting with a + (eg. '+bench_flythrough
+ * path.txt'), are run once the engine is initialised
  *******************************************************************/
-int main()
+int main(int argc, char** argv)
 {
 	// Init Engine
 	if (!Engine::init())
 		return 1;
+
+	// Run command line commands
+	string command;
+	for (int a = 1; a <= argc; a++)
+	{
+		if (a == argc || argv[a][0] == '+')
+		{
+			if (!command.empty())
+				Console::execute(command);
+			if (a < argc)
+				command = argv[a] + 1;
+		}
+		else if (!command.empty())
+			command += S_FMT(" \"%s\"", argv[a]);
+	}
 
 	// Main Loop
 	while (Engine::mainLoop());
@@ -17,7 +17,10 @@ typedef unsigned __int64 uint64_t;
 #else
 #include <stdint.h>
 #endif
+#include <cstring>
+#ifndef VOXIGINE_HEADLESS
 #include <SFML/System.hpp>
+#endif
 
 // Use std::string
 #include <string>
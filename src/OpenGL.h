@@ -43,6 +43,33 @@ namespace OpenGL
 		}
 	};
 
+	// Compact vertex for terrain meshes. The position is relative to the
+	// zone origin, and the colour is looked up from [palette] (or drawn
+	// per palette batch with glColor)
+	struct packed_vertex_t
+	{
+		int16_t x, y, z;
+		int16_t palette;
+
+		packed_vertex_t()
+		{
+			x = y = z = palette = 0;
+		}
+
+		packed_vertex_t(int16_t x, int16_t y, int16_t z, int16_t palette)
+		{
+			set(x, y, z, palette);
+		}
+
+		void set(int16_t x, int16_t y, int16_t z, int16_t palette)
+		{
+			this->x = x;
+			this->y = y;
+			this->z = z;
+			this->palette = palette;
+		}
+	};
+
 	struct quad_vbo_t
 	{
 		unsigned	vertices_id;
@@ -0,0 +1,243 @@
+
+#include "Main.h"
+#include "glew/glew.h"
+#include "BufferArena.h"
+#include "GLState.h"
+#include "UploadRing.h"
+#include <algorithm>
+
+// Rounds [value] up to a multiple of [align]
+static inline unsigned alignUp(unsigned value, unsigned align)
+{
+	return ((value + align - 1) / align) * align;
+}
+
+BufferArena::BufferArena(unsigned target, unsigned capacity)
+{
+	_target = target;
+	_buffer = 0;
+	_capacity = capacity;
+	_used = 0;
+	_n_compactions = 0;
+	_ring = nullptr;
+
+	// Start with the whole buffer free, it's created on the first
+	// allocation
+	range_t all = { 0, capacity };
+	_free.push_back(all);
+}
+
+BufferArena::~BufferArena()
+{
+	if (_buffer != 0)
+	{
+		glDeleteBuffers(1, &_buffer);
+		GLState::bufferDeleted(_buffer);
+	}
+}
+
+/* BufferArena::findRange
+ * Finds the first free range that can hold [size] bytes at a multiple
+ * of [align] and takes it out of the free list. Returns false if
+ * there isn't one
+ *******************************************************************/
+bool BufferArena::findRange(unsigned size, unsigned align, unsigned& offset)
+{
+	for (unsigned a = 0; a < _free.size(); a++)
+	{
+		range_t range = _free[a];
+		unsigned start = alignUp(range.offset, align);
+		if (start + size > range.offset + range.size)
+			continue;
+
+		// Anything before and after the allocation stays free
+		range_t before = { range.offset, start - range.offset };
+		range_t after = { start + size, range.offset + range.size - (start + size) };
+		_free.erase(_free.begin() + a);
+		if (after.size > 0)
+			_free.insert(_free.begin() + a, after);
+		if (before.size > 0)
+			_free.insert(_free.begin() + a, before);
+
+		offset = start;
+		return true;
+	}
+
+	return false;
+}
+
+/* BufferArena::releaseRange
+ * Returns [size] bytes at [offset] to the free list, merging with the
+ * ranges either side
+ *******************************************************************/
+void BufferArena::releaseRange(unsigned offset, unsigned size)
+{
+	// Find the first free range after this one
+	unsigned a = 0;
+	while (a < _free.size() && _free[a].offset < offset)
+		a++;
+
+	range_t range = { offset, size };
+	_free.insert(_free.begin() + a, range);
+
+	// Merge with the next range
+	if (a + 1 < _free.size() && _free[a].offset + _free[a].size == _free[a + 1].offset)
+	{
+		_free[a].size += _free[a + 1].size;
+		_free.erase(_free.begin() + a + 1);
+	}
+
+	// Merge with the previous range
+	if (a > 0 && _free[a - 1].offset + _free[a - 1].size == _free[a].offset)
+	{
+		_free[a - 1].size += _free[a].size;
+		_free.erase(_free.begin() + a);
+	}
+}
+
+/* BufferArena::compactedSize
+ * Returns the bytes needed to hold all current allocations packed
+ * together, plus one more of [extra_size] at [extra_align]
+ *******************************************************************/
+unsigned BufferArena::compactedSize(unsigned extra_size, unsigned extra_align)
+{
+	unsigned end = 0;
+	for (unsigned a = 0; a < _blocks.size(); a++)
+		if (_blocks[a].used)
+			end = alignUp(end, _blocks[a].align) + _blocks[a].size;
+
+	return alignUp(end, extra_align) + extra_size;
+}
+
+/* BufferArena::compact
+ * Moves all allocations to the start of the buffer, in their current
+ * order, leaving all the free space in one range at the end. The
+ * buffer is resized to [capacity] at the same time. This reads the
+ * whole buffer back so it stalls, but only happens when an allocation
+ * doesn't fit
+ *******************************************************************/
+void BufferArena::compact(unsigned capacity)
+{
+	// Allocations in buffer order
+	vector<unsigned> order;
+	for (unsigned a = 0; a < _blocks.size(); a++)
+		if (_blocks[a].used)
+			order.push_back(a);
+	std::sort(order.begin(), order.end(), [this](unsigned l, unsigned r) { return _blocks[l].offset < _blocks[r].offset; });
+
+	vector<uint8_t> old_data(_capacity);
+	vector<uint8_t> new_data(capacity);
+	GLState::bindBuffer(_target, _buffer);
+	if (!order.empty())
+		glGetBufferSubData(_target, 0, _capacity, &old_data[0]);
+
+	unsigned end = 0;
+	for (unsigned a = 0; a < order.size(); a++)
+	{
+		block_t& block = _blocks[order[a]];
+		end = alignUp(end, block.align);
+		memcpy(&new_data[end], &old_data[block.offset], block.size);
+		block.offset = end;
+		end += block.size;
+	}
+
+	glBufferData(_target, capacity, &new_data[0], GL_DYNAMIC_DRAW);
+	GLState::countCalls(2);
+
+	_capacity = capacity;
+	_free.clear();
+	if (end < capacity)
+	{
+		range_t range = { end, capacity - end };
+		_free.push_back(range);
+	}
+	_n_compactions++;
+}
+
+/* BufferArena::allocate
+ * Allocates [size] bytes at a multiple of [align] and uploads [data]
+ * to it. If there is no free range big enough the arena is compacted,
+ * and grown if that still wouldn't be enough. Returns the handle of
+ * the allocation, or ARENA_NONE if [size] is 0
+ *******************************************************************/
+unsigned BufferArena::allocate(unsigned size, unsigned align, const void* data)
+{
+	if (size == 0)
+		return ARENA_NONE;
+
+	if (_buffer == 0)
+	{
+		glGenBuffers(1, &_buffer);
+		GLState::bindBuffer(_target, _buffer);
+		glBufferData(_target, _capacity, nullptr, GL_DYNAMIC_DRAW);
+		GLState::countCalls(2);
+	}
+
+	unsigned offset;
+	if (!findRange(size, align, offset))
+	{
+		unsigned capacity = _capacity;
+		while (capacity < compactedSize(size, align))
+			capacity *= 2;
+		compact(capacity);
+		findRange(size, align, offset);
+	}
+
+	// Get a handle
+	block_t block = { offset, size, align, true };
+	unsigned handle;
+	if (_free_handles.empty())
+	{
+		handle = _blocks.size();
+		_blocks.push_back(block);
+	}
+	else
+	{
+		handle = _free_handles.back();
+		_free_handles.pop_back();
+		_blocks[handle] = block;
+	}
+	_used += size;
+
+	// Stream the data through the upload ring if there is one, so the
+	// driver doesn't have to copy it or wait for the arena to be idle
+	if (!_ring || !_ring->upload(_buffer, offset, data, size))
+	{
+		GLState::bindBuffer(_target, _buffer);
+		glBufferSubData(_target, offset, size, data);
+		GLState::countCalls();
+	}
+
+	return handle;
+}
+
+/* BufferArena::release
+ * Frees the allocation [handle]
+ *******************************************************************/
+void BufferArena::release(unsigned handle)
+{
+	if (handle == ARENA_NONE)
+		return;
+
+	block_t& block = _blocks[handle];
+	if (!block.used)
+		return;
+
+	releaseRange(block.offset, block.size);
+	_used -= block.size;
+	block.used = false;
+	_free_handles.push_back(handle);
+}
+
+/* BufferArena::largestFreeRange
+ * Returns the size of the largest free range, in bytes. Compared to
+ * the total free space this shows how fragmented the arena is
+ *******************************************************************/
+unsigned BufferArena::largestFreeRange() const
+{
+	unsigned largest = 0;
+	for (unsigned a = 0; a < _free.size(); a++)
+		largest = max(largest, _free[a].size);
+
+	return largest;
+}
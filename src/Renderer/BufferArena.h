@@ -0,0 +1,65 @@
+
+#ifndef __BUFFER_ARENA_H__
+#define __BUFFER_ARENA_H__
+
+class UploadRing;
+
+// Handle for an allocation that doesn't exist
+const unsigned ARENA_NONE = 0xFFFFFFFF;
+
+// A single OpenGL buffer that many meshes are sub-allocated from, so
+// they can all be drawn without rebinding. Allocations are referred to
+// by handle since compacting the arena moves them around
+class BufferArena
+{
+private:
+	struct block_t
+	{
+		unsigned	offset;
+		unsigned	size;
+		unsigned	align;
+		bool		used;
+	};
+
+	struct range_t
+	{
+		unsigned	offset;
+		unsigned	size;
+	};
+
+	unsigned			_target;		// GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER
+	unsigned			_buffer;
+	unsigned			_capacity;		// Size of the buffer in bytes
+	unsigned			_used;			// Bytes allocated, not counting alignment padding
+	vector<block_t>		_blocks;		// Allocations, indexed by handle
+	vector<unsigned>	_free_handles;	// Unused entries in _blocks
+	vector<range_t>		_free;			// Free space, sorted by offset
+	unsigned			_n_compactions;
+	UploadRing*			_ring;			// Uploads go through this if set
+
+	bool		findRange(unsigned size, unsigned align, unsigned& offset);
+	void		releaseRange(unsigned offset, unsigned size);
+	unsigned	compactedSize(unsigned extra_size, unsigned extra_align);
+	void		compact(unsigned capacity);
+
+public:
+	BufferArena(unsigned target, unsigned capacity);
+	~BufferArena();
+
+	unsigned	bufferId() const { return _buffer; }
+	unsigned	offset(unsigned handle) const { return _blocks[handle].offset; }
+	void		setUploadRing(UploadRing* ring) { _ring = ring; }
+
+	unsigned	allocate(unsigned size, unsigned align, const void* data);
+	void		release(unsigned handle);
+
+	// Stats
+	unsigned	capacity() const { return _capacity; }
+	unsigned	usedBytes() const { return _used; }
+	unsigned	numAllocations() const { return _blocks.size() - _free_handles.size(); }
+	unsigned	numFreeRanges() const { return _free.size(); }
+	unsigned	largestFreeRange() const;
+	unsigned	numCompactions() const { return _n_compactions; }
+};
+
+#endif//__BUFFER_ARENA_H__
@@ -3,6 +3,7 @@
 #include "Camera.h"
 #include "Utilities/Math.h"
 #include <SFML/OpenGL.hpp>
+#include <cmath>
 
 Camera::Camera()
 {
@@ -24,6 +25,52 @@ float* Camera::getGLMatrix()
 	return _gl_matrix;
 }
 
+/* Camera::viewMatrix
+ * Returns the (column-major) view matrix for the camera, the same as
+ * applyView would multiply onto the modelview matrix
+ *******************************************************************/
+mat4f_t Camera::viewMatrix()
+{
+	fpoint3_t f = _direction.normalize();
+	fpoint3_t s = f.cross(_up).normalize();
+	fpoint3_t u = s.cross(f);
+
+	mat4f_t ret;
+	ret[0] = s.x;
+	ret[4] = s.y;
+	ret[8] = s.z;
+	ret[1] = u.x;
+	ret[5] = u.y;
+	ret[9] = u.z;
+	ret[2] = -f.x;
+	ret[6] = -f.y;
+	ret[10] = -f.z;
+	ret[12] = -s.dot(_position);
+	ret[13] = -u.dot(_position);
+	ret[14] = f.dot(_position);
+	ret[15] = 1.0f;
+
+	return ret;
+}
+
+/* Camera::perspectiveMatrix
+ * Returns a perspective projection matrix, the same as gluPerspective
+ * would produce
+ *******************************************************************/
+mat4f_t Camera::perspectiveMatrix(float fovy, float aspect, float z_near, float z_far)
+{
+	mat4f_t ret;
+	float scale = 1.0f / tanf((float)Math::degToRad(fovy) / 2.0f);
+
+	ret[0] = scale / aspect;
+	ret[5] = scale;
+	ret[10] = (z_far + z_near) / (z_near - z_far);
+	ret[14] = (2 * z_far * z_near) / (z_near - z_far);
+	ret[11] = -1.0f;
+
+	return ret;
+}
+
 void Camera::applyView()
 {
 	gluLookAt(_position.x, _position.y, _position.z,
@@ -21,6 +21,8 @@ public:
 	fpoint3_t	getStrafe() { return _strafe; }
 
 	float*	getGLMatrix();
+	mat4f_t	viewMatrix();
+	static mat4f_t	perspectiveMatrix(float fovy, float aspect, float z_near, float z_far);
 	void	applyView();
 
 	void	set(fpoint3_t position, fpoint3_t direction);
@@ -0,0 +1,478 @@
+
+#include "Main.h"
+#include "CellMesh.h"
+#include "World/Cell.h"
+#include "World/Zone.h"
+#include "Utilities/VertexCache.h"
+#include "Utilities/Profiler.h"
+#include <cassert>
+
+
+CellMesh::CellMesh()
+{
+	_compact = false;
+	clear();
+}
+
+CellMesh::~CellMesh()
+{
+}
+
+void CellMesh::clear()
+{
+	for (unsigned a = 0; a < NUM_FACE_TYPES; a++)
+	{
+		_quads[a].clear();
+		_group_quads[a] = 0;
+		_group_indices[a] = 0;
+	}
+	_vertices.clear();
+	_packed.clear();
+	_indices.clear();
+	_n_quads_naive = 0;
+}
+
+const void* CellMesh::vertexData() const
+{
+	if (_compact)
+		return _packed.empty() ? nullptr : &_packed[0];
+	else
+		return _vertices.empty() ? nullptr : &_vertices[0];
+}
+
+// Mesh coordinates are all whole numbers relative to the cell origin
+static inline int16_t quantize(float value)
+{
+	return (int16_t)floorf(value + 0.5f);
+}
+
+void CellMesh::addQuad(uint8_t face,
+	float x1, float y1, float z1,
+	float x2, float y2, float z2,
+	float x3, float y3, float z3,
+	float x4, float y4, float z4)
+{
+	vector<OpenGL::packed_vertex_t>& quads = _quads[face];
+	quads.push_back(OpenGL::packed_vertex_t(quantize(x1), quantize(y1), quantize(z1), face));
+	quads.push_back(OpenGL::packed_vertex_t(quantize(x2), quantize(y2), quantize(z2), face));
+	quads.push_back(OpenGL::packed_vertex_t(quantize(x3), quantize(y3), quantize(z3), face));
+	quads.push_back(OpenGL::packed_vertex_t(quantize(x4), quantize(y4), quantize(z4), face));
+}
+
+/* CellMesh::build
+ * Builds the mesh for [cell] at [lod_level]. Top faces and walls are
+ * greedily merged into the largest rectangles possible, and walls
+ * between samples of equal height are skipped entirely.
+ *
+ * [neighbour_lods] gives the LOD each neighbouring cell in [zone] is
+ * drawn at (see NEIGHBOUR_*), or LOD_NONE if it isn't drawn. Walls on
+ * the cell's edges are only emitted where this cell is higher than
+ * its neighbour; the neighbour emits the wall where it is higher
+ *******************************************************************/
+void CellMesh::build(Zone& zone, Cell* cell, uint8_t lod_level, const uint8_t* neighbour_lods, bool compact)
+{
+	PROF_SCOPE("CellMesh::build");
+	assert(!compact || canPack(zone));
+
+	clear();
+	_compact = compact;
+
+	unsigned dim = lodDim(lod_level);
+	float size = 32.0f / dim;
+	rgba_t col_top(40, 130, 40, 255);
+	if (lod_level == 1)
+		col_top.set(130, 100, 40, 255);
+	else if (lod_level == 2)
+		col_top.set(130, 100, 180, 255);
+	else if (lod_level == 3)
+		col_top.set(40, 150, 100, 255);
+
+	_palette[FACE_TOP] = col_top;
+	_palette[FACE_X] = col_top.ampf(0.8f, 0.8f, 0.8f, 1.0f);
+	_palette[FACE_Y] = col_top.ampf(0.7f, 0.7f, 0.7f, 1.0f);
+
+	// Grab the heights once, heightAt is too slow to hit repeatedly
+	float heights[32 * 32];
+	for (unsigned x = 0; x < dim; x++)
+		for (unsigned y = 0; y < dim; y++)
+			heights[x * dim + y] = cell->heightAt(lod_level, x, y);
+
+	// One top and one wall per axis per sample, plus the far edge walls
+	_n_quads_naive = dim * dim * 3 + dim * 2;
+
+	// Quads are built relative to the cell origin
+	buildTop(heights, dim, size);
+
+	// Interior walls, [a] is the sample on the positive side of the line
+	float a[32], b[32];
+	for (unsigned x = 1; x < dim; x++)
+	{
+		for (unsigned y = 0; y < dim; y++)
+		{
+			a[y] = heights[x * dim + y];
+			b[y] = heights[(x - 1) * dim + y];
+		}
+		buildWallX(x * size, size, a, b, dim);
+	}
+	for (unsigned y = 1; y < dim; y++)
+	{
+		for (unsigned x = 0; x < dim; x++)
+		{
+			a[x] = heights[x * dim + y];
+			b[x] = heights[x * dim + y - 1];
+		}
+		buildWallY(y * size, size, a, b, dim);
+	}
+
+	// Edge walls. These are built at the finer of the two cells' LODs so
+	// each segment has a single height on both sides
+	for (unsigned side = 0; side < 4; side++)
+	{
+		int nx = cell->zoneX();
+		int ny = cell->zoneY();
+		if (side == NEIGHBOUR_WEST) nx--;
+		else if (side == NEIGHBOUR_EAST) nx++;
+		else if (side == NEIGHBOUR_SOUTH) ny--;
+		else ny++;
+
+		Cell* neighbour = zone.getCell(nx, ny);
+		uint8_t n_lod = neighbour_lods ? neighbour_lods[side] : LOD_NONE;
+		if (n_lod == LOD_NONE)
+			neighbour = nullptr;
+
+		unsigned n_dim = neighbour ? lodDim(n_lod) : dim;
+		unsigned seg_dim = max(dim, n_dim);
+		bool positive = (side == NEIGHBOUR_EAST || side == NEIGHBOUR_NORTH);
+		for (unsigned i = 0; i < seg_dim; i++)
+		{
+			// Sample index across the edge for this cell and the neighbour
+			unsigned s = i * dim / seg_dim;
+			unsigned ns = i * n_dim / seg_dim;
+			unsigned edge = positive ? dim - 1 : 0;
+			unsigned n_edge = positive ? 0 : n_dim - 1;
+
+			float own;
+			float other = 0.0f;
+			if (side == NEIGHBOUR_WEST || side == NEIGHBOUR_EAST)
+			{
+				own = heights[edge * dim + s];
+				if (neighbour)
+					other = neighbour->heightAt(n_lod, n_edge, ns);
+			}
+			else
+			{
+				own = heights[s * dim + edge];
+				if (neighbour)
+					other = neighbour->heightAt(n_lod, ns, n_edge);
+			}
+
+			// Hidden (or the neighbour's to draw)
+			if (other >= own)
+				other = own;
+
+			a[i] = positive ? other : own;
+			b[i] = positive ? own : other;
+		}
+
+		float seg = 32.0f / seg_dim;
+		if (side == NEIGHBOUR_WEST)
+			buildWallX(0.0f, seg, a, b, seg_dim);
+		else if (side == NEIGHBOUR_EAST)
+			buildWallX(32.0f, seg, a, b, seg_dim);
+		else if (side == NEIGHBOUR_SOUTH)
+			buildWallY(0.0f, seg, a, b, seg_dim);
+		else
+			buildWallY(32.0f, seg, a, b, seg_dim);
+	}
+
+	finish(cell->zoneX() * 32.0f, cell->zoneY() * 32.0f);
+}
+
+/* CellMesh::finish
+ * Turns the quads built for each face type into an indexed triangle
+ * list. Identical vertices within a face type are shared, each face
+ * type's triangles are ordered for the vertex cache, and vertices are
+ * stored in the order they are first used. The vertices are then
+ * offset by the cell origin ([origin_x],[origin_y]) and either kept
+ * packed or converted to full vertices
+ *******************************************************************/
+void CellMesh::finish(float origin_x, float origin_y)
+{
+	// Quads are all within the cell so vertex x and y are on a 33x33
+	// grid. Each grid position holds the first shared vertex there, the
+	// others (at different heights) are chained on from it
+	const unsigned grid_dim = 33;
+	const uint16_t no_vertex = 0xFFFF;
+	uint16_t grid[grid_dim * grid_dim];
+
+	_unique.clear();
+	_unique_next.clear();
+	for (unsigned a = 0; a < NUM_FACE_TYPES; a++)
+	{
+		const vector<OpenGL::packed_vertex_t>& quads = _quads[a];
+		_group_quads[a] = quads.size() / 4;
+
+		// Palettes differ between face types so nothing can be shared
+		// with the previous group
+		memset(grid, 0xFF, sizeof(grid));
+
+		unsigned first = _indices.size();
+		for (unsigned q = 0; q < quads.size(); q += 4)
+		{
+			uint16_t index[4];
+			for (unsigned c = 0; c < 4; c++)
+			{
+				const OpenGL::packed_vertex_t& pv = quads[q + c];
+				assert(pv.x >= 0 && pv.x < (int)grid_dim && pv.y >= 0 && pv.y < (int)grid_dim);
+				uint16_t& head = grid[pv.x * grid_dim + pv.y];
+
+				uint16_t i = head;
+				while (i != no_vertex && _unique[i].z != pv.z)
+					i = _unique_next[i];
+
+				if (i == no_vertex)
+				{
+					i = _unique.size();
+					_unique.push_back(pv);
+					_unique_next.push_back(head);
+					head = i;
+				}
+				index[c] = i;
+			}
+
+			// Split into two triangles, keeping the quad's winding
+			_indices.push_back(index[0]);
+			_indices.push_back(index[1]);
+			_indices.push_back(index[2]);
+			_indices.push_back(index[0]);
+			_indices.push_back(index[2]);
+			_indices.push_back(index[3]);
+		}
+
+		_group_indices[a] = _indices.size() - first;
+		if (_group_indices[a] > 0)
+			VertexCache::optimize(&_indices[first], _group_indices[a], _unique.size());
+	}
+
+	// Put the vertices in the order the triangles use them, offset by
+	// the cell origin. Packed positions are relative to the zone
+	// origin (see canPack)
+	int16_t ox = (int16_t)origin_x;
+	int16_t oy = (int16_t)origin_y;
+	if (_compact)
+		_packed.reserve(_unique.size());
+	else
+		_vertices.reserve(_unique.size());
+	_remap.assign(_unique.size(), -1);
+	for (unsigned a = 0; a < _indices.size(); a++)
+	{
+		int& remap = _remap[_indices[a]];
+		if (remap < 0)
+		{
+			const OpenGL::packed_vertex_t& pv = _unique[_indices[a]];
+			if (_compact)
+			{
+				remap = _packed.size();
+				_packed.push_back(pv);
+				_packed.back().x += ox;
+				_packed.back().y += oy;
+			}
+			else
+			{
+				remap = _vertices.size();
+				_vertices.push_back(OpenGL::vertex_t(origin_x + pv.x, origin_y + pv.y, pv.z, _palette[pv.palette]));
+			}
+		}
+		_indices[a] = remap;
+	}
+
+	for (unsigned a = 0; a < NUM_FACE_TYPES; a++)
+		_quads[a].clear();
+}
+
+/* CellMesh::canPack
+ * Returns true if meshes of cells in [zone] can use packed vertices,
+ * ie. the zone is at most MAX_PACKED_ZONE_CELLS across
+ *******************************************************************/
+bool CellMesh::canPack(const Zone& zone)
+{
+	return zone.getWidth() <= MAX_PACKED_ZONE_CELLS && zone.getHeight() <= MAX_PACKED_ZONE_CELLS;
+}
+
+/* CellMesh::merge
+ * Replaces this mesh with all of [meshes] combined, keeping triangles
+ * grouped by face type. The meshes must all use the same vertex
+ * format and palette (ie. the same LOD). Returns false if there would
+ * be too many vertices for 16 bit indices
+ *******************************************************************/
+bool CellMesh::merge(const vector<const CellMesh*>& meshes)
+{
+	PROF_SCOPE("CellMesh::merge");
+
+	clear();
+	if (meshes.empty())
+		return true;
+
+	_compact = meshes[0]->_compact;
+	for (unsigned a = 0; a < NUM_FACE_TYPES; a++)
+		_palette[a] = meshes[0]->_palette[a];
+
+	// Vertices are just appended, so each mesh's indices are offset by
+	// the vertices before it
+	vector<unsigned> first_vertex(meshes.size());
+	unsigned n_vertices = 0;
+	unsigned n_indices = 0;
+	for (unsigned m = 0; m < meshes.size(); m++)
+	{
+		first_vertex[m] = n_vertices;
+		n_vertices += meshes[m]->numVertices();
+		n_indices += meshes[m]->numIndices();
+	}
+	if (n_vertices > 65536)
+		return false;
+
+	if (_compact)
+	{
+		_packed.reserve(n_vertices);
+		for (unsigned m = 0; m < meshes.size(); m++)
+			_packed.insert(_packed.end(), meshes[m]->_packed.begin(), meshes[m]->_packed.end());
+	}
+	else
+	{
+		_vertices.reserve(n_vertices);
+		for (unsigned m = 0; m < meshes.size(); m++)
+			_vertices.insert(_vertices.end(), meshes[m]->_vertices.begin(), meshes[m]->_vertices.end());
+	}
+
+	// Gather each face type's triangles from every mesh in turn
+	_indices.reserve(n_indices);
+	vector<unsigned> group_start(meshes.size(), 0);
+	for (unsigned a = 0; a < NUM_FACE_TYPES; a++)
+	{
+		unsigned first = _indices.size();
+		for (unsigned m = 0; m < meshes.size(); m++)
+		{
+			const CellMesh& mesh = *meshes[m];
+			for (unsigned i = 0; i < mesh._group_indices[a]; i++)
+				_indices.push_back(mesh._indices[group_start[m] + i] + first_vertex[m]);
+
+			group_start[m] += mesh._group_indices[a];
+			_group_quads[a] += mesh._group_quads[a];
+		}
+		_group_indices[a] = _indices.size() - first;
+	}
+
+	for (unsigned m = 0; m < meshes.size(); m++)
+		_n_quads_naive += meshes[m]->_n_quads_naive;
+
+	return true;
+}
+
+/* CellMesh::buildTop
+ * Adds top faces, merging runs of equal height first along y, then
+ * along x for as long as the whole run matches
+ *******************************************************************/
+void CellMesh::buildTop(const float* heights, unsigned dim, float size)
+{
+	bool done[32 * 32];
+	memset(done, 0, sizeof(done));
+
+	for (unsigned x = 0; x < dim; x++)
+	{
+		for (unsigned y = 0; y < dim; y++)
+		{
+			if (done[x * dim + y])
+				continue;
+
+			float top = heights[x * dim + y];
+
+			// Extend along y
+			unsigned y2 = y + 1;
+			while (y2 < dim && !done[x * dim + y2] && heights[x * dim + y2] == top)
+				y2++;
+
+			// Extend along x while the full y run matches
+			unsigned x2 = x + 1;
+			while (x2 < dim)
+			{
+				bool match = true;
+				for (unsigned a = y; a < y2; a++)
+				{
+					if (done[x2 * dim + a] || heights[x2 * dim + a] != top)
+					{
+						match = false;
+						break;
+					}
+				}
+				if (!match)
+					break;
+				x2++;
+			}
+
+			for (unsigned a = x; a < x2; a++)
+				for (unsigned b = y; b < y2; b++)
+					done[a * dim + b] = true;
+
+			float xf1 = x * size;
+			float yf1 = y * size;
+			float xf2 = x2 * size;
+			float yf2 = y2 * size;
+			addQuad(FACE_TOP, xf1, yf1, top, xf2, yf1, top, xf2, yf2, top, xf1, yf2, top);
+		}
+	}
+}
+
+/* CellMesh::buildWallX
+ * Adds a line of walls facing along the x axis at [xf]. Each of the
+ * [n] segments runs from height [a] (the sample on the +x side) to
+ * [b] (the -x side). The vertex order flips with the height
+ * difference so the wall always faces the lower side. Segments of
+ * equal height are skipped and consecutive segments spanning the
+ * same heights are merged
+ *******************************************************************/
+void CellMesh::buildWallX(float xf, float seg, const float* a, const float* b, unsigned n)
+{
+	unsigned y = 0;
+	while (y < n)
+	{
+		if (a[y] == b[y])
+		{
+			y++;
+			continue;
+		}
+
+		unsigned y2 = y + 1;
+		while (y2 < n && a[y2] == a[y] && b[y2] == b[y])
+			y2++;
+
+		float yf1 = y * seg;
+		float yf2 = y2 * seg;
+		addQuad(FACE_X, xf, yf1, a[y], xf, yf2, a[y], xf, yf2, b[y], xf, yf1, b[y]);
+		y = y2;
+	}
+}
+
+/* CellMesh::buildWallY
+ * As buildWallX, for walls facing along the y axis at [yf]
+ *******************************************************************/
+void CellMesh::buildWallY(float yf, float seg, const float* a, const float* b, unsigned n)
+{
+	unsigned x = 0;
+	while (x < n)
+	{
+		if (a[x] == b[x])
+		{
+			x++;
+			continue;
+		}
+
+		unsigned x2 = x + 1;
+		while (x2 < n && a[x2] == a[x] && b[x2] == b[x])
+			x2++;
+
+		float xf1 = x * seg;
+		float xf2 = x2 * seg;
+		addQuad(FACE_Y, xf1, yf, b[x], xf2, yf, b[x], xf2, yf, a[x], xf1, yf, a[x]);
+		x = x2;
+	}
+}
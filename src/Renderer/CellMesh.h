@@ -0,0 +1,92 @@
+
+#ifndef __CELL_MESH_H__
+#define __CELL_MESH_H__
+
+#include "OpenGL.h"
+
+// Neighbour order used by CellMesh::build
+enum
+{
+	NEIGHBOUR_WEST = 0,	// x - 1
+	NEIGHBOUR_EAST,		// x + 1
+	NEIGHBOUR_SOUTH,	// y - 1
+	NEIGHBOUR_NORTH,	// y + 1
+};
+
+// LOD value for a neighbour that isn't being drawn
+const uint8_t LOD_NONE = 255;
+
+// LOD levels are 0 (full detail) up to NUM_LODS - 1
+const uint8_t NUM_LODS = 4;
+
+// Packed vertex positions are 16 bit offsets from the zone origin,
+// which only reach this many cells across
+const unsigned MAX_PACKED_ZONE_CELLS = 1023;
+
+// Face types, each has its own palette colour
+enum
+{
+	FACE_TOP = 0,
+	FACE_X,			// Walls facing along the x axis
+	FACE_Y,			// Walls facing along the y axis
+
+	NUM_FACE_TYPES
+};
+
+class Cell;
+class Zone;
+class CellMesh
+{
+private:
+	vector<OpenGL::packed_vertex_t>	_quads[NUM_FACE_TYPES];	// Cell-local quads while building, by face type
+	vector<OpenGL::vertex_t>		_vertices;				// Full vertices (world position + colour)
+	vector<OpenGL::packed_vertex_t>	_packed;				// Compact vertices (zone position + palette index)
+	vector<uint16_t>				_indices;				// Triangle list
+	bool							_compact;
+	unsigned						_group_quads[NUM_FACE_TYPES];	// Quads of each face type
+	unsigned						_group_indices[NUM_FACE_TYPES];	// Indices of each face type, in order
+	rgba_t							_palette[NUM_FACE_TYPES];
+	unsigned						_n_quads_naive;			// Quads a per-sample mesh would have needed
+
+	// Scratch space for finish, kept so a reused mesh doesn't allocate
+	vector<OpenGL::packed_vertex_t>	_unique;				// Shared vertices in first use order
+	vector<uint16_t>				_unique_next;			// Next shared vertex at the same grid position
+	vector<int>						_remap;					// Shared vertex -> final vertex index
+
+	void	addQuad(uint8_t face, float x1, float y1, float z1, float x2, float y2, float z2,
+					float x3, float y3, float z3, float x4, float y4, float z4);
+	void	buildTop(const float* heights, unsigned dim, float size);
+	void	buildWallX(float xf, float seg, const float* a, const float* b, unsigned n);
+	void	buildWallY(float yf, float seg, const float* a, const float* b, unsigned n);
+	void	finish(float origin_x, float origin_y);
+
+public:
+	CellMesh();
+	~CellMesh();
+
+	// Vertices are shared between quads of the same face type, and
+	// triangles are grouped by face type, FACE_TOP first
+	bool	compact() const { return _compact; }
+	const vector<OpenGL::vertex_t>&			vertices() const { return _vertices; }
+	const vector<OpenGL::packed_vertex_t>&	packedVertices() const { return _packed; }
+	const vector<uint16_t>&	indices() const { return _indices; }
+	unsigned	groupQuads(uint8_t face) const { return _group_quads[face]; }
+	unsigned	groupIndices(uint8_t face) const { return _group_indices[face]; }
+	rgba_t		paletteColour(uint8_t face) const { return _palette[face]; }
+
+	unsigned	numQuads() const { return _group_quads[FACE_TOP] + _group_quads[FACE_X] + _group_quads[FACE_Y]; }
+	unsigned	numQuadsNaive() const { return _n_quads_naive; }
+	unsigned	numVertices() const { return _compact ? _packed.size() : _vertices.size(); }
+	unsigned	numIndices() const { return _indices.size(); }
+	unsigned	vertexSize() const { return _compact ? sizeof(OpenGL::packed_vertex_t) : sizeof(OpenGL::vertex_t); }
+	const void*	vertexData() const;
+
+	void	clear();
+	void	build(Zone& zone, Cell* cell, uint8_t lod_level, const uint8_t* neighbour_lods, bool compact = false);
+	bool	merge(const vector<const CellMesh*>& meshes);
+
+	static unsigned	lodDim(uint8_t lod_level) { return 32 >> lod_level; }
+	static bool		canPack(const Zone& zone);
+};
+
+#endif//__CELL_MESH_H__
@@ -0,0 +1,537 @@
+
+#include "Main.h"
+#include "glew/glew.h"
+#include "ClipmapRenderer.h"
+#include "CellMesh.h"
+#include "Camera.h"
+#include "Utilities/Math.h"
+#include "Utilities/VertexCache.h"
+#include "World/Cell.h"
+#include "World/Zone.h"
+#include "Console.h"
+#include "GLState.h"
+#include "Utilities/Profiler.h"
+#include <cmath>
+
+CVAR(Int, clipmap_size, 64, CVAR_SAVE)
+EXTERN_CVAR(Float, max_view_distance)
+
+// Shared with StandardRenderer
+extern rgba_t col_sky;
+extern Zone test_zone;
+extern bool test_zone_regenerated;
+
+// Levels beyond this are never created, whatever the view distance
+#define CLIPMAP_MAX_LEVELS	16
+
+// Clipmap statistics for the last frame (see clipmap_stats command)
+unsigned stat_clipmap_levels = 0;
+unsigned stat_clipmap_vertices = 0;
+unsigned stat_clipmap_triangles = 0;
+unsigned stat_clipmap_texels = 0;
+
+// Everything uploaded since init
+uint64_t stat_clipmap_bytes_uploaded = 0;
+
+/* wrap
+ * Returns [value] modulo [size], always positive
+ *******************************************************************/
+static int wrap(int value, int size)
+{
+	int ret = value % size;
+	return ret < 0 ? ret + size : ret;
+}
+
+/* ClipmapRenderer::ClipmapRenderer
+ * ClipmapRenderer class constructor
+ *******************************************************************/
+ClipmapRenderer::ClipmapRenderer() : _shader_vertex(GL_VERTEX_SHADER), _shader_fragment(GL_FRAGMENT_SHADER)
+{
+	_vertex_buffer = 0;
+	_index_buffer = 0;
+	_vao = 0;
+	_size = 0;
+	_tex_size = 0;
+	_ring_indices = 0;
+	_full_indices = 0;
+	for (unsigned a = 0; a < 4; a++)
+		_ring_offset[a] = 0;
+}
+
+/* ClipmapRenderer::~ClipmapRenderer
+ * ClipmapRenderer class destructor
+ *******************************************************************/
+ClipmapRenderer::~ClipmapRenderer()
+{
+	clearLevels();
+	if (_vertex_buffer)
+		glDeleteBuffers(1, &_vertex_buffer);
+	if (_index_buffer)
+		glDeleteBuffers(1, &_index_buffer);
+	if (_vao)
+		glDeleteVertexArrays(1, &_vao);
+
+	// Deleting bound objects unbinds them
+	GLState::invalidate();
+}
+
+/* ClipmapRenderer::init
+ * Loads the clipmap shaders and generates the test zone. Returns false
+ * if the shaders failed to compile or link
+ *******************************************************************/
+bool ClipmapRenderer::init()
+{
+	_shader_vertex.openFile("shaders/clipmap_vertex.glsl");
+	_shader_fragment.openFile("shaders/clipmap_fragment.glsl");
+
+	_program.addShader(&_shader_vertex);
+	_program.addShader(&_shader_fragment);
+	if (!_program.link())
+		return false;
+
+	GLuint program = _program.getId();
+	_attr_grid = glGetAttribLocation(program, "grid_pos");
+	_uniform_mvp = glGetUniformLocation(program, "mat_mvp");
+	_uniform_origin = glGetUniformLocation(program, "level_origin");
+	_uniform_spacing = glGetUniformLocation(program, "level_spacing");
+	_uniform_tex_size = glGetUniformLocation(program, "tex_size");
+	_uniform_grid_size = glGetUniformLocation(program, "grid_size");
+	_uniform_morph = glGetUniformLocation(program, "morph_enabled");
+	_uniform_heights = glGetUniformLocation(program, "heights");
+	_uniform_heights_coarse = glGetUniformLocation(program, "heights_coarse");
+	_uniform_fog = glGetUniformLocation(program, "fog_range");
+	_uniform_sky = glGetUniformLocation(program, "sky_colour");
+
+	glGenVertexArrays(1, &_vao);
+
+	test_zone.generateTestLandscape();
+	buildFarHeights();
+
+	return true;
+}
+
+/* ClipmapRenderer::createGrid
+ * Creates the grid vertex buffer shared by all levels, and the index
+ * buffer with the full grid (for the finest level) followed by the
+ * four possible rings. A ring leaves out the quads covered by the
+ * level inside it, which sits [size] / 4 quads in plus 0 or 1 on each
+ * axis depending on where the camera is
+ *******************************************************************/
+void ClipmapRenderer::createGrid(int size)
+{
+	_size = size;
+	_tex_size = size * 2;
+
+	// Vertices are just grid positions, the shader does the rest
+	vector<float> vertices;
+	vertices.reserve((size + 1) * (size + 1) * 2);
+	for (int y = 0; y <= size; y++)
+	{
+		for (int x = 0; x <= size; x++)
+		{
+			vertices.push_back((float)x);
+			vertices.push_back((float)y);
+		}
+	}
+
+	// Build the full grid and rings
+	vector<uint16_t> indices;
+	for (int ring = -1; ring < 4; ring++)
+	{
+		int hole_x = size / 4 + (ring & 1);
+		int hole_y = size / 4 + ((ring >> 1) & 1);
+		unsigned start = indices.size();
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				if (ring >= 0 &&
+					x >= hole_x && x < hole_x + size / 2 &&
+					y >= hole_y && y < hole_y + size / 2)
+					continue;
+
+				uint16_t v00 = y * (size + 1) + x;
+				uint16_t v10 = v00 + 1;
+				uint16_t v01 = v00 + size + 1;
+				uint16_t v11 = v01 + 1;
+				indices.push_back(v00);
+				indices.push_back(v10);
+				indices.push_back(v11);
+				indices.push_back(v00);
+				indices.push_back(v11);
+				indices.push_back(v01);
+			}
+		}
+
+		VertexCache::optimize(&indices[start], indices.size() - start, vertices.size() / 2);
+
+		if (ring < 0)
+			_full_indices = indices.size();
+		else
+		{
+			_ring_offset[ring] = start;
+			_ring_indices = indices.size() - start;
+		}
+	}
+
+	if (!_vertex_buffer)
+		glGenBuffers(1, &_vertex_buffer);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, _vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+
+	if (!_index_buffer)
+		glGenBuffers(1, &_index_buffer);
+	GLState::bindVertexArray(_vao);
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _index_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), &indices[0], GL_STATIC_DRAW);
+}
+
+/* ClipmapRenderer::createLevels
+ * Creates the height textures for [n_levels] levels. Their contents
+ * are filled in by updateLevel
+ *******************************************************************/
+void ClipmapRenderer::createLevels(unsigned n_levels)
+{
+	clearLevels();
+
+	_levels.resize(n_levels);
+	for (unsigned a = 0; a < n_levels; a++)
+	{
+		level_t& level = _levels[a];
+		level.origin_x = level.origin_y = 0;
+		level.tex_x = level.tex_y = 0;
+		level.valid = false;
+
+		// Repeat wrapping makes the toroidal addressing free, and linear
+		// filtering is used to sample the coarser level between texels
+		glGenTextures(1, &level.texture);
+		glBindTexture(GL_TEXTURE_2D, level.texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, _tex_size, _tex_size, 0, GL_RED, GL_FLOAT, nullptr);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/* ClipmapRenderer::clearLevels
+ * Deletes all level textures
+ *******************************************************************/
+void ClipmapRenderer::clearLevels()
+{
+	for (unsigned a = 0; a < _levels.size(); a++)
+		glDeleteTextures(1, &_levels[a].texture);
+	_levels.clear();
+}
+
+/* ClipmapRenderer::buildFarHeights
+ * Builds the height pyramid for levels coarser than the cells' own
+ * LODs, starting from the coarsest cell LOD and halving each time
+ *******************************************************************/
+void ClipmapRenderer::buildFarHeights()
+{
+	_far_heights.clear();
+
+	unsigned coarsest = NUM_LODS - 1;
+	unsigned cell_dim = CellMesh::lodDim(coarsest);
+	unsigned width = test_zone.getWidth() * cell_dim;
+	unsigned height = test_zone.getHeight() * cell_dim;
+	vector<float> prev(width * height);
+	for (unsigned x = 0; x < width; x++)
+		for (unsigned y = 0; y < height; y++)
+			prev[y * width + x] = sampleHeight(coarsest, x, y);
+
+	for (unsigned level = coarsest + 1; level < CLIPMAP_MAX_LEVELS; level++)
+	{
+		unsigned next_width = max(width / 2, 1u);
+		unsigned next_height = max(height / 2, 1u);
+		vector<float> next(next_width * next_height);
+		for (unsigned x = 0; x < next_width; x++)
+		{
+			for (unsigned y = 0; y < next_height; y++)
+			{
+				unsigned x1 = min(x * 2 + 1, width - 1);
+				unsigned y1 = min(y * 2 + 1, height - 1);
+				next[y * next_width + x] = 0.25f * (prev[y * 2 * width + x * 2] + prev[y * 2 * width + x1] +
+					prev[y1 * width + x * 2] + prev[y1 * width + x1]);
+			}
+		}
+
+		_far_heights.push_back(next);
+		prev.swap(next);
+		width = next_width;
+		height = next_height;
+	}
+}
+
+/* ClipmapRenderer::sampleHeight
+ * Returns the terrain height of sample [x,y] at [level], where level
+ * n has samples 2^n units apart. Levels up to the coarsest cell LOD
+ * read the cells directly. Outside the zone the height is 0
+ *******************************************************************/
+float ClipmapRenderer::sampleHeight(unsigned level, int x, int y)
+{
+	if (x < 0 || y < 0)
+		return 0.0f;
+
+	if (level < NUM_LODS)
+	{
+		int cell_dim = CellMesh::lodDim(level);
+		Cell* cell = test_zone.getCell(x / cell_dim, y / cell_dim);
+		if (!cell)
+			return 0.0f;
+
+		return cell->heightAt(level, x % cell_dim, y % cell_dim);
+	}
+
+	unsigned far = level - NUM_LODS;
+	if (far >= _far_heights.size())
+		return 0.0f;
+
+	unsigned shift = level - (NUM_LODS - 1);
+	unsigned cell_dim = CellMesh::lodDim(NUM_LODS - 1);
+	unsigned width = max((test_zone.getWidth() * cell_dim) >> shift, 1u);
+	unsigned height = max((test_zone.getHeight() * cell_dim) >> shift, 1u);
+	if ((unsigned)x >= width || (unsigned)y >= height)
+		return 0.0f;
+
+	return _far_heights[far][y * width + x];
+}
+
+/* ClipmapRenderer::updateLevel
+ * Moves the texture window of [level] to start at sample [tex_x,tex_y].
+ * Only the rows and columns that came into the window are uploaded,
+ * the texture is addressed toroidally so the rest stays where it is
+ *******************************************************************/
+void ClipmapRenderer::updateLevel(unsigned level, int tex_x, int tex_y)
+{
+	PROF_SCOPE("ClipmapRenderer::updateLevel");
+
+	level_t& lv = _levels[level];
+	int dx = tex_x - lv.tex_x;
+	int dy = tex_y - lv.tex_y;
+	if (lv.valid && dx == 0 && dy == 0)
+		return;
+
+	glBindTexture(GL_TEXTURE_2D, lv.texture);
+	GLState::countCalls();
+
+	int n = _tex_size;
+	if (!lv.valid || abs(dx) >= n || abs(dy) >= n)
+		uploadRegion(level, tex_x, tex_y, n, n);
+	else
+	{
+		// New columns, then new rows
+		if (dx > 0)
+			uploadRegion(level, lv.tex_x + n, tex_y, dx, n);
+		else if (dx < 0)
+			uploadRegion(level, tex_x, tex_y, -dx, n);
+
+		if (dy > 0)
+			uploadRegion(level, tex_x, lv.tex_y + n, n, dy);
+		else if (dy < 0)
+			uploadRegion(level, tex_x, tex_y, n, -dy);
+	}
+
+	lv.tex_x = tex_x;
+	lv.tex_y = tex_y;
+	lv.valid = true;
+}
+
+/* ClipmapRenderer::uploadRegion
+ * Uploads the samples of [level] in the given region to the (already
+ * bound) level texture, splitting it where it wraps around the edges
+ *******************************************************************/
+void ClipmapRenderer::uploadRegion(unsigned level, int x, int y, int width, int height)
+{
+	int n = _tex_size;
+	vector<float> data;
+	for (int ys = y; ys < y + height;)
+	{
+		int ty = wrap(ys, n);
+		int rows = min(y + height - ys, n - ty);
+		for (int xs = x; xs < x + width;)
+		{
+			int tx = wrap(xs, n);
+			int cols = min(x + width - xs, n - tx);
+
+			data.resize(cols * rows);
+			for (int r = 0; r < rows; r++)
+				for (int c = 0; c < cols; c++)
+					data[r * cols + c] = sampleHeight(level, xs + c, ys + r);
+
+			glTexSubImage2D(GL_TEXTURE_2D, 0, tx, ty, cols, rows, GL_RED, GL_FLOAT, &data[0]);
+			GLState::countCalls();
+			stat_clipmap_texels += cols * rows;
+			stat_clipmap_bytes_uploaded += cols * rows * sizeof(float);
+			xs += cols;
+		}
+		ys += rows;
+	}
+}
+
+/* ClipmapRenderer::renderScene
+ * Renders the terrain as nested clipmap levels around the camera, with
+ * enough levels to reach max_view_distance
+ *******************************************************************/
+void ClipmapRenderer::renderScene(int width, int height)
+{
+	PROF_SCOPE("ClipmapRenderer::renderScene");
+
+	// Calculate aspect ratio
+	float aspect = ((float)width / (float)height);
+	float fovy = 2 * (float)Math::radToDeg(atan(tan(Math::degToRad(90) / 2) / aspect));
+
+	// Setup projection and view, the shader gets them combined. They
+	// are built here rather than with the GL matrix stack, which
+	// doesn't exist in a core profile context
+	mat4f_t projection = Camera::perspectiveMatrix(fovy, aspect, 0.5f, max_view_distance * 1.3f);
+	mat4f_t view = _camera.viewMatrix();
+
+	float mvp[16];
+	for (unsigned c = 0; c < 4; c++)
+	{
+		for (unsigned r = 0; r < 4; r++)
+		{
+			mvp[c * 4 + r] = 0.0f;
+			for (unsigned k = 0; k < 4; k++)
+				mvp[c * 4 + r] += projection[k * 4 + r] * view[c * 4 + k];
+		}
+	}
+
+	// Setup GL stuff
+	gl_pass_state_t state;
+	state.depth_test = true;
+	state.cull_face = true;
+	state.cull_mode = GL_BACK;
+	GLState::apply(state);
+
+	// Clear
+	glClearColor(col_sky.fr(), col_sky.fg(), col_sky.fb(), 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+
+	// Matrix setup, reads and clear
+	GLState::countCalls(9);
+
+	if (!_program.isValid())
+		return;
+
+	if (test_zone_regenerated)
+	{
+		buildFarHeights();
+		for (unsigned a = 0; a < _levels.size(); a++)
+			_levels[a].valid = false;
+		test_zone_regenerated = false;
+	}
+
+	// Grid size must be a power of two so the levels nest
+	int size = 16;
+	while (size < clipmap_size && size < 128)
+		size *= 2;
+	if (size != _size)
+	{
+		createGrid(size);
+		clearLevels();
+	}
+
+	// Add levels until the coarsest reaches the view distance
+	unsigned n_levels = 1;
+	while (n_levels < CLIPMAP_MAX_LEVELS && (float)((size / 2) << (n_levels - 1)) < max_view_distance)
+		n_levels++;
+	if (n_levels != _levels.size())
+		createLevels(n_levels);
+
+	// Position the levels around the camera. Each level's origin is
+	// snapped to the next level's spacing so it lines up with its grid
+	stat_clipmap_texels = 0;
+	fpoint3_t position = _camera.getPosition();
+	for (unsigned a = 0; a < _levels.size(); a++)
+	{
+		double spacing = (double)(1 << a);
+		level_t& level = _levels[a];
+		level.origin_x = (int)floor(position.x / (spacing * 2)) * 2 - size / 2;
+		level.origin_y = (int)floor(position.y / (spacing * 2)) * 2 - size / 2;
+		updateLevel(a, level.origin_x - (_tex_size - size) / 2, level.origin_y - (_tex_size - size) / 2);
+	}
+
+	// Draw levels, finest first
+	GLState::useProgram(_program.getId());
+	GLState::bindVertexArray(_vao);
+	glUniformMatrix4fv(_uniform_mvp, 1, GL_FALSE, mvp);
+	glUniform1f(_uniform_tex_size, (float)_tex_size);
+	glUniform1f(_uniform_grid_size, (float)size);
+	glUniform2f(_uniform_fog, max_view_distance * 0.4f, max_view_distance * 0.8f);
+	glUniform3f(_uniform_sky, col_sky.fr(), col_sky.fg(), col_sky.fb());
+	glUniform1i(_uniform_heights, 0);
+	glUniform1i(_uniform_heights_coarse, 1);
+
+	GLState::bindBuffer(GL_ARRAY_BUFFER, _vertex_buffer);
+	glEnableVertexAttribArray(_attr_grid);
+	glVertexAttribPointer(_attr_grid, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _index_buffer);
+	GLState::countCalls(9);
+
+	stat_clipmap_levels = _levels.size();
+	stat_clipmap_vertices = 0;
+	stat_clipmap_triangles = 0;
+	for (unsigned a = 0; a < _levels.size(); a++)
+	{
+		level_t& level = _levels[a];
+		bool coarser = a + 1 < _levels.size();
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, level.texture);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, coarser ? _levels[a + 1].texture : level.texture);
+
+		glUniform2f(_uniform_origin, (float)level.origin_x, (float)level.origin_y);
+		glUniform1f(_uniform_spacing, (float)(1 << a));
+		glUniform1f(_uniform_morph, coarser ? 1.0f : 0.0f);
+
+		// Leave a hole where the finer level is
+		int n_indices = _full_indices;
+		int offset = 0;
+		if (a > 0)
+		{
+			int hole_x = _levels[a - 1].origin_x / 2 - level.origin_x - size / 4;
+			int hole_y = _levels[a - 1].origin_y / 2 - level.origin_y - size / 4;
+			n_indices = _ring_indices;
+			offset = _ring_offset[(hole_y << 1) | hole_x];
+		}
+
+		glDrawElements(GL_TRIANGLES, n_indices, GL_UNSIGNED_SHORT, (void*)(offset * sizeof(uint16_t)));
+		GLState::countCalls(8);
+		stat_clipmap_vertices += (size + 1) * (size + 1);
+		stat_clipmap_triangles += n_indices / 3;
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	GLState::countCalls();
+}
+
+/* ClipmapRenderer::renderCell
+ * Not used, the terrain is drawn by level rather than by cell
+ *******************************************************************/
+void ClipmapRenderer::renderCell(Cell* cell)
+{
+}
+
+/* ClipmapRenderer::numBytesUploaded
+ * Returns the amount of height data uploaded since init
+ *******************************************************************/
+uint64_t ClipmapRenderer::numBytesUploaded()
+{
+	return stat_clipmap_bytes_uploaded;
+}
+
+
+/*******************************************************************
+ * CONSOLE COMMANDS
+ *******************************************************************/
+
+CONSOLE_COMMAND(clipmap_stats, 0, true)
+{
+	Console::logMessage(S_FMT("%d clipmap levels, %d vertices, %d triangles", stat_clipmap_levels, stat_clipmap_vertices, stat_clipmap_triangles));
+	Console::logMessage(S_FMT("%d height texels uploaded last frame", stat_clipmap_texels));
+}
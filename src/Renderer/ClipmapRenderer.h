@@ -0,0 +1,72 @@
+
+#ifndef __CLIPMAP_RENDERER_H__
+#define __CLIPMAP_RENDERER_H__
+
+#include "Shader.h"
+#include "Renderer.h"
+
+// Terrain renderer using nested geometry clipmaps. Each level is a
+// grid of [size] quads centred on the camera, with twice the spacing
+// of the level inside it, and heights sampled in the vertex shader
+// from a toroidally updated height texture. The vertex count only
+// grows with the log of the view distance
+class ClipmapRenderer : public Renderer
+{
+private:
+	struct level_t
+	{
+		GLuint	texture;
+		int		origin_x;	// Sample index of the first grid vertex
+		int		origin_y;
+		int		tex_x;		// Sample index of the first texel in the texture window
+		int		tex_y;
+		bool	valid;		// False if the texture needs a full update
+	};
+
+	Shader			_shader_vertex;
+	Shader			_shader_fragment;
+	ShaderProgram	_program;
+
+	GLuint	_vertex_buffer;
+	GLuint	_index_buffer;
+	GLuint	_vao;
+	int		_size;					// Grid quads per side of each level
+	int		_tex_size;				// Texels per side of each height texture
+	int		_ring_offset[4];		// Index buffer offset of each ring variant
+	int		_ring_indices;
+	int		_full_indices;
+	vector<level_t>			_levels;
+	vector< vector<float> >	_far_heights;	// Averaged heights beyond the coarsest cell LOD
+
+	// Uniform/attribute locations
+	GLint	_attr_grid;
+	GLint	_uniform_mvp;
+	GLint	_uniform_origin;
+	GLint	_uniform_spacing;
+	GLint	_uniform_tex_size;
+	GLint	_uniform_grid_size;
+	GLint	_uniform_morph;
+	GLint	_uniform_heights;
+	GLint	_uniform_heights_coarse;
+	GLint	_uniform_fog;
+	GLint	_uniform_sky;
+
+	void	createGrid(int size);
+	void	createLevels(unsigned n_levels);
+	void	clearLevels();
+	void	buildFarHeights();
+	float	sampleHeight(unsigned level, int x, int y);
+	void	updateLevel(unsigned level, int tex_x, int tex_y);
+	void	uploadRegion(unsigned level, int x, int y, int width, int height);
+
+public:
+	ClipmapRenderer();
+	~ClipmapRenderer();
+
+	bool	init();
+	void	renderScene(int width, int height);
+	void	renderCell(Cell* cell);
+	uint64_t	numBytesUploaded();
+};
+
+#endif//__CLIPMAP_RENDERER_H__
@@ -0,0 +1,104 @@
+
+#include "Main.h"
+#include "Frustum.h"
+#include "glew/glew.h"
+
+/* Frustum::extract
+ * Extracts the frustum planes from the given OpenGL (column-major)
+ * [projection] and [modelview] matrices. The planes are in the
+ * modelview's source space, ie. world space
+ *******************************************************************/
+void Frustum::extract(const float* projection, const float* modelview)
+{
+	// Combined clip matrix, clip = projection * modelview
+	float clip[16];
+	for (unsigned col = 0; col < 4; col++)
+	{
+		for (unsigned row = 0; row < 4; row++)
+		{
+			clip[col * 4 + row] =
+				projection[0 * 4 + row] * modelview[col * 4 + 0] +
+				projection[1 * 4 + row] * modelview[col * 4 + 1] +
+				projection[2 * 4 + row] * modelview[col * 4 + 2] +
+				projection[3 * 4 + row] * modelview[col * 4 + 3];
+		}
+	}
+
+	// Each plane is the 4th row of the clip matrix plus or minus one of
+	// the other rows
+	for (unsigned a = 0; a < 6; a++)
+	{
+		unsigned row = a / 2;
+		float sign = (a % 2 == 0) ? 1.0f : -1.0f;
+		_planes[a].a = clip[3] + sign * clip[row];
+		_planes[a].b = clip[7] + sign * clip[4 + row];
+		_planes[a].c = clip[11] + sign * clip[8 + row];
+		_planes[a].d = clip[15] + sign * clip[12 + row];
+		_planes[a].normalize();
+	}
+}
+
+/* Frustum::extractFromGL
+ * Extracts the frustum planes from the current OpenGL projection and
+ * modelview matrices
+ *******************************************************************/
+void Frustum::extractFromGL()
+{
+	float projection[16];
+	float modelview[16];
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+	extract(projection, modelview);
+}
+
+/* Frustum::boxVisible
+ * Returns true if any part of the axis-aligned box [min]-[max] may be
+ * inside the frustum. Boxes near the corners of the frustum can be
+ * reported visible when they aren't, but never the other way round
+ *******************************************************************/
+bool Frustum::boxVisible(fpoint3_t min, fpoint3_t max) const
+{
+	for (unsigned a = 0; a < 6; a++)
+	{
+		// Test the corner furthest along the plane's normal
+		const plane_t& p = _planes[a];
+		float x = p.a >= 0 ? max.x : min.x;
+		float y = p.b >= 0 ? max.y : min.y;
+		float z = p.c >= 0 ? max.z : min.z;
+		if (p.a * x + p.b * y + p.c * z + p.d < 0)
+			return false;
+	}
+
+	return true;
+}
+
+/* Frustum::classifyBox
+ * Returns FRUSTUM_INSIDE if the axis-aligned box [min]-[max] is
+ * completely inside the frustum, FRUSTUM_OUTSIDE if it is completely
+ * outside (with the same caveat as boxVisible) or FRUSTUM_INTERSECTS
+ * otherwise. Anything within an inside box doesn't need testing
+ *******************************************************************/
+int Frustum::classifyBox(fpoint3_t min, fpoint3_t max) const
+{
+	int result = FRUSTUM_INSIDE;
+	for (unsigned a = 0; a < 6; a++)
+	{
+		const plane_t& p = _planes[a];
+
+		// Corner furthest along the plane's normal
+		float x = p.a >= 0 ? max.x : min.x;
+		float y = p.b >= 0 ? max.y : min.y;
+		float z = p.c >= 0 ? max.z : min.z;
+		if (p.a * x + p.b * y + p.c * z + p.d < 0)
+			return FRUSTUM_OUTSIDE;
+
+		// Nearest corner, if that is outside the box crosses the plane
+		x = p.a >= 0 ? min.x : max.x;
+		y = p.b >= 0 ? min.y : max.y;
+		z = p.c >= 0 ? min.z : max.z;
+		if (p.a * x + p.b * y + p.c * z + p.d < 0)
+			result = FRUSTUM_INTERSECTS;
+	}
+
+	return result;
+}
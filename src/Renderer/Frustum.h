@@ -0,0 +1,28 @@
+
+#ifndef __FRUSTUM_H__
+#define __FRUSTUM_H__
+
+// Results of Frustum::classifyBox
+enum
+{
+	FRUSTUM_OUTSIDE = 0,
+	FRUSTUM_INTERSECTS,
+	FRUSTUM_INSIDE,
+};
+
+class Frustum
+{
+private:
+	plane_t	_planes[6];	// Left, right, bottom, top, near, far. Points inside have ax+by+cz+d >= 0
+
+public:
+	Frustum() {}
+	~Frustum() {}
+
+	void	extract(const float* projection, const float* modelview);
+	void	extractFromGL();
+	bool	boxVisible(fpoint3_t min, fpoint3_t max) const;
+	int		classifyBox(fpoint3_t min, fpoint3_t max) const;
+};
+
+#endif//__FRUSTUM_H__
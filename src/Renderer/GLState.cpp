@@ -0,0 +1,378 @@
+
+#include "Main.h"
+#include "glew/glew.h"
+#include "GLState.h"
+#include "Console.h"
+
+CVAR(Bool, gl_state_cache, true, CVAR_SAVE)
+
+#define GL_STATE_UNKNOWN	-1
+#define GL_OBJECT_UNKNOWN	0xFFFFFFFF
+
+namespace GLState
+{
+	// Capabilities and client arrays that are tracked. Anything else
+	// is passed straight through
+	const GLenum caps[] = { GL_DEPTH_TEST, GL_CULL_FACE, GL_ALPHA_TEST, GL_FOG, GL_LIGHTING, GL_LIGHT0, GL_COLOR_MATERIAL, GL_BLEND, GL_TEXTURE_2D };
+	const GLenum arrays[] = { GL_VERTEX_ARRAY, GL_COLOR_ARRAY, GL_TEXTURE_COORD_ARRAY };
+	const unsigned n_caps = sizeof(caps) / sizeof(GLenum);
+	const unsigned n_arrays = sizeof(arrays) / sizeof(GLenum);
+
+	int		cap_state[n_caps];
+	int		array_state[n_arrays];
+	int		depth_write = GL_STATE_UNKNOWN;
+	GLenum	cull_mode = GL_OBJECT_UNKNOWN;
+	GLenum	alpha_func = GL_OBJECT_UNKNOWN;
+	float	alpha_ref = 0.0f;
+	bool	fog_valid = false;
+	rgba_t	fog_colour;
+	float	fog_start = 0.0f;
+	float	fog_end = 0.0f;
+	GLuint	array_buffer = GL_OBJECT_UNKNOWN;
+	GLuint	element_buffer = GL_OBJECT_UNKNOWN;
+	GLuint	copy_read_buffer = GL_OBJECT_UNKNOWN;
+	GLuint	copy_write_buffer = GL_OBJECT_UNKNOWN;
+	GLuint	vertex_array = GL_OBJECT_UNKNOWN;
+	GLuint	program = GL_OBJECT_UNKNOWN;
+
+	// Call counts for the current and last frames
+	unsigned	issued = 0;
+	unsigned	skipped = 0;
+	unsigned	last_issued = 0;
+	unsigned	last_skipped = 0;
+	bool		initialised = false;
+
+	/* GLState::redundant
+	 * Returns true (and counts the skipped call) if a call setting
+	 * [current] to [value] can be skipped
+	 *******************************************************************/
+	template<class T> bool redundant(T current, T value)
+	{
+		if (gl_state_cache && current == value)
+		{
+			skipped++;
+			return true;
+		}
+
+		return false;
+	}
+
+	/* GLState::capIndex
+	 * Returns the index of [cap] in [list], or -1 if it isn't tracked
+	 *******************************************************************/
+	int capIndex(const GLenum* list, unsigned n, GLenum cap)
+	{
+		for (unsigned a = 0; a < n; a++)
+			if (list[a] == cap)
+				return a;
+
+		return -1;
+	}
+}
+
+/* GLState::enable
+ * Enables or disables [cap]
+ *******************************************************************/
+void GLState::enable(GLenum cap, bool enable)
+{
+	if (!initialised)
+		invalidate();
+
+	int index = capIndex(caps, n_caps, cap);
+	if (index >= 0)
+	{
+		if (redundant(cap_state[index], (int)enable))
+			return;
+		cap_state[index] = enable;
+	}
+
+	if (enable)
+		glEnable(cap);
+	else
+		glDisable(cap);
+	issued++;
+}
+
+/* GLState::clientState
+ * Enables or disables the client-side [array]
+ *******************************************************************/
+void GLState::clientState(GLenum array, bool enable)
+{
+	if (!initialised)
+		invalidate();
+
+	int index = capIndex(arrays, n_arrays, array);
+	if (index >= 0)
+	{
+		if (redundant(array_state[index], (int)enable))
+			return;
+		array_state[index] = enable;
+	}
+
+	if (enable)
+		glEnableClientState(array);
+	else
+		glDisableClientState(array);
+	issued++;
+}
+
+/* GLState::depthMask
+ * Enables or disables depth buffer writes
+ *******************************************************************/
+void GLState::depthMask(bool write)
+{
+	if (redundant(depth_write, (int)write))
+		return;
+
+	depth_write = write;
+	glDepthMask(write ? GL_TRUE : GL_FALSE);
+	issued++;
+}
+
+/* GLState::cullFace
+ * Sets which faces are culled when GL_CULL_FACE is enabled
+ *******************************************************************/
+void GLState::cullFace(GLenum mode)
+{
+	if (redundant(cull_mode, mode))
+		return;
+
+	cull_mode = mode;
+	glCullFace(mode);
+	issued++;
+}
+
+/* GLState::alphaFunc
+ * Sets the alpha test function
+ *******************************************************************/
+void GLState::alphaFunc(GLenum func, float ref)
+{
+	if (alpha_ref == ref && redundant(alpha_func, func))
+		return;
+
+	alpha_func = func;
+	alpha_ref = ref;
+	glAlphaFunc(func, ref);
+	issued++;
+}
+
+/* GLState::fog
+ * Sets up linear fog of [colour] from [start] to [end]. Only the
+ * parameters that changed are set
+ *******************************************************************/
+void GLState::fog(rgba_t colour, float start, float end)
+{
+	bool all = !fog_valid || !gl_state_cache;
+	if (all)
+	{
+		glFogi(GL_FOG_MODE, GL_LINEAR);
+		glHint(GL_FOG_HINT, GL_NICEST);
+		issued += 2;
+	}
+	else
+		skipped += 2;
+
+	if (all || !fog_colour.equals(colour, true))
+	{
+		GLfloat fog_colour_f[4] = { colour.fr(), colour.fg(), colour.fb(), 1.0f };
+		glFogfv(GL_FOG_COLOR, fog_colour_f);
+		issued++;
+	}
+	else
+		skipped++;
+
+	if (all || fog_start != start)
+	{
+		glFogf(GL_FOG_START, start);
+		issued++;
+	}
+	else
+		skipped++;
+
+	if (all || fog_end != end)
+	{
+		glFogf(GL_FOG_END, end);
+		issued++;
+	}
+	else
+		skipped++;
+
+	fog_valid = true;
+	fog_colour = colour;
+	fog_start = start;
+	fog_end = end;
+}
+
+/* GLState::bindBuffer
+ * Binds [buffer] to [target]
+ *******************************************************************/
+void GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+	if (target == GL_ARRAY_BUFFER)
+	{
+		if (redundant(array_buffer, buffer))
+			return;
+		array_buffer = buffer;
+	}
+	else if (target == GL_ELEMENT_ARRAY_BUFFER)
+	{
+		if (redundant(element_buffer, buffer))
+			return;
+		element_buffer = buffer;
+	}
+	else if (target == GL_COPY_READ_BUFFER)
+	{
+		if (redundant(copy_read_buffer, buffer))
+			return;
+		copy_read_buffer = buffer;
+	}
+	else if (target == GL_COPY_WRITE_BUFFER)
+	{
+		if (redundant(copy_write_buffer, buffer))
+			return;
+		copy_write_buffer = buffer;
+	}
+
+	glBindBuffer(target, buffer);
+	issued++;
+}
+
+/* GLState::bufferDeleted
+ * Forgets [buffer] if it is bound, deleting a buffer unbinds it
+ *******************************************************************/
+void GLState::bufferDeleted(GLuint buffer)
+{
+	if (array_buffer == buffer)
+		array_buffer = 0;
+	if (element_buffer == buffer)
+		element_buffer = 0;
+	if (copy_read_buffer == buffer)
+		copy_read_buffer = 0;
+	if (copy_write_buffer == buffer)
+		copy_write_buffer = 0;
+}
+
+/* GLState::bindVertexArray
+ * Binds the vertex array object [vao]. The element array binding is
+ * part of the VAO, so that is no longer known
+ *******************************************************************/
+void GLState::bindVertexArray(GLuint vao)
+{
+	if (redundant(vertex_array, vao))
+		return;
+
+	vertex_array = vao;
+	element_buffer = GL_OBJECT_UNKNOWN;
+	glBindVertexArray(vao);
+	issued++;
+}
+
+/* GLState::useProgram
+ * Makes program [id] current
+ *******************************************************************/
+void GLState::useProgram(GLuint id)
+{
+	if (redundant(program, id))
+		return;
+
+	program = id;
+	glUseProgram(id);
+	issued++;
+}
+
+/* GLState::apply
+ * Sets everything in [state]
+ *******************************************************************/
+void GLState::apply(const gl_pass_state_t& state)
+{
+	enable(GL_DEPTH_TEST, state.depth_test);
+	depthMask(state.depth_write);
+	enable(GL_CULL_FACE, state.cull_face);
+	if (state.cull_face)
+		cullFace(state.cull_mode);
+}
+
+/* GLState::applyFixed
+ * Sets everything in the fixed-function [state]. Must not be called
+ * with a core profile context
+ *******************************************************************/
+void GLState::applyFixed(const gl_fixed_state_t& state)
+{
+	enable(GL_ALPHA_TEST, state.alpha_test);
+	if (state.alpha_test)
+		alphaFunc(state.alpha_func, state.alpha_ref);
+	enable(GL_FOG, state.fog);
+	if (state.fog)
+		fog(state.fog_colour, state.fog_start, state.fog_end);
+	enable(GL_LIGHTING, state.lighting);
+	clientState(GL_VERTEX_ARRAY, state.vertex_array);
+	clientState(GL_COLOR_ARRAY, state.colour_array);
+	clientState(GL_TEXTURE_COORD_ARRAY, state.texcoord_array);
+}
+
+/* GLState::invalidate
+ * Forgets all tracked state, so the next call for each is made
+ *******************************************************************/
+void GLState::invalidate()
+{
+	for (unsigned a = 0; a < n_caps; a++)
+		cap_state[a] = GL_STATE_UNKNOWN;
+	for (unsigned a = 0; a < n_arrays; a++)
+		array_state[a] = GL_STATE_UNKNOWN;
+	depth_write = GL_STATE_UNKNOWN;
+	cull_mode = GL_OBJECT_UNKNOWN;
+	alpha_func = GL_OBJECT_UNKNOWN;
+	fog_valid = false;
+	array_buffer = GL_OBJECT_UNKNOWN;
+	element_buffer = GL_OBJECT_UNKNOWN;
+	copy_read_buffer = GL_OBJECT_UNKNOWN;
+	copy_write_buffer = GL_OBJECT_UNKNOWN;
+	vertex_array = GL_OBJECT_UNKNOWN;
+	program = GL_OBJECT_UNKNOWN;
+	initialised = true;
+}
+
+/* GLState::countCalls
+ * Adds [n] GL calls made outside GLState to the frame's total
+ *******************************************************************/
+void GLState::countCalls(unsigned n)
+{
+	issued += n;
+}
+
+/* GLState::nextFrame
+ * Ends the current frame's call counts
+ *******************************************************************/
+void GLState::nextFrame()
+{
+	last_issued = issued;
+	last_skipped = skipped;
+	issued = 0;
+	skipped = 0;
+}
+
+/* GLState::callsIssued
+ * Returns the number of GL calls made last frame
+ *******************************************************************/
+unsigned GLState::callsIssued()
+{
+	return last_issued;
+}
+
+/* GLState::callsSkipped
+ * Returns the number of redundant GL calls skipped last frame
+ *******************************************************************/
+unsigned GLState::callsSkipped()
+{
+	return last_skipped;
+}
+
+
+/*******************************************************************
+ * CONSOLE COMMANDS
+ *******************************************************************/
+
+CONSOLE_COMMAND(gl_stats, 0, true)
+{
+	Console::logMessage(S_FMT("%d GL calls last frame, %d redundant state calls skipped", GLState::callsIssued(), GLState::callsSkipped()));
+}
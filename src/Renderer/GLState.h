@@ -0,0 +1,84 @@
+
+#ifndef __GL_STATE_H__
+#define __GL_STATE_H__
+
+// State a render pass needs. Passes declare it and pass it to
+// GLState::apply, which only makes the GL calls for the parts that
+// differ from the current state. Everything here is valid in a core
+// profile context
+struct gl_pass_state_t
+{
+	bool	depth_test;
+	bool	depth_write;
+	bool	cull_face;
+	GLenum	cull_mode;
+
+	gl_pass_state_t()
+	{
+		depth_test = false;
+		depth_write = true;
+		cull_face = false;
+		cull_mode = GL_BACK;
+	}
+};
+
+// Fixed-function state for passes drawn without shaders, applied with
+// GLState::applyFixed. None of this exists in a core profile context,
+// so only the legacy (fixed-function) renderers may use it
+struct gl_fixed_state_t
+{
+	bool	alpha_test;
+	GLenum	alpha_func;
+	float	alpha_ref;
+	bool	fog;
+	rgba_t	fog_colour;
+	float	fog_start;
+	float	fog_end;
+	bool	lighting;
+	bool	vertex_array;
+	bool	colour_array;
+	bool	texcoord_array;
+
+	gl_fixed_state_t()
+	{
+		alpha_test = false;
+		alpha_func = GL_ALWAYS;
+		alpha_ref = 0.0f;
+		fog = false;
+		fog_start = 0.0f;
+		fog_end = 1.0f;
+		lighting = false;
+		vertex_array = false;
+		colour_array = false;
+		texcoord_array = false;
+	}
+};
+
+// Tracks the current GL state so that redundant calls can be skipped.
+// Anything drawn outside the renderers (ie. by SFML) can change the
+// state behind its back, so invalidate must be called after that
+namespace GLState
+{
+	void	enable(GLenum cap, bool enable);
+	void	clientState(GLenum array, bool enable);
+	void	depthMask(bool write);
+	void	cullFace(GLenum mode);
+	void	alphaFunc(GLenum func, float ref);
+	void	fog(rgba_t colour, float start, float end);
+	void	bindBuffer(GLenum target, GLuint buffer);
+	void	bufferDeleted(GLuint buffer);
+	void	bindVertexArray(GLuint vao);
+	void	useProgram(GLuint id);
+	void	apply(const gl_pass_state_t& state);
+	void	applyFixed(const gl_fixed_state_t& state);
+	void	invalidate();
+
+	// GL calls made directly (draws, pointers etc.) count towards the
+	// per-frame total too
+	void		countCalls(unsigned n = 1);
+	void		nextFrame();
+	unsigned	callsIssued();		// Last frame
+	unsigned	callsSkipped();		// Last frame
+}
+
+#endif//__GL_STATE_H__
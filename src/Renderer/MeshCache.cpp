@@ -0,0 +1,84 @@
+
+#include "Main.h"
+#include "MeshCache.h"
+#include "StandardRenderer.h"
+
+MeshCache::MeshCache()
+{
+	_frame = 0;
+	_bytes_resident = 0;
+	resetStats();
+}
+
+MeshCache::~MeshCache()
+{
+}
+
+/* MeshCache::add
+ * Adds a newly uploaded mesh of [render_cell] at [lod_level], taking
+ * up [bytes] of GPU memory. Returns the entry to use with touch and
+ * remove
+ *******************************************************************/
+MeshCache::entry_id_t MeshCache::add(RenderCell* render_cell, uint8_t lod_level, unsigned bytes)
+{
+	entry_t entry = { render_cell, lod_level, bytes, _frame };
+	_lru.push_front(entry);
+	_bytes_resident += bytes;
+
+	return _lru.begin();
+}
+
+/* MeshCache::remove
+ * Removes [entry], when its mesh has been unloaded by its cell
+ *******************************************************************/
+void MeshCache::remove(entry_id_t entry)
+{
+	_bytes_resident -= entry->bytes;
+	_lru.erase(entry);
+}
+
+/* MeshCache::touch
+ * Marks [entry] as used this frame, moving it to the front
+ *******************************************************************/
+void MeshCache::touch(entry_id_t entry)
+{
+	entry->last_used = _frame;
+	if (entry != _lru.begin())
+		_lru.splice(_lru.begin(), _lru, entry);
+}
+
+/* MeshCache::evict
+ * Unloads least recently used meshes until no more than [budget]
+ * bytes are resident. Meshes used this frame are never evicted, so
+ * this can stop short of the budget if it is too small for what is
+ * in view
+ *******************************************************************/
+void MeshCache::evict(uint64_t budget)
+{
+	while (_bytes_resident > budget && !_lru.empty())
+	{
+		entry_t& entry = _lru.back();
+		if (entry.last_used == _frame)
+			break;
+
+		// Unloading the mesh removes the entry
+		entry.render_cell->unloadMesh(entry.lod_level);
+		_evictions++;
+	}
+}
+
+/* MeshCache::clear
+ * Unloads all resident meshes
+ *******************************************************************/
+void MeshCache::clear()
+{
+	while (!_lru.empty())
+		_lru.back().render_cell->unloadMesh(_lru.back().lod_level);
+}
+
+void MeshCache::resetStats()
+{
+	_hits = 0;
+	_misses = 0;
+	_evictions = 0;
+}
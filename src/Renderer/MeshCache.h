@@ -0,0 +1,54 @@
+
+#ifndef __MESH_CACHE_H__
+#define __MESH_CACHE_H__
+
+#include <list>
+
+class RenderCell;
+
+// Keeps track of every cell mesh resident on the GPU, in least
+// recently used order, and evicts the oldest when over budget. Cells
+// keep a mesh per LOD, so a cell moving back and forth between LODs
+// can switch to a cached mesh instead of building a new one
+class MeshCache
+{
+private:
+	struct entry_t
+	{
+		RenderCell*	render_cell;
+		uint8_t		lod_level;
+		unsigned	bytes;
+		unsigned	last_used;	// Frame the mesh was last drawn
+	};
+
+	std::list<entry_t>	_lru;	// Most recently used first
+	unsigned	_frame;
+	uint64_t	_bytes_resident;
+	uint64_t	_hits;
+	uint64_t	_misses;
+	uint64_t	_evictions;
+
+public:
+	typedef std::list<entry_t>::iterator entry_id_t;
+
+	MeshCache();
+	~MeshCache();
+
+	uint64_t	bytesResident() const { return _bytes_resident; }
+	unsigned	numResident() const { return _lru.size(); }
+	uint64_t	hits() const { return _hits; }
+	uint64_t	misses() const { return _misses; }
+	uint64_t	evictions() const { return _evictions; }
+
+	void		nextFrame() { _frame++; }
+	entry_id_t	add(RenderCell* render_cell, uint8_t lod_level, unsigned bytes);
+	void		remove(entry_id_t entry);
+	void		touch(entry_id_t entry);
+	void		hit() { _hits++; }
+	void		miss() { _misses++; }
+	void		evict(uint64_t budget);
+	void		clear();
+	void		resetStats();
+};
+
+#endif//__MESH_CACHE_H__
@@ -41,6 +41,14 @@ public:
 	virtual bool	init() = 0;
 	virtual void	renderScene(int width, int height) = 0;
 	virtual void	renderCell(Cell* cell) = 0;
+
+	// Waits for any work on other threads that reads the zone and
+	// discards its results, so the zone can be changed safely
+	virtual void	finishMeshing() {}
+
+	// Running totals, for benchmarks
+	virtual unsigned	numCellsMeshed() { return 0; }
+	virtual uint64_t	numBytesUploaded() { return 0; }
 };
 
 #endif//__RENDERER_H__
@@ -2,94 +2,400 @@
 #include "Main.h"
 #include "glew/glew.h"
 #include "ShaderRenderer.h"
+#include "StandardRenderer.h"
 #include "Camera.h"
+#include "Utilities/Math.h"
 #include "World/Cell.h"
+#include "World/Zone.h"
+#include "Console.h"
+#include "GLState.h"
+#include "Utilities/Profiler.h"
+#include <cmath>
 
-const float vertexPositions[] ={
-	0.75f, 0.75f, 0.0f, 1.0f,
-	0.75f, -0.75f, 0.0f, 1.0f,
-	-0.75f, -0.75f, 0.0f, 1.0f,
-};
+EXTERN_CVAR(Float, max_view_distance)
+EXTERN_CVAR(Bool, cull_frustum)
+
+// Shared with StandardRenderer
+extern rgba_t col_sky;
+extern Zone test_zone;
+extern bool test_zone_regenerated;
+
+// Each column is a top quad and four walls, two triangles each
+#define COLUMN_VERTICES	30
 
-const Renderer::glvertex_t vertices[] ={
-	Renderer::glvertex_t(0.0f, 0.5f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f),
-	Renderer::glvertex_t(0.5f, -0.366f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f),
-	Renderer::glvertex_t(-0.5f, -0.366f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f),
+// Top face colour for each LOD, the same as CellMesh uses
+static const rgba_t lod_colours[NUM_LODS] =
+{
+	rgba_t(40, 130, 40, 255),
+	rgba_t(130, 100, 40, 255),
+	rgba_t(130, 100, 180, 255),
+	rgba_t(40, 150, 100, 255),
 };
 
+// Statistics for the last frame (see shader_stats command)
+unsigned stat_shader_cells[NUM_LODS] = { 0, 0, 0, 0 };
+unsigned stat_shader_draw_calls = 0;
+uint64_t stat_shader_vertices = 0;
+
+// Everything uploaded since init
+uint64_t stat_shader_bytes_uploaded = 0;
+
+/* ShaderRenderer::ShaderRenderer
+ * ShaderRenderer class constructor
+ *******************************************************************/
 ShaderRenderer::ShaderRenderer() : _shader_vertex(GL_VERTEX_SHADER), _shader_fragment(GL_FRAGMENT_SHADER)
 {
+	_vao = 0;
+	_instance_buffer = 0;
+	_height_texture = 0;
+	_base_texture = 0;
+	_lod_scale = 1.0f;
 }
 
+/* ShaderRenderer::~ShaderRenderer
+ * ShaderRenderer class destructor
+ *******************************************************************/
 ShaderRenderer::~ShaderRenderer()
 {
+	if (_instance_buffer)
+		glDeleteBuffers(1, &_instance_buffer);
+	if (_height_texture)
+		glDeleteTextures(1, &_height_texture);
+	if (_base_texture)
+		glDeleteTextures(1, &_base_texture);
+	if (_vao)
+		glDeleteVertexArrays(1, &_vao);
+
+	// Deleting bound objects unbinds them
+	GLState::invalidate();
 }
 
+/* ShaderRenderer::init
+ * Loads the column shaders, sets up the instance attribute and
+ * uploads the test zone heights. Returns false if the shaders failed
+ * to compile or link
+ *******************************************************************/
 bool ShaderRenderer::init()
 {
-	bool ok = true;
+	_shader_vertex.openFile("shaders/column_vertex.glsl");
+	_shader_fragment.openFile("shaders/column_fragment.glsl");
 
-	glGenBuffers(1, &_position_buffer_object);
+	_program.addShader(&_shader_vertex);
+	_program.addShader(&_shader_fragment);
+	if (!_program.link())
+		return false;
 
-	glBindBuffer(GL_ARRAY_BUFFER, _position_buffer_object);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GLuint program = _program.getId();
+	_uniform_mvp = glGetUniformLocation(program, "mat_mvp");
+	_uniform_lod = glGetUniformLocation(program, "lod");
+	_uniform_zone_size = glGetUniformLocation(program, "zone_size");
+	_uniform_heights = glGetUniformLocation(program, "heights");
+	_uniform_base_heights = glGetUniformLocation(program, "base_heights");
+	_uniform_top_colour = glGetUniformLocation(program, "top_colour");
+	_uniform_fog = glGetUniformLocation(program, "fog_range");
+	_uniform_sky = glGetUniformLocation(program, "sky_colour");
 
+	// The only vertex attribute is the cell position, once per instance
+	glGenBuffers(1, &_instance_buffer);
 	glGenVertexArrays(1, &_vao);
+	GLState::bindVertexArray(_vao);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, _instance_buffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribDivisor(0, 1);
 
-	_shader_vertex.openFile("shaders/vertex.glsl");
-	_shader_fragment.openFile("shaders/fragment.glsl");
-	
-	_program.addShader(&_shader_vertex);
-	_program.addShader(&_shader_fragment);
-	if (!_program.link())
-		ok = false;
+	glGenTextures(1, &_height_texture);
+	glGenTextures(1, &_base_texture);
+
+	test_zone.generateTestLandscape();
+	uploadHeights();
+
+	return true;
+}
+
+/* ShaderRenderer::uploadHeights
+ * Uploads the heights of every cell in the zone. Each LOD is a mip
+ * level of the height texture, holding heights above the cell base
+ * (so they fit in a byte), and the base heights go in a separate
+ * texture with one texel per cell
+ *******************************************************************/
+void ShaderRenderer::uploadHeights()
+{
+	PROF_SCOPE("ShaderRenderer::uploadHeights");
+
+	unsigned zone_width = test_zone.getWidth();
+	unsigned zone_height = test_zone.getHeight();
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-	// Setup perspective
-	if (ok)
+	glBindTexture(GL_TEXTURE_2D, _height_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, NUM_LODS - 1);
+	for (uint8_t lod = 0; lod < NUM_LODS; lod++)
 	{
-		GLint uniform_perspective = glGetUniformLocation(_program.getId(), "mat_perspective");
-		glUseProgram(_program.getId());
-		glUniformMatrix4fv(uniform_perspective, 1, GL_FALSE, perspectiveMatrix(1.0f, 0.1f, 100.0f).data());
-		glUseProgram(0);
+		unsigned dim = CellMesh::lodDim(lod);
+		unsigned width = zone_width * dim;
+		vector<uint8_t> data(width * zone_height * dim);
+		for (unsigned cx = 0; cx < zone_width; cx++)
+		{
+			for (unsigned cy = 0; cy < zone_height; cy++)
+			{
+				Cell* cell = test_zone.getCell(cx, cy);
+				float base = cell->baseHeight();
+				for (unsigned x = 0; x < dim; x++)
+					for (unsigned y = 0; y < dim; y++)
+						data[(cy * dim + y) * width + cx * dim + x] = (uint8_t)(cell->heightAt(lod, x, y) - base + 0.5f);
+			}
+		}
+
+		glTexImage2D(GL_TEXTURE_2D, lod, GL_R8UI, width, zone_height * dim, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &data[0]);
+		stat_shader_bytes_uploaded += data.size();
 	}
 
-	return ok;
+	vector<float> bases(zone_width * zone_height);
+	for (unsigned cx = 0; cx < zone_width; cx++)
+		for (unsigned cy = 0; cy < zone_height; cy++)
+			bases[cy * zone_width + cx] = test_zone.getCell(cx, cy)->baseHeight();
+
+	glBindTexture(GL_TEXTURE_2D, _base_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, zone_width, zone_height, 0, GL_RED, GL_FLOAT, &bases[0]);
+	stat_shader_bytes_uploaded += bases.size() * sizeof(float);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 }
 
+/* ShaderRenderer::renderScene
+ * Draws every cell in view, at the coarsest LOD within lod_max_error
+ *******************************************************************/
 void ShaderRenderer::renderScene(int width, int height)
 {
-	glUseProgram(_program.getId());
-	glBindVertexArray(_vao);
+	PROF_SCOPE("ShaderRenderer::renderScene");
 
-	glBindBuffer(GL_ARRAY_BUFFER, _position_buffer_object);
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 8*sizeof(float), 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)16);
+	// Calculate aspect ratio
+	float aspect = ((float)width / (float)height);
+	float fovy = 2 * (float)Math::radToDeg(atan(tan(Math::degToRad(90) / 2) / aspect));
+
+	// Setup projection and view
+	mat4f_t projection = Camera::perspectiveMatrix(fovy, aspect, 0.5f, max_view_distance * 1.3f);
+	mat4f_t view = _camera.viewMatrix();
+	_frustum.extract(projection.data(), view.data());
+
+	float mvp[16];
+	for (unsigned c = 0; c < 4; c++)
+	{
+		for (unsigned r = 0; r < 4; r++)
+		{
+			mvp[c * 4 + r] = 0.0f;
+			for (unsigned k = 0; k < 4; k++)
+				mvp[c * 4 + r] += projection[k * 4 + r] * view[c * 4 + k];
+		}
+	}
+
+	// Projected size of 1 unit at distance 1, in pixels
+	_lod_scale = (float)height / (2.0f * tanf((float)Math::degToRad(fovy) / 2.0f));
+
+	// Setup GL stuff
+	gl_pass_state_t state;
+	state.depth_test = true;
+	state.cull_face = true;
+	state.cull_mode = GL_BACK;
+	GLState::apply(state);
+
+	// Clear
+	glClearColor(col_sky.fr(), col_sky.fg(), col_sky.fb(), 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+	GLState::countCalls(2);
+
+	if (!_program.isValid())
+		return;
+
+	if (test_zone_regenerated)
+	{
+		uploadHeights();
+		_cell_lods.clear();
+		test_zone_regenerated = false;
+	}
+	if (_cell_lods.size() != test_zone.numCells())
+		_cell_lods.assign(test_zone.numCells(), LOD_NONE);
 
-	glDrawArrays(GL_TRIANGLES, 0, 3);
+	// Find visible cells
+	for (unsigned a = 0; a < NUM_LODS; a++)
+		_instances[a].clear();
+	visitNode(test_zone.numLevels() - 1, 0, false);
 
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glUseProgram(0);
-	glBindVertexArray(0);
+	GLState::useProgram(_program.getId());
+	glUniformMatrix4fv(_uniform_mvp, 1, GL_FALSE, mvp);
+	glUniform2f(_uniform_fog, max_view_distance * 0.4f, max_view_distance * 0.8f);
+	glUniform3f(_uniform_sky, col_sky.fr(), col_sky.fg(), col_sky.fb());
+	GLState::countCalls(3);
+
+	for (unsigned a = 0; a < NUM_LODS; a++)
+		stat_shader_cells[a] = _instances[a].size() / 2;
+	stat_shader_draw_calls = 0;
+	stat_shader_vertices = 0;
+	drawInstances();
 }
 
+/* ShaderRenderer::renderCell
+ * Draws [cell] at full detail, with the view set up by the last call
+ * to renderScene
+ *******************************************************************/
 void ShaderRenderer::renderCell(Cell* cell)
 {
+	if (!cell || !_program.isValid())
+		return;
+
+	for (unsigned a = 0; a < NUM_LODS; a++)
+		_instances[a].clear();
+	_instances[0].push_back(cell->zoneX());
+	_instances[0].push_back(cell->zoneY());
+	drawInstances();
+}
+
+/* ShaderRenderer::numBytesUploaded
+ * Returns the amount of height and instance data uploaded since init
+ *******************************************************************/
+uint64_t ShaderRenderer::numBytesUploaded()
+{
+	return stat_shader_bytes_uploaded;
 }
 
-mat4f_t	ShaderRenderer::perspectiveMatrix(float scale, float z_near, float z_far)
+/* ShaderRenderer::selectLod
+ * Returns the LOD the cell at [index] should be drawn at, or LOD_NONE
+ * if it is out of view range, and remembers it for next frame's
+ * hysteresis (see RenderCell::selectLod)
+ *******************************************************************/
+uint8_t ShaderRenderer::selectLod(unsigned index)
 {
-	mat4f_t ret;
+	uint8_t lod = RenderCell::selectLod(test_zone.cellAt(index), _camera.getPosition(), _lod_scale, _cell_lods[index]);
+	_cell_lods[index] = lod;
+	return lod;
+}
+
+/* ShaderRenderer::visitNode
+ * Adds the cells under quadtree node [index] at [level] (see Zone) to
+ * the instance lists, skipping subtrees outside the view frustum. If
+ * [inside] is true the node is already known to be entirely in it
+ *******************************************************************/
+void ShaderRenderer::visitNode(unsigned level, unsigned index, bool inside)
+{
+	// Nothing under the node is in the zone
+	float min_height = test_zone.nodeMinHeight(level, index);
+	float max_height = test_zone.nodeMaxHeight(level, index);
+	if (min_height > max_height)
+		return;
+
+	unsigned x, y;
+	Math::mortonDecode(index << (level * 2), x, y);
+	unsigned size = 1 << level;
 
-	ret[0] = scale;
-	ret[5] = scale;
-	ret[10] = (z_far + z_near) / (z_near - z_far);
-	ret[14] = (2 * z_far * z_near) / (z_near - z_far);
-	ret[11] = -1.0f;
+	// Skip if the nearest cell centre is out of range
+	fpoint3_t cam = _camera.getPosition();
+	float x1 = x * 32.0f + 16.0f;
+	float y1 = y * 32.0f + 16.0f;
+	float x2 = x1 + (size - 1) * 32.0f;
+	float y2 = y1 + (size - 1) * 32.0f;
+	float near_x = cam.x < x1 ? x1 - cam.x : (cam.x > x2 ? cam.x - x2 : 0.0f);
+	float near_y = cam.y < y1 ? y1 - cam.y : (cam.y > y2 ? cam.y - y2 : 0.0f);
+	if (near_x * near_x + near_y * near_y >= max_view_distance * max_view_distance)
+		return;
+
+	// Frustum test, walls can go down to 0 (see RenderCell::boundsMin)
+	if (cull_frustum && !inside)
+	{
+		fpoint3_t box_min(x * 32.0f, y * 32.0f, std::min(min_height, 0.0f));
+		fpoint3_t box_max((x + size) * 32.0f, (y + size) * 32.0f, max_height);
+		int result = _frustum.classifyBox(box_min, box_max);
+		if (result == FRUSTUM_OUTSIDE)
+			return;
+		inside = (result == FRUSTUM_INSIDE);
+	}
+
+	if (level == 0)
+	{
+		uint8_t lod = selectLod(index);
+		if (lod != LOD_NONE)
+		{
+			_instances[lod].push_back(x);
+			_instances[lod].push_back(y);
+		}
+	}
+	else
+	{
+		for (unsigned a = 0; a < 4; a++)
+			visitNode(level - 1, index * 4 + a, inside);
+	}
+}
 
-	return ret;
+/* ShaderRenderer::drawInstances
+ * Uploads the instance lists and draws each LOD's cells with a single
+ * instanced draw call
+ *******************************************************************/
+void ShaderRenderer::drawInstances()
+{
+	PROF_SCOPE("ShaderRenderer::drawInstances");
+
+	// All the instance lists go in the one buffer
+	vector<uint16_t> data;
+	unsigned offsets[NUM_LODS];
+	for (unsigned a = 0; a < NUM_LODS; a++)
+	{
+		offsets[a] = data.size() * sizeof(uint16_t);
+		data.insert(data.end(), _instances[a].begin(), _instances[a].end());
+	}
+	if (data.empty())
+		return;
+
+	GLState::useProgram(_program.getId());
+	GLState::bindVertexArray(_vao);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, _instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(uint16_t), &data[0], GL_STREAM_DRAW);
+	GLState::countCalls(8);
+	stat_shader_bytes_uploaded += data.size() * sizeof(uint16_t);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, _height_texture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, _base_texture);
+	glUniform1i(_uniform_heights, 0);
+	glUniform1i(_uniform_base_heights, 1);
+	glUniform2i(_uniform_zone_size, test_zone.getWidth(), test_zone.getHeight());
+
+	for (uint8_t lod = 0; lod < NUM_LODS; lod++)
+	{
+		unsigned n_instances = _instances[lod].size() / 2;
+		if (n_instances == 0)
+			continue;
+
+		unsigned dim = CellMesh::lodDim(lod);
+		unsigned n_vertices = dim * dim * COLUMN_VERTICES;
+		rgba_t col = lod_colours[lod];
+		glUniform1i(_uniform_lod, lod);
+		glUniform3f(_uniform_top_colour, col.fr(), col.fg(), col.fb());
+		glVertexAttribIPointer(0, 2, GL_UNSIGNED_SHORT, 0, (void*)(size_t)offsets[lod]);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, n_vertices, n_instances);
+		GLState::countCalls(4);
+
+		stat_shader_draw_calls++;
+		stat_shader_vertices += (uint64_t)n_vertices * n_instances;
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	GLState::countCalls();
+}
+
+
+/*******************************************************************
+ * CONSOLE COMMANDS
+ *******************************************************************/
+
+CONSOLE_COMMAND(shader_stats, 0, true)
+{
+	Console::logMessage(S_FMT("%d cells drawn in %d draw calls", stat_shader_cells[0] + stat_shader_cells[1] + stat_shader_cells[2] + stat_shader_cells[3], stat_shader_draw_calls));
+	Console::logMessage(S_FMT("By LOD: %d / %d / %d / %d", stat_shader_cells[0], stat_shader_cells[1], stat_shader_cells[2], stat_shader_cells[3]));
+	Console::logMessage(S_FMT("%1.2f million vertices pulled", (double)stat_shader_vertices / 1000000.0));
 }
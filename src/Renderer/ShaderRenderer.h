@@ -4,18 +4,46 @@
 
 #include "Shader.h"
 #include "Renderer.h"
+#include "Frustum.h"
+#include "CellMesh.h"
 
+// Core-profile terrain renderer. Cell heights are kept in textures
+// and each visible cell is drawn as an instance, with the vertex
+// shader building the column faces from gl_VertexID. No vertex
+// positions are ever uploaded, only one cell position per instance
 class Camera;
 class ShaderRenderer : public Renderer
 {
 private:
-	GLuint	_position_buffer_object;
 	GLuint	_vao;
+	GLuint	_instance_buffer;
+	GLuint	_height_texture;	// Heights above the cell base, one mip level per LOD
+	GLuint	_base_texture;		// Cell base heights
 
 	Shader			_shader_vertex;
 	Shader			_shader_fragment;
 	ShaderProgram	_program;
 
+	Frustum				_frustum;
+	float				_lod_scale;
+	vector<uint16_t>	_instances[NUM_LODS];	// Cell x,y pairs to draw at each LOD
+	vector<uint8_t>		_cell_lods;				// LOD each cell was last drawn at, by zone index
+
+	// Uniform locations
+	GLint	_uniform_mvp;
+	GLint	_uniform_lod;
+	GLint	_uniform_zone_size;
+	GLint	_uniform_heights;
+	GLint	_uniform_base_heights;
+	GLint	_uniform_top_colour;
+	GLint	_uniform_fog;
+	GLint	_uniform_sky;
+
+	void	uploadHeights();
+	uint8_t	selectLod(unsigned index);
+	void	visitNode(unsigned level, unsigned index, bool inside);
+	void	drawInstances();
+
 public:
 	ShaderRenderer();
 	~ShaderRenderer();
@@ -23,7 +51,7 @@ public:
 	bool	init();
 	void	renderScene(int width, int height);
 	void	renderCell(Cell* cell);
-	mat4f_t	perspectiveMatrix(float scale, float z_near, float z_far);
+	uint64_t	numBytesUploaded();
 };
 
 #endif//__SHADER_RENDERER_H__
@@ -2,215 +2,399 @@
 #include "Main.h"
 #include "glew/glew.h"
 #include "StandardRenderer.h"
+#include "CellMesh.h"
+#include "Frustum.h"
 #include "Camera.h"
 #include "Utilities/Math.h"
 #include "World/Cell.h"
 #include "World/Zone.h"
-
+#include "Utilities/ThreadPool.h"
+#include "Utilities/LockFreeQueue.h"
+#include "Console.h"
+#include "GLState.h"
+#include "UploadRing.h"
+#include "Utilities/Profiler.h"
+
+CVAR(Int, mesh_threads, 0, CVAR_SAVE)
+CVAR(Int, mesh_uploads_per_frame, 64, CVAR_SAVE)
+CVAR(Bool, mesh_compact_vertices, true, CVAR_SAVE)
+CVAR(Bool, cull_frustum, true, CVAR_SAVE)
+CVAR(Bool, render_multi_draw, true, CVAR_SAVE)
+CVAR(Int, mesh_cache_mb, 128, CVAR_SAVE)
+CVAR(Bool, mesh_upload_ring, true, CVAR_SAVE|CVAR_LOCKED)
+CVAR(Float, lod_max_error, 2.0f, CVAR_SAVE)
+CVAR(Float, lod_hysteresis, 0.25f, CVAR_SAVE)
+CVAR(Int, far_merge_level, 3, CVAR_SAVE)
 EXTERN_CVAR(Float, max_view_distance)
 
 // testing
 //Cell test_cell;
 rgba_t col_sky(70, 130, 240);
 Zone test_zone(128, 128);
+bool test_zone_regenerated = false;
+
+// Cell meshes are built on these threads and passed back to the
+// render thread through mesh_results
+ThreadPool* mesh_pool = nullptr;
+LockFreeQueue<mesh_job_t*> mesh_results;
+
+// All cell meshes are sub-allocated from these, so everything visible
+// can be drawn without switching buffers. They grow as needed
+#define VERTEX_ARENA_SIZE	(16 * 1024 * 1024)
+#define INDEX_ARENA_SIZE	(4 * 1024 * 1024)
+BufferArena* vertex_arena = nullptr;
+BufferArena* index_arena = nullptr;
+
+// Mesh data is streamed to the arenas through this (see UploadRing)
+#define UPLOAD_RING_SIZE	(8 * 1024 * 1024)
+UploadRing* upload_ring = nullptr;
+
+// Meshes resident in the arenas, evicted least recently used first
+// once over mesh_cache_mb
+MeshCache mesh_cache;
+
+// Mesh statistics (see mesh_stats command)
+unsigned stat_meshes_built = 0;
+uint64_t stat_quads_naive = 0;
+uint64_t stat_quads_built = 0;
+uint64_t stat_vertices_built = 0;
+uint64_t stat_bytes_uploaded = 0;
+
+// Culling statistics for the last frame (see cull_stats command)
+unsigned stat_nodes_visited = 0;
+unsigned stat_nodes_out_of_range = 0;
+unsigned stat_nodes_culled = 0;
+unsigned stat_cells_drawn = 0;
+unsigned stat_cells_lod[NUM_LODS] = { 0, 0, 0, 0 };
+unsigned stat_super_cells_drawn = 0;
+unsigned stat_super_cells_members = 0;
+unsigned stat_draw_calls = 0;
 #define TEST_DIM 64
 
+// Returns the neighbour of [cell] on [side] (see NEIGHBOUR_*), if any
+static Cell* neighbourCell(Zone& zone, Cell* cell, unsigned side)
+{
+	if (side == NEIGHBOUR_WEST)
+		return zone.getCell(cell->zoneX() - 1, cell->zoneY());
+	else if (side == NEIGHBOUR_EAST)
+		return zone.getCell(cell->zoneX() + 1, cell->zoneY());
+	else if (side == NEIGHBOUR_SOUTH)
+		return zone.getCell(cell->zoneX(), cell->zoneY() - 1);
+	else
+		return zone.getCell(cell->zoneX(), cell->zoneY() + 1);
+}
+
+// Deletes [job] and any meshes in it
+static void deleteJob(mesh_job_t* job)
+{
+	delete job->mesh;
+	for (unsigned a = 0; a < job->member_meshes.size(); a++)
+		delete job->member_meshes[a];
+	delete job;
+}
+
+// Returns the distance from [point] to the nearest point of the box
+// [min]-[max], or 0 if it is inside
+static float boxDistance(fpoint3_t point, fpoint3_t min, fpoint3_t max)
+{
+	float dx = point.x < min.x ? min.x - point.x : (point.x > max.x ? point.x - max.x : 0.0f);
+	float dy = point.y < min.y ? min.y - point.y : (point.y > max.y ? point.y - max.y : 0.0f);
+	float dz = point.z < min.z ? min.z - point.z : (point.z > max.z ? point.z - max.z : 0.0f);
+	return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
 RenderCell::RenderCell(Cell* cell)
 {
 	_cell = cell;
-	_vbo_vertices = 0;
-	_vbo_indices = 0;
-	_n_quads = 0;
-	_current_lod_level = 0;
+	_current = LOD_NONE;
+	_lod = LOD_NONE;
+	_mesh_pending = false;
+	for (unsigned a = 0; a < NUM_LODS; a++)
+	{
+		_meshes[a].vertex_block = ARENA_NONE;
+		_meshes[a].index_block = ARENA_NONE;
+		_meshes[a].n_indices = 0;
+		memset(&_meshes[a].state, 0, sizeof(mesh_state_t));
+	}
 }
 
 RenderCell::~RenderCell()
 {
 }
 
-void RenderCell::generateVBO(uint8_t lod_level)
+/* RenderCell::uploadMesh
+ * Uploads [mesh] to the shared arenas, replacing the cell's cached
+ * mesh at the same LOD, and starts drawing it. [state] is what the
+ * mesh was built against
+ *******************************************************************/
+void RenderCell::uploadMesh(const CellMesh& mesh, const mesh_state_t& state)
 {
-	// Create VBOs if needed
-	if (_vbo_vertices == 0)
-		glGenBuffers(1, &_vbo_vertices);
-	//if (_vbo_indices == 0)
-	//	glGenBuffers(1, &_vbo_indices);
+	uint8_t lod_level = state.lod_level;
+	unloadMesh(lod_level);
 
-	unsigned dim = 32;
-	float size = 1.0f;
-	rgba_t col_top(40, 130, 40, 255);
-	if (lod_level == 1)
-	{
-		dim = 16;
-		size = 2.0f;
-		col_top.set(130, 100, 40, 255);
-	}
-	else if (lod_level == 2)
-	{
-		dim = 8;
-		size = 4.0f;
-		col_top.set(130, 100, 180, 255);
-	}
-	else if (lod_level == 3)
+	cell_mesh_t& cm = _meshes[lod_level];
+	cm.n_indices = mesh.numIndices();
+	cm.state = state;
+	for (unsigned a = 0; a < NUM_FACE_TYPES; a++)
 	{
-		dim = 4;
-		size = 8.0f;
-		col_top.set(40, 150, 100, 255);
+		cm.group_indices[a] = mesh.groupIndices(a);
+		cm.palette[a] = mesh.paletteColour(a);
 	}
 
-	_vertices = new OpenGL::vertex_t[dim*dim*20];
-	_n_quads = 0;
-	//vector<OpenGL::vertex_t> vertices;
-
-	rgba_t col_v = col_top.ampf(0.8f, 0.8f, 0.8f, 1.0f);
-	rgba_t col_h = col_top.ampf(0.7f, 0.7f, 0.7f, 1.0f);
+	unsigned vertex_bytes = mesh.numVertices() * mesh.vertexSize();
+	unsigned index_bytes = cm.n_indices * sizeof(uint16_t);
+	stat_meshes_built++;
+	stat_quads_naive += mesh.numQuadsNaive();
+	stat_quads_built += mesh.numQuads();
+	stat_vertices_built += mesh.numVertices();
+	stat_bytes_uploaded += vertex_bytes + index_bytes;
+
+	// Vertices are aligned to the vertex size so they can be addressed
+	// with a base vertex index
+	cm.vertex_block = vertex_arena->allocate(vertex_bytes, mesh.vertexSize(), mesh.vertexData());
+	cm.index_block = index_arena->allocate(index_bytes, sizeof(uint16_t), cm.n_indices > 0 ? &mesh.indices()[0] : nullptr);
+	cm.cache_entry = mesh_cache.add(this, lod_level, vertex_bytes + index_bytes);
+	_current = lod_level;
+}
 
-	unsigned v = 0;
-	for (unsigned x = 0; x < dim; x++)
-	{
-		float xf = _cell->zoneX() * 32.0f + ((float)x * size);
-		for (unsigned y = 0; y < dim; y++)
-		{
-			float yf = _cell->zoneY() * 32.0f + ((float)y * size);
-			float top = _cell->heightAt(lod_level, x, y);
-
-			// Top
-			_vertices[v++].set(xf, yf, top, col_top);
-			_vertices[v++].set(xf + size, yf, top, col_top);
-			_vertices[v++].set(xf + size, yf + size, top, col_top);
-			_vertices[v++].set(xf, yf + size, top, col_top);
-			_n_quads++;
-
-			// Y-Axis
-			if (x == 0)
-			{
-				_vertices[v++].set(xf, yf, top, col_v);
-				_vertices[v++].set(xf, yf + size, top, col_v);
-				_vertices[v++].set(xf, yf + size, 0.0f, col_v);
-				_vertices[v++].set(xf, yf, 0.0f, col_v);
-				_n_quads++;
-			}
-			else
-			{
-				float bottom = _cell->heightAt(lod_level, x - 1, y);
-				_vertices[v++].set(xf, yf, top, col_v);
-				_vertices[v++].set(xf, yf + size, top, col_v);
-				_vertices[v++].set(xf, yf + size, bottom, col_v);
-				_vertices[v++].set(xf, yf, bottom, col_v);
-				_n_quads++;
-			}
+/* RenderCell::unloadMesh
+ * Frees the cell's cached mesh at [lod_level], if any
+ *******************************************************************/
+void RenderCell::unloadMesh(uint8_t lod_level)
+{
+	cell_mesh_t& cm = _meshes[lod_level];
+	if (cm.vertex_block == ARENA_NONE)
+		return;
 
-			if (x == dim - 1)
-			{
-				_vertices[v++].set(xf + size, yf, 0.0f, col_v);
-				_vertices[v++].set(xf + size, yf + size, 0.0f, col_v);
-				_vertices[v++].set(xf + size, yf + size, top, col_v);
-				_vertices[v++].set(xf + size, yf, top, col_v);
-				_n_quads++;
-			}
+	vertex_arena->release(cm.vertex_block);
+	index_arena->release(cm.index_block);
+	mesh_cache.remove(cm.cache_entry);
+	cm.vertex_block = ARENA_NONE;
+	cm.index_block = ARENA_NONE;
+	if (_current == lod_level)
+		_current = LOD_NONE;
+}
 
-			// X-Axis
-			if (y == 0)
-			{
-				_vertices[v++].set(xf, yf, 0.0f, col_h);
-				_vertices[v++].set(xf + size, yf, 0.0f, col_h);
-				_vertices[v++].set(xf + size, yf, top, col_h);
-				_vertices[v++].set(xf, yf, top, col_h);
-				_n_quads++;
-			}
-			else
-			{
-				float bottom = _cell->heightAt(lod_level, x, y - 1);
-				_vertices[v++].set(xf, yf, bottom, col_h);
-				_vertices[v++].set(xf + size, yf, bottom, col_h);
-				_vertices[v++].set(xf + size, yf, top, col_h);
-				_vertices[v++].set(xf, yf, top, col_h);
-				_n_quads++;
-			}
+/* RenderCell::useMesh
+ * Switches to drawing the cell's mesh for [state], if it has one
+ * cached. Otherwise returns true if a mesh needs building for it,
+ * and the current mesh is drawn until that is ready. Returns false
+ * if a mesh is already being built
+ *******************************************************************/
+bool RenderCell::useMesh(const mesh_state_t& state)
+{
+	// Still what's being drawn
+	if (_current == state.lod_level && _meshes[_current].state == state)
+	{
+		mesh_cache.touch(_meshes[_current].cache_entry);
+		return false;
+	}
 
-			if (y == dim - 1)
-			{
-				_vertices[v++].set(xf, yf + size, top, col_h);
-				_vertices[v++].set(xf + size, yf + size, top, col_h);
-				_vertices[v++].set(xf + size, yf + size, 0.0f, col_h);
-				_vertices[v++].set(xf, yf + size, 0.0f, col_h);
-				_n_quads++;
-			}
-		}
+	// Cached from before
+	cell_mesh_t& cm = _meshes[state.lod_level];
+	if (cm.vertex_block != ARENA_NONE && cm.state == state)
+	{
+		_current = state.lod_level;
+		mesh_cache.touch(cm.cache_entry);
+		mesh_cache.hit();
+		return false;
 	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, _vbo_vertices);
-	glBufferData(GL_ARRAY_BUFFER, _n_quads*4*sizeof(OpenGL::vertex_t), _vertices, GL_STATIC_DRAW);
+	if (_current != LOD_NONE)
+		mesh_cache.touch(_meshes[_current].cache_entry);
+	if (_mesh_pending)
+		return false;
 
-	/*glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _vbo_indices);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, 32*32*4*sizeof(uint16_t), indices, GL_STATIC_DRAW);*/
+	mesh_cache.miss();
+	return true;
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+/* RenderCell::touchMesh
+ * Marks the mesh being drawn as used this frame, for the mesh cache
+ *******************************************************************/
+void RenderCell::touchMesh()
+{
+	if (_current != LOD_NONE)
+		mesh_cache.touch(_meshes[_current].cache_entry);
+}
 
-	delete[] _vertices;
-	_vertices = nullptr;
-	//delete[] indices;
+/* RenderCell::inViewRange
+ * Returns true if [cell]'s centre is within view distance of
+ * [cam_position] (horizontally)
+ *******************************************************************/
+bool RenderCell::inViewRange(Cell* cell, fpoint3_t cam_position)
+{
+	float dx = cam_position.x - (16.0f + cell->zoneX() * 32.0f);
+	float dy = cam_position.y - (16.0f + cell->zoneY() * 32.0f);
+	return dx * dx + dy * dy < max_view_distance * max_view_distance;
+}
 
-	//logMessage(0, "VBO has %d quads - %d bytes", _n_quads, _n_quads*4*sizeof(OpenGL::vertex_t));
+/* RenderCell::boundsMin
+ * Returns the minimum corner of [cell]'s bounding box. Walls can go
+ * down to 0 at the edges of the drawn area, so this is always at the
+ * cell's base height
+ *******************************************************************/
+fpoint3_t RenderCell::boundsMin(Cell* cell)
+{
+	return fpoint3_t(cell->zoneX() * 32.0f, cell->zoneY() * 32.0f, min(cell->baseHeight(), 0.0f));
 }
 
-void RenderCell::unloadVBO()
+/* RenderCell::boundsMax
+ * Returns the maximum corner of [cell]'s bounding box
+ *******************************************************************/
+fpoint3_t RenderCell::boundsMax(Cell* cell)
 {
-	if (_vbo_vertices != 0)
-		glDeleteBuffers(1, &_vbo_vertices);
-	if (_vbo_indices != 0)
-		glDeleteBuffers(1, &_vbo_indices);
-	_vbo_vertices = 0;
-	_vbo_indices = 0;
+	return fpoint3_t(cell->zoneX() * 32.0f + 32.0f, cell->zoneY() * 32.0f + 32.0f, cell->maxHeight());
 }
 
-void RenderCell::render(fpoint3_t cam_position)
+/* RenderCell::selectLod
+ * Returns the LOD [cell] should be drawn at from [cam_position], or
+ * LOD_NONE if it is out of view distance. This is the coarsest LOD
+ * whose height error projects to no more than [lod_max_error] pixels
+ * from the nearest point of the cell, [lod_scale] being pixels per
+ * world unit at distance 1.
+ *
+ * To stop cells near a threshold switching back and forth, a cell
+ * keeps the LOD it was last drawn at ([current], LOD_NONE if none)
+ * until its error is more than [lod_hysteresis] over the limit, and
+ * only goes coarser once that LOD is the same amount under it.
+ * Selecting again from the result gives the same LOD
+ *******************************************************************/
+uint8_t RenderCell::selectLod(Cell* cell, fpoint3_t cam_position, float lod_scale, uint8_t current)
 {
-	// Determine LOD to use
-	uint8_t lod_level = 3;
-	double distance = Math::distance(cam_position.x, cam_position.y, 16.0 + _cell->zoneX() * 32.0, 16.0 + _cell->zoneY() * 32.0);
-	if (distance < max_view_distance * 0.2)
-		lod_level = 0;
-	else if (distance < max_view_distance * 0.4)
-		lod_level = 1;
-	else if (distance < max_view_distance * 0.7)
-		lod_level = 2;
-	else if (distance < max_view_distance)
-		lod_level = 3;
-	else
+	if (!inViewRange(cell, cam_position))
+		return LOD_NONE;
+
+	// Pixels per unit of height error at the cell's distance
+	float distance = boxDistance(cam_position, boundsMin(cell), boundsMax(cell));
+	float scale = lod_scale / max(distance, 1.0f);
+	float tolerance = lod_max_error;
+	float band = (float)Math::clamp(lod_hysteresis, 0.0, 0.9);
+
+	if (current != LOD_NONE && cell->lodError(current) * scale <= tolerance * (1.0f + band))
 	{
-		unloadVBO();
-		return;
+		// Current LOD is still good enough
+		for (uint8_t lod = NUM_LODS - 1; lod > current; lod--)
+			if (cell->lodError(lod) * scale <= tolerance * (1.0f - band))
+				return lod;
+
+		return current;
 	}
 
-	if (_vbo_vertices == 0 || _current_lod_level != lod_level)
+	for (uint8_t lod = NUM_LODS - 1; lod > 0; lod--)
+		if (cell->lodError(lod) * scale <= tolerance)
+			return lod;
+
+	return 0;
+}
+
+/* RenderCell::meshState
+ * Returns the state a mesh of [cell] at [lod_level] would currently
+ * be built against
+ *******************************************************************/
+mesh_state_t RenderCell::meshState(Zone& zone, Cell* cell, uint8_t lod_level, const uint8_t* neighbour_lods)
+{
+	mesh_state_t state;
+	state.lod_level = lod_level;
+	state.compact = mesh_compact_vertices && CellMesh::canPack(zone);
+	state.revision = cell->revision();
+	for (unsigned a = 0; a < 4; a++)
 	{
-		generateVBO(lod_level);
-		_current_lod_level = lod_level;
+		state.neighbour_lods[a] = neighbour_lods[a];
+		Cell* neighbour = neighbourCell(zone, cell, a);
+		state.neighbour_revisions[a] = neighbour ? neighbour->revision() : 0;
 	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, _vbo_vertices);
-	glVertexPointer(3, GL_FLOAT, 24, 0);
-	glColorPointer(3, GL_FLOAT, 24, ((char*)nullptr + 12));
+	return state;
+}
 
-	glDrawArrays(GL_QUADS, 0, _n_quads*4);
+/* RenderCell::addDraws
+ * Adds the cell's mesh to [batches]. Full vertices all go in the
+ * first batch, packed vertices are batched by palette colour
+ *******************************************************************/
+void RenderCell::addDraws(vector<draw_batch_t>& batches)
+{
+	if (_current == LOD_NONE)
+		return;
 
-	//glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _vbo_indices);
-	//glIndexPointer(GL_UNSIGNED_SHORT, 0, 0);
+	const cell_mesh_t& cm = _meshes[_current];
+	if (cm.index_block == ARENA_NONE)
+		return;
 
-	//glDrawElements(GL_QUADS, 32*32*4, GL_UNSIGNED_SHORT, 0);
+	unsigned vertex_size = cm.state.compact ? sizeof(OpenGL::packed_vertex_t) : sizeof(OpenGL::vertex_t);
+	int base_vertex = vertex_arena->offset(cm.vertex_block) / vertex_size;
+	char* index_offset = (char*)nullptr + index_arena->offset(cm.index_block);
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	if (!cm.state.compact)
+	{
+		if (batches.empty())
+			batches.resize(1);
+		batches[0].compact = false;
+		batches[0].counts.push_back(cm.n_indices);
+		batches[0].index_offsets.push_back(index_offset);
+		batches[0].base_vertices.push_back(base_vertex);
+		return;
+	}
+
+	for (unsigned a = 0; a < NUM_FACE_TYPES; a++)
+	{
+		if (cm.group_indices[a] > 0)
+		{
+			// Palettes only vary by LOD level and face type
+			unsigned index = 1 + _current * NUM_FACE_TYPES + a;
+			if (batches.size() <= index)
+				batches.resize(index + 1);
+
+			draw_batch_t& batch = batches[index];
+			batch.compact = true;
+			batch.colour = cm.palette[a];
+			batch.counts.push_back(cm.group_indices[a]);
+			batch.index_offsets.push_back(index_offset);
+			batch.base_vertices.push_back(base_vertex);
+		}
+
+		index_offset += cm.group_indices[a] * sizeof(uint16_t);
+	}
 }
 
 
 StandardRenderer::StandardRenderer()
 {
+	_lod_scale = 1.0f;
+	_super_level = 0;
 }
 
 StandardRenderer::~StandardRenderer()
 {
+	// Finish any meshes being built and throw them away
+	delete mesh_pool;
+	mesh_pool = nullptr;
+	mesh_results.popAll(_mesh_uploads);
+	for (unsigned a = 0; a < _mesh_uploads.size(); a++)
+		deleteJob(_mesh_uploads[a]);
+	_mesh_uploads.clear();
+
+	// Unloads every cached mesh, so the render cells have nothing left
+	// in the arenas or the cache when they're deleted
+	mesh_cache.clear();
+	for (unsigned a = 0; a < _render_cells.size(); a++)
+		delete _render_cells[a];
+	_render_cells.clear();
+	for (unsigned a = 0; a < _super_cells.size(); a++)
+	{
+		if (!_super_cells[a])
+			continue;
+		for (unsigned m = 0; m < _super_cells[a]->member_meshes.size(); m++)
+			delete _super_cells[a]->member_meshes[m];
+		delete _super_cells[a]->render_cell;
+		delete _super_cells[a];
+	}
+	delete vertex_arena;
+	delete index_arena;
+	delete upload_ring;
+	vertex_arena = nullptr;
+	index_arena = nullptr;
+	upload_ring = nullptr;
 }
 
 bool StandardRenderer::init()
@@ -231,6 +415,30 @@ bool StandardRenderer::init()
 	//test_zone.fillWithRandomNoise();
 	test_zone.generateTestLandscape();
 
+	// Start mesh building threads, leaving one hardware thread for rendering
+	unsigned n_threads = mesh_threads;
+	if (mesh_threads <= 0)
+		n_threads = max(ThreadPool::hardwareThreads(), 2u) - 1;
+	mesh_pool = new ThreadPool(n_threads);
+
+	vertex_arena = new BufferArena(GL_ARRAY_BUFFER, VERTEX_ARENA_SIZE);
+	index_arena = new BufferArena(GL_ELEMENT_ARRAY_BUFFER, INDEX_ARENA_SIZE);
+	if (mesh_upload_ring)
+	{
+		upload_ring = new UploadRing(UPLOAD_RING_SIZE);
+		if (upload_ring->init())
+		{
+			vertex_arena->setUploadRing(upload_ring);
+			index_arena->setUploadRing(upload_ring);
+		}
+		else
+		{
+			logMessage(1, "Buffer copies not supported, uploading meshes directly");
+			delete upload_ring;
+			upload_ring = nullptr;
+		}
+	}
+
 	// Setup lighting
 	float light_pos[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
 	float light_ambient[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
@@ -252,6 +460,8 @@ bool StandardRenderer::init()
 
 void StandardRenderer::renderScene(int width, int height)
 {
+	PROF_SCOPE("StandardRenderer::renderScene");
+
 	// Calculate aspect ratio
 	float aspect = ((float)width / (float)height);
 	float fovy = 2 * (float)Math::radToDeg(atan(tan(Math::degToRad(90) / 2) / aspect));
@@ -262,29 +472,30 @@ void StandardRenderer::renderScene(int width, int height)
 
 	gluPerspective(fovy, aspect, 0.5, max_view_distance * 1.3);
 
+	// Projected size of 1 unit at distance 1, in pixels
+	_lod_scale = (float)height / (2.0f * tanf((float)Math::degToRad(fovy) / 2.0f));
+
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
 
-	// Setup GL stuff
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_BACK);
-	glDepthMask(GL_TRUE);
-	glEnable(GL_ALPHA_TEST);
-	glAlphaFunc(GL_GREATER, 0.0f);
-
-	// Setup fog
-	GLfloat fogColor[4]={ col_sky.fr(), col_sky.fg(), col_sky.fb(), 1.0f };
-	glFogi(GL_FOG_MODE, GL_LINEAR);
-	glFogfv(GL_FOG_COLOR, fogColor);
-	//glFogf(GL_FOG_DENSITY, 0.1f);
-	glFogf(GL_FOG_START, max_view_distance * 0.4f);
-	glFogf(GL_FOG_END, max_view_distance * 0.8f);
-	//if (render_fog_quality)
-		glHint(GL_FOG_HINT, GL_NICEST);
-	//else
-	//	glHint(GL_FOG_HINT, GL_FASTEST);
-	glEnable(GL_FOG);
+	// Setup GL stuff, only what changed since last frame is set
+	gl_pass_state_t state;
+	state.depth_test = true;
+	state.cull_face = true;
+	state.cull_mode = GL_BACK;
+	GLState::apply(state);
+
+	gl_fixed_state_t fixed;
+	fixed.alpha_test = true;
+	fixed.alpha_func = GL_GREATER;
+	fixed.alpha_ref = 0.0f;
+	fixed.fog = true;
+	fixed.fog_colour = col_sky;
+	fixed.fog_start = max_view_distance * 0.4f;
+	fixed.fog_end = max_view_distance * 0.8f;
+	fixed.vertex_array = true;
+	fixed.colour_array = true;
+	GLState::applyFixed(fixed);
 
 	// Apply camera view
 	_camera.applyView();
@@ -293,6 +504,9 @@ void StandardRenderer::renderScene(int width, int height)
 	glClearColor(col_sky.fr(), col_sky.fg(), col_sky.fb(), 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
+	// Matrix setup, view and clear
+	GLState::countCalls(8);
+
 	// Test cell
 	//glEnable(GL_LIGHTING);
 	//glEnable(GL_LIGHT0);
@@ -300,45 +514,514 @@ void StandardRenderer::renderScene(int width, int height)
 
 	//renderCell(&test_cell);
 
-	frect_t cam_strafe;
-	cam_strafe.tl = fpoint2_t(_camera.getPosition().x, _camera.getPosition().y) + fpoint2_t(_camera.getStrafe().x, _camera.getStrafe().y);
-	cam_strafe.br = fpoint2_t(_camera.getPosition().x, _camera.getPosition().y) - fpoint2_t(_camera.getStrafe().x, _camera.getStrafe().y);
+	// Get the view frustum for culling
+	_frustum.extractFromGL();
+	GLState::countCalls(2);
+
+	if (_render_cells.size() != test_zone.numCells())
+		_render_cells.resize(test_zone.numCells(), nullptr);
+	if (test_zone_regenerated)
+	{
+		// Zone heights changed, none of the cached meshes are any use
+		mesh_cache.clear();
+		test_zone_regenerated = false;
+	}
+
+	// Far-field blocks are nodes at this level of the quadtree
+	unsigned super_level = (unsigned)Math::clamp(far_merge_level, 0, test_zone.numLevels() - 1);
+	if (super_level != _super_level)
+	{
+		clearSuperCells();
+		_super_level = super_level;
+	}
+	if (_super_cells.size() != test_zone.numNodes(_super_level))
+		_super_cells.resize(test_zone.numNodes(_super_level), nullptr);
+
+	// Upload meshes finished since last frame
+	mesh_cache.nextFrame();
+	uploadMeshes();
+	if (upload_ring)
+		upload_ring->endFrame();
+
+	// Walk the zone's quadtree from the root, collecting visible cells
+	// in zone storage (Morton) order, then draw them all together
+	stat_nodes_visited = 0;
+	stat_nodes_out_of_range = 0;
+	stat_nodes_culled = 0;
+	stat_cells_drawn = 0;
+	stat_super_cells_drawn = 0;
+	stat_super_cells_members = 0;
+	memset(stat_cells_lod, 0, sizeof(stat_cells_lod));
+	for (unsigned a = 0; a < _draw_batches.size(); a++)
+		_draw_batches[a].clear();
+	visitNode(test_zone.numLevels() - 1, 0, LOD_NONE, false);
+	drawBatches();
+
+	// Drop least recently drawn meshes if over budget. Anything drawn
+	// this frame stays, even if that alone is over
+	mesh_cache.evict((uint64_t)max((int)mesh_cache_mb, 0) * 1024 * 1024);
+}
+
+/* StandardRenderer::selectLod
+ * Returns the LOD the cell at [index] should be drawn at, or LOD_NONE
+ * if it is out of view distance (see RenderCell::selectLod). As the
+ * result is stable, neighbours can be checked whether they have been
+ * drawn this frame or not
+ *******************************************************************/
+uint8_t StandardRenderer::selectLod(unsigned index)
+{
+	RenderCell* rc = _render_cells[index];
+	return RenderCell::selectLod(test_zone.cellAt(index), _camera.getPosition(), _lod_scale, rc ? rc->lod() : LOD_NONE);
+}
+
+/* StandardRenderer::visitNode
+ * Draws the cells under quadtree node [index] at [level] (see Zone).
+ * Whole subtrees are skipped when they are out of view distance or
+ * outside the view frustum. [lod_level] is the LOD of every cell
+ * under the node if already known (only ever the coarsest, when the
+ * node's error is small enough), otherwise LOD_NONE. If [inside] is
+ * true the node is known to be inside the frustum
+ *******************************************************************/
+void StandardRenderer::visitNode(unsigned level, unsigned index, uint8_t lod_level, bool inside)
+{
+	// Nothing under the node is in the zone
+	float min_height = test_zone.nodeMinHeight(level, index);
+	float max_height = test_zone.nodeMaxHeight(level, index);
+	if (min_height > max_height)
+		return;
+
+	stat_nodes_visited++;
+	unsigned x, y;
+	Math::mortonDecode(index << (level * 2), x, y);
+	unsigned size = 1 << level;
+
+	// Cell meshes can have walls down to 0 so the box always includes
+	// it (see RenderCell::boundsMin)
+	fpoint3_t box_min(x * 32.0f, y * 32.0f, min(min_height, 0.0f));
+	fpoint3_t box_max((x + size) * 32.0f, (y + size) * 32.0f, max_height);
+	fpoint3_t cam = _camera.getPosition();
+
+	// Skip if the nearest cell centre is out of range
+	float x1 = x * 32.0f + 16.0f;
+	float y1 = y * 32.0f + 16.0f;
+	float x2 = x1 + (size - 1) * 32.0f;
+	float y2 = y1 + (size - 1) * 32.0f;
+	float near_x = cam.x < x1 ? x1 - cam.x : (cam.x > x2 ? cam.x - x2 : 0.0f);
+	float near_y = cam.y < y1 ? y1 - cam.y : (cam.y > y2 ? cam.y - y2 : 0.0f);
+	if (near_x * near_x + near_y * near_y >= max_view_distance * max_view_distance)
+	{
+		stat_nodes_out_of_range++;
+		return;
+	}
+
+	if (lod_level == LOD_NONE)
+	{
+		// If even the worst cell under the node is well within the error
+		// limit at the coarsest LOD, every cell will select it (see
+		// selectLod) so there's no need to check them individually
+		float scale = _lod_scale / max(boxDistance(cam, box_min, box_max), 1.0f);
+		float band = (float)Math::clamp(lod_hysteresis, 0.0, 0.9);
+		if (test_zone.nodeMaxError(level, index) * scale <= lod_max_error * (1.0f - band))
+			lod_level = NUM_LODS - 1;
+	}
+
+	// Frustum test
+	if (cull_frustum && !inside)
+	{
+		int result = _frustum.classifyBox(box_min, box_max);
+		if (result == FRUSTUM_OUTSIDE)
+		{
+			stat_nodes_culled++;
+			return;
+		}
+		inside = (result == FRUSTUM_INSIDE);
+	}
+
+	// Blocks of distant cells all at the coarsest LOD are drawn merged,
+	// as long as they are completely within view distance
+	if (level == _super_level && level > 0 && lod_level == NUM_LODS - 1)
+	{
+		float far_x = max(fabs(cam.x - x1), fabs(cam.x - x2));
+		float far_y = max(fabs(cam.y - y1), fabs(cam.y - y2));
+		if (far_x * far_x + far_y * far_y < max_view_distance * max_view_distance)
+		{
+			drawSuperCell(index);
+			return;
+		}
+	}
+
+	if (level == 0)
+		drawCell(index, lod_level);
+	else
+	{
+		for (unsigned a = 0; a < 4; a++)
+			visitNode(level - 1, index * 4 + a, lod_level, inside);
+	}
+}
+
+/* StandardRenderer::drawCell
+ * Draws the cell at [index] in the zone at [lod_level], queueing a
+ * new mesh for it if needed
+ *******************************************************************/
+void StandardRenderer::drawCell(unsigned index, uint8_t lod_level)
+{
+	if (lod_level == LOD_NONE)
+		lod_level = selectLod(index);
+
+	Cell* cell = test_zone.cellAt(index);
+	RenderCell* rc = _render_cells[index];
+	if (!rc)
+	{
+		rc = new RenderCell(cell);
+		_render_cells[index] = rc;
+	}
+	rc->setLod(lod_level);
+
+	// Neighbours may not have been visited (eg. if outside the frustum)
+	// so work out their LODs directly
+	uint8_t neighbour_lods[4];
+	for (unsigned side = 0; side < 4; side++)
+	{
+		Cell* neighbour = neighbourCell(test_zone, cell, side);
+		if (neighbour)
+			neighbour_lods[side] = selectLod(test_zone.cellIndex(neighbour->zoneX(), neighbour->zoneY()));
+		else
+			neighbour_lods[side] = LOD_NONE;
+	}
+
+	mesh_state_t state = RenderCell::meshState(test_zone, cell, lod_level, neighbour_lods);
+	if (rc->useMesh(state))
+		queueMesh(rc, index, state);
+	rc->addDraws(_draw_batches);
+	stat_cells_drawn++;
+	stat_cells_lod[lod_level]++;
+}
+
+/* StandardRenderer::drawBatches
+ * Draws everything collected in the draw batches. Each batch is one
+ * glMultiDrawElementsBaseVertex call where supported, otherwise each
+ * cell is drawn separately (but still without switching buffers)
+ *******************************************************************/
+void StandardRenderer::drawBatches()
+{
+	PROF_SCOPE("StandardRenderer::drawBatches");
+
+	bool multi_draw = render_multi_draw && (GLEW_VERSION_3_2 || GLEW_ARB_draw_elements_base_vertex);
+
+	GLState::bindBuffer(GL_ARRAY_BUFFER, vertex_arena->bufferId());
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_arena->bufferId());
+
+	stat_draw_calls = 0;
+	for (unsigned a = 0; a < _draw_batches.size(); a++)
+	{
+		draw_batch_t& batch = _draw_batches[a];
+		if (batch.counts.empty())
+			continue;
+
+		unsigned vertex_size;
+		if (batch.compact)
+		{
+			vertex_size = sizeof(OpenGL::packed_vertex_t);
+			GLState::clientState(GL_COLOR_ARRAY, false);
+			glColor4f(batch.colour.fr(), batch.colour.fg(), batch.colour.fb(), 1.0f);
+			glVertexPointer(3, GL_SHORT, vertex_size, 0);
+			GLState::countCalls(2);
+		}
+		else
+		{
+			vertex_size = sizeof(OpenGL::vertex_t);
+			GLState::clientState(GL_COLOR_ARRAY, true);
+			glVertexPointer(3, GL_FLOAT, vertex_size, 0);
+			glColorPointer(3, GL_FLOAT, vertex_size, ((char*)nullptr + 12));
+			GLState::countCalls(2);
+		}
+
+		if (multi_draw)
+		{
+			glMultiDrawElementsBaseVertex(GL_TRIANGLES, &batch.counts[0], GL_UNSIGNED_SHORT,
+				&batch.index_offsets[0], batch.counts.size(), &batch.base_vertices[0]);
+			GLState::countCalls();
+			stat_draw_calls++;
+			continue;
+		}
 
-	glEnableClientState(GL_VERTEX_ARRAY);
-	glEnableClientState(GL_COLOR_ARRAY);
-	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		// No base vertex support, point at each cell's vertices in turn
+		for (unsigned d = 0; d < batch.counts.size(); d++)
+		{
+			char* vertices = (char*)nullptr + batch.base_vertices[d] * vertex_size;
+			if (batch.compact)
+				glVertexPointer(3, GL_SHORT, vertex_size, vertices);
+			else
+			{
+				glVertexPointer(3, GL_FLOAT, vertex_size, vertices);
+				glColorPointer(3, GL_FLOAT, vertex_size, vertices + 12);
+				GLState::countCalls();
+			}
+			glDrawElements(GL_TRIANGLES, batch.counts[d], GL_UNSIGNED_SHORT, batch.index_offsets[d]);
+			GLState::countCalls(2);
+			stat_draw_calls++;
+		}
+	}
+}
 
-	for (unsigned x = 0; x < test_zone.getWidth(); x++)
+/* StandardRenderer::drawSuperCell
+ * Draws the far-field block at quadtree node [index] (at the super
+ * cell level) as one merged mesh, rebuilding the members that have
+ * changed. Until there is a merged mesh the members are drawn
+ * separately
+ *******************************************************************/
+void StandardRenderer::drawSuperCell(unsigned index)
+{
+	super_cell_t* sc = _super_cells[index];
+	if (!sc)
 	{
-		//glPushMatrix();
-		//glTranslatef((float)x * 32.0f, 0.0f, 0.0f);
-		for (unsigned y = 0; y < test_zone.getHeight(); y++)
+		sc = new super_cell_t;
+		sc->revision = 0;
+		sc->failed = false;
+		unsigned first = index << (_super_level * 2);
+		for (unsigned a = first; a < first + (1u << (_super_level * 2)) && a < test_zone.numCells(); a++)
 		{
-			//renderCell(test_cells[x * TEST_DIM + y]);
-			uint64_t index = x * test_zone.getHeight() + y;
+			Cell* cell = test_zone.cellAt(a);
+			if (test_zone.contains(cell->zoneX(), cell->zoneY()))
+				sc->members.push_back(a);
+		}
+		mesh_state_t blank;
+		memset(&blank, 0, sizeof(mesh_state_t));
+		sc->member_states.resize(sc->members.size(), blank);
+		sc->member_meshes.resize(sc->members.size(), nullptr);
+		sc->render_cell = new RenderCell(test_zone.cellAt(sc->members[0]));
+		_super_cells[index] = sc;
+	}
 
-			RenderCell* rc = _render_cells[index];
-			if (!rc)
+	RenderCell* rc = sc->render_cell;
+	if (!sc->failed && !rc->meshPending())
+	{
+		// Find members whose meshes are out of date. The merged mesh
+		// also needs redoing if it was evicted from the mesh cache
+		vector<unsigned> changed;
+		vector<mesh_state_t> states;
+		for (unsigned a = 0; a < sc->members.size(); a++)
+		{
+			mesh_state_t state = memberState(sc->members[a], index);
+			if (!sc->member_meshes[a] || !(state == sc->member_states[a]))
 			{
-				rc = new RenderCell(test_zone.getCell(x, y));
-				_render_cells[index] = rc;
+				changed.push_back(a);
+				states.push_back(state);
 			}
+		}
+
+		if (!changed.empty() || !rc->hasMesh(NUM_LODS - 1))
+			queueSuperMesh(sc, changed, states);
+	}
 
-			//glTranslatef(0.0f, 32.0f, 0.0f);
+	if (!sc->failed && rc->hasMesh(NUM_LODS - 1))
+	{
+		rc->touchMesh();
+		rc->addDraws(_draw_batches);
+		stat_super_cells_drawn++;
+		stat_super_cells_members += sc->members.size();
+	}
+	else
+	{
+		for (unsigned a = 0; a < sc->members.size(); a++)
+			drawCell(sc->members[a], NUM_LODS - 1);
+	}
+}
+
+/* StandardRenderer::memberState
+ * Returns the state of the coarsest LOD mesh of the cell at
+ * [cell_index], as a member of the super cell at [node_index]. Other
+ * members are known to be at the coarsest LOD too
+ *******************************************************************/
+mesh_state_t StandardRenderer::memberState(unsigned cell_index, unsigned node_index)
+{
+	Cell* cell = test_zone.cellAt(cell_index);
+	uint8_t neighbour_lods[4];
+	for (unsigned side = 0; side < 4; side++)
+	{
+		Cell* neighbour = neighbourCell(test_zone, cell, side);
+		if (!neighbour)
+		{
+			neighbour_lods[side] = LOD_NONE;
+			continue;
+		}
+
+		unsigned neighbour_index = test_zone.cellIndex(neighbour->zoneX(), neighbour->zoneY());
+		if (neighbour_index >> (_super_level * 2) == node_index)
+			neighbour_lods[side] = NUM_LODS - 1;
+		else
+			neighbour_lods[side] = selectLod(neighbour_index);
+	}
+
+	return RenderCell::meshState(test_zone, cell, NUM_LODS - 1, neighbour_lods);
+}
+
+/* StandardRenderer::queueSuperMesh
+ * Queues rebuilding [members] of [sc] against [states], and merging
+ * them with the rest into a new mesh, on the mesh threads
+ *******************************************************************/
+void StandardRenderer::queueSuperMesh(super_cell_t* sc, const vector<unsigned>& members, const vector<mesh_state_t>& states)
+{
+	mesh_job_t* job = new mesh_job_t;
+	job->render_cell = sc->render_cell;
+	job->cell_index = sc->members[0];
+	job->mesh = new CellMesh();
+	job->super_cell = sc;
+	job->members = members;
+	job->member_states = states;
+	job->merged = false;
+
+	// The merged mesh's state only needs to change when it is rebuilt
+	memset(&job->state, 0, sizeof(mesh_state_t));
+	job->state.lod_level = NUM_LODS - 1;
+	job->state.compact = mesh_compact_vertices && CellMesh::canPack(test_zone);
+	job->state.revision = ++sc->revision;
+
+	sc->render_cell->setMeshPending(true);
+	mesh_pool->addJob([job]()
+	{
+		// The render thread leaves the super cell's member meshes alone
+		// while this job is pending
+		super_cell_t* sc = job->super_cell;
+		vector<const CellMesh*> parts(sc->member_meshes.begin(), sc->member_meshes.end());
+		for (unsigned a = 0; a < job->members.size(); a++)
+		{
+			const mesh_state_t& state = job->member_states[a];
+			CellMesh* mesh = new CellMesh();
+			mesh->build(test_zone, test_zone.cellAt(sc->members[job->members[a]]), NUM_LODS - 1, state.neighbour_lods, state.compact);
+			job->member_meshes.push_back(mesh);
+			parts[job->members[a]] = mesh;
+		}
 
-			rc->render(_camera.getPosition());
+		job->merged = job->mesh->merge(parts);
+		mesh_results.push(job);
+	});
+}
+
+/* StandardRenderer::clearSuperCells
+ * Unloads and deletes all super cells, after waiting for any of their
+ * meshes still being built
+ *******************************************************************/
+void StandardRenderer::clearSuperCells()
+{
+	mesh_pool->wait();
+	mesh_results.popAll(_mesh_uploads);
+	for (unsigned a = 0; a < _mesh_uploads.size();)
+	{
+		if (_mesh_uploads[a]->super_cell)
+		{
+			deleteJob(_mesh_uploads[a]);
+			_mesh_uploads.erase(_mesh_uploads.begin() + a);
 		}
-		//glPopMatrix();
+		else
+			a++;
 	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	for (unsigned a = 0; a < _super_cells.size(); a++)
+	{
+		super_cell_t* sc = _super_cells[a];
+		if (!sc)
+			continue;
+
+		for (unsigned lod = 0; lod < NUM_LODS; lod++)
+			sc->render_cell->unloadMesh(lod);
+		for (unsigned m = 0; m < sc->member_meshes.size(); m++)
+			delete sc->member_meshes[m];
+		delete sc->render_cell;
+		delete sc;
+	}
+	_super_cells.clear();
+}
 
-	glDisableClientState(GL_VERTEX_ARRAY);
+/* StandardRenderer::finishMeshing
+ * Waits for the mesh threads to finish and throws away every mesh not
+ * yet uploaded. The cells they were for are no longer pending, so they
+ * are queued again (against the zone as it is then) when next drawn
+ *******************************************************************/
+void StandardRenderer::finishMeshing()
+{
+	if (!mesh_pool)
+		return;
 
-	glDisable(GL_LIGHTING);
-	glDisable(GL_LIGHT0);
-	glDisable(GL_COLOR_MATERIAL);
+	mesh_pool->wait();
+	mesh_results.popAll(_mesh_uploads);
+	for (unsigned a = 0; a < _mesh_uploads.size(); a++)
+	{
+		_mesh_uploads[a]->render_cell->setMeshPending(false);
+		deleteJob(_mesh_uploads[a]);
+	}
+	_mesh_uploads.clear();
+}
+
+/* StandardRenderer::queueMesh
+ * Queues building a mesh for [rc] (cell [index] in the zone) against
+ * [state] on the mesh threads
+ *******************************************************************/
+void StandardRenderer::queueMesh(RenderCell* rc, unsigned index, const mesh_state_t& state)
+{
+	mesh_job_t* job = new mesh_job_t;
+	job->render_cell = rc;
+	job->cell_index = index;
+	job->state = state;
+	job->mesh = new CellMesh();
+	job->super_cell = nullptr;
+	job->merged = false;
+
+	rc->setMeshPending(true);
+	mesh_pool->addJob([job]()
+	{
+		job->mesh->build(test_zone, job->render_cell->getCell(), job->state.lod_level, job->state.neighbour_lods, job->state.compact);
+		mesh_results.push(job);
+	});
+}
+
+/* StandardRenderer::uploadMeshes
+ * Uploads up to [mesh_uploads_per_frame] finished meshes to their
+ * cells, oldest first. Meshes for cells now out of view distance are
+ * discarded. Super cells also take their rebuilt member meshes
+ *******************************************************************/
+void StandardRenderer::uploadMeshes()
+{
+	PROF_SCOPE("StandardRenderer::uploadMeshes");
+
+	mesh_results.popAll(_mesh_uploads);
+
+	unsigned n_uploads = 0;
+	unsigned a = 0;
+	for (; a < _mesh_uploads.size(); a++)
+	{
+		if (mesh_uploads_per_frame > 0 && n_uploads >= (unsigned)mesh_uploads_per_frame)
+			break;
+
+		mesh_job_t* job = _mesh_uploads[a];
+		job->render_cell->setMeshPending(false);
+		if (job->super_cell)
+		{
+			super_cell_t* sc = job->super_cell;
+			for (unsigned m = 0; m < job->members.size(); m++)
+			{
+				delete sc->member_meshes[job->members[m]];
+				sc->member_meshes[job->members[m]] = job->member_meshes[m];
+				sc->member_states[job->members[m]] = job->member_states[m];
+			}
+			job->member_meshes.clear();
+
+			if (job->merged)
+				job->render_cell->uploadMesh(*job->mesh, job->state);
+			else
+				sc->failed = true;
+			n_uploads++;
+		}
+		else if (RenderCell::inViewRange(job->render_cell->getCell(), _camera.getPosition()))
+		{
+			job->render_cell->uploadMesh(*job->mesh, job->state);
+			n_uploads++;
+		}
+
+		deleteJob(job);
+	}
+
+	_mesh_uploads.erase(_mesh_uploads.begin(), _mesh_uploads.begin() + a);
 }
 
 void StandardRenderer::renderCell(Cell* cell)
@@ -423,3 +1106,138 @@ void StandardRenderer::renderBlock(float x, float y, float top, float bottom, rg
 
 	glEnd();
 }
+
+/* StandardRenderer::numCellsMeshed
+ * Returns the number of cell meshes uploaded since init (or the last
+ * mesh_stats reset)
+ *******************************************************************/
+unsigned StandardRenderer::numCellsMeshed()
+{
+	return stat_meshes_built;
+}
+
+/* StandardRenderer::numBytesUploaded
+ * Returns the amount of mesh data uploaded since init (or the last
+ * mesh_stats reset)
+ *******************************************************************/
+uint64_t StandardRenderer::numBytesUploaded()
+{
+	return stat_bytes_uploaded;
+}
+
+
+/*******************************************************************
+ * CONSOLE COMMANDS
+ *******************************************************************/
+
+/* mesh_stats
+ * Logs how many quads the greedy mesher has generated compared to a
+ * mesh with one quad per sample face, and how much vertex data was
+ * uploaded. 'reset' clears the counters
+ *******************************************************************/
+CONSOLE_COMMAND(mesh_stats, 0, true)
+{
+	if (args.size() > 0 && args[0] == "reset")
+	{
+		stat_meshes_built = 0;
+		stat_quads_naive = 0;
+		stat_quads_built = 0;
+		stat_vertices_built = 0;
+		stat_bytes_uploaded = 0;
+		return;
+	}
+
+	if (stat_meshes_built == 0)
+	{
+		Console::logMessage("No meshes built yet");
+		return;
+	}
+
+	Console::logMessage(S_FMT("%d meshes: %llu quads (%llu before merging, %1.2fx reduction)",
+		stat_meshes_built, stat_quads_built, stat_quads_naive,
+		stat_quads_built > 0 ? (double)stat_quads_naive / (double)stat_quads_built : 0.0));
+	Console::logMessage(S_FMT("%1.2f vertices per quad, %1.2fMB uploaded (%1.1f bytes per quad)",
+		stat_quads_built > 0 ? (double)stat_vertices_built / (double)stat_quads_built : 0.0,
+		(double)stat_bytes_uploaded / (1024.0 * 1024.0),
+		stat_quads_built > 0 ? (double)stat_bytes_uploaded / (double)stat_quads_built : 0.0));
+}
+
+/* cull_stats
+ * Logs how many cells were drawn last frame (and at which LODs), and
+ * how many quadtree nodes were visited to find them
+ *******************************************************************/
+CONSOLE_COMMAND(cull_stats, 0, true)
+{
+	Console::logMessage(S_FMT("%d cells drawn in %d draw calls", stat_cells_drawn, stat_draw_calls));
+	Console::logMessage(S_FMT("By LOD: %d / %d / %d / %d", stat_cells_lod[0], stat_cells_lod[1], stat_cells_lod[2], stat_cells_lod[3]));
+	Console::logMessage(S_FMT("%d far-field super cells drawn, covering %d cells", stat_super_cells_drawn, stat_super_cells_members));
+	Console::logMessage(S_FMT("%d quadtree nodes visited: %d out of range, %d outside frustum",
+		stat_nodes_visited, stat_nodes_out_of_range, stat_nodes_culled));
+}
+
+/* arena_stats
+ * Logs how full and how fragmented the vertex and index arenas are
+ *******************************************************************/
+CONSOLE_COMMAND(arena_stats, 0, true)
+{
+	BufferArena* arenas[2] = { vertex_arena, index_arena };
+	const char* names[2] = { "Vertex", "Index" };
+	for (unsigned a = 0; a < 2; a++)
+	{
+		BufferArena* arena = arenas[a];
+		if (!arena)
+			continue;
+
+		// Fragmentation is how much of the free space is unusable for
+		// an allocation as big as the largest free range
+		unsigned free_bytes = arena->capacity() - arena->usedBytes();
+		double fragmentation = free_bytes > 0 ? 1.0 - (double)arena->largestFreeRange() / (double)free_bytes : 0.0;
+		Console::logMessage(S_FMT("%s arena: %1.2fMB of %1.2fMB used (%1.1f%%) by %d allocations",
+			names[a], (double)arena->usedBytes() / (1024.0 * 1024.0), (double)arena->capacity() / (1024.0 * 1024.0),
+			arena->capacity() > 0 ? 100.0 * arena->usedBytes() / arena->capacity() : 0.0, arena->numAllocations()));
+		Console::logMessage(S_FMT("  %d free ranges, largest %1.2fMB, %1.1f%% fragmented, compacted %d times",
+			arena->numFreeRanges(), (double)arena->largestFreeRange() / (1024.0 * 1024.0),
+			100.0 * fragmentation, arena->numCompactions()));
+	}
+}
+
+/* upload_stats
+ * Logs how much mesh data went through the upload ring last frame,
+ * and how often writing to it had to wait for the GPU
+ *******************************************************************/
+CONSOLE_COMMAND(upload_stats, 0, true)
+{
+	if (!upload_ring)
+	{
+		Console::logMessage("Upload ring not in use, meshes are uploaded directly");
+		return;
+	}
+
+	Console::logMessage(S_FMT("Upload ring: %1.2fMB, %s", (double)upload_ring->size() / (1024.0 * 1024.0),
+		upload_ring->isPersistent() ? "persistently mapped" : "orphaned when full"));
+	Console::logMessage(S_FMT("  Last frame: %d uploads, %1.1fKB, %d stalls",
+		upload_ring->lastFrameUploads(), (double)upload_ring->lastFrameBytes() / 1024.0, upload_ring->lastFrameStalls()));
+	Console::logMessage(S_FMT("  Total: %1.2fMB, %d stalls, %d orphans, %d fences pending",
+		(double)upload_ring->totalBytes() / (1024.0 * 1024.0), upload_ring->numStalls(),
+		upload_ring->numOrphans(), upload_ring->numFences()));
+}
+
+/* mesh_cache_stats
+ * Logs how many cell meshes are resident and how well the mesh cache
+ * is doing. 'reset' clears the counters
+ *******************************************************************/
+CONSOLE_COMMAND(mesh_cache_stats, 0, true)
+{
+	if (args.size() > 0 && args[0] == "reset")
+	{
+		mesh_cache.resetStats();
+		return;
+	}
+
+	uint64_t requests = mesh_cache.hits() + mesh_cache.misses();
+	Console::logMessage(S_FMT("%d meshes resident, %1.2fMB of %dMB budget",
+		mesh_cache.numResident(), (double)mesh_cache.bytesResident() / (1024.0 * 1024.0), (int)mesh_cache_mb));
+	Console::logMessage(S_FMT("%llu hits, %llu misses (%1.1f%% hit rate), %llu evictions",
+		mesh_cache.hits(), mesh_cache.misses(), requests > 0 ? 100.0 * mesh_cache.hits() / requests : 0.0,
+		mesh_cache.evictions()));
+}
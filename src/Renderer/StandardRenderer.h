@@ -4,26 +4,128 @@
 
 #include "Renderer.h"
 #include "OpenGL.h"
-#include <unordered_map>
+#include "Frustum.h"
+#include "BufferArena.h"
+#include "MeshCache.h"
+#include "CellMesh.h"
 
 class Cell;
+class Zone;
+class ThreadPool;
+class RenderCell;
+struct super_cell_t;
+
+// Everything a cell's mesh depends on. If any of it changes the mesh
+// needs rebuilding
+struct mesh_state_t
+{
+	uint8_t		lod_level;
+	uint8_t		neighbour_lods[4];
+	bool		compact;					// Packed vertex format
+	unsigned	revision;					// Cell revision
+	unsigned	neighbour_revisions[4];		// Neighbour cell revisions
+
+	bool operator==(const mesh_state_t& rhs) const
+	{
+		if (lod_level != rhs.lod_level || compact != rhs.compact || revision != rhs.revision)
+			return false;
+		for (unsigned a = 0; a < 4; a++)
+			if (neighbour_lods[a] != rhs.neighbour_lods[a] || neighbour_revisions[a] != rhs.neighbour_revisions[a])
+				return false;
+		return true;
+	}
+};
+
+// A mesh built on a worker thread, waiting to be uploaded
+struct mesh_job_t
+{
+	RenderCell*		render_cell;
+	unsigned		cell_index;
+	mesh_state_t	state;
+	CellMesh*		mesh;
+
+	// Far-field super cells only, [mesh] is all the members merged
+	super_cell_t*			super_cell;
+	vector<unsigned>		members;		// Members rebuilt (indices into the super cell's lists)
+	vector<mesh_state_t>	member_states;
+	vector<CellMesh*>		member_meshes;
+	bool					merged;			// False if the members didn't fit in one mesh
+};
+
+// Cell draws collected while culling, to be drawn together with one
+// multi-draw call. Offsets are into the shared arena buffers
+struct draw_batch_t
+{
+	bool			compact;		// Packed vertices, drawn in [colour]
+	rgba_t			colour;
+	vector<int>		counts;			// Indices per draw
+	vector<void*>	index_offsets;	// Byte offset of each draw's first index
+	vector<int>		base_vertices;	// Added to each draw's indices
+
+	void clear()
+	{
+		counts.clear();
+		index_offsets.clear();
+		base_vertices.clear();
+	}
+};
+
+// A cell mesh uploaded to the shared arenas
+struct cell_mesh_t
+{
+	unsigned				vertex_block;		// Vertex arena allocation (ARENA_NONE if not loaded)
+	unsigned				index_block;		// Index arena allocation
+	unsigned				n_indices;
+	unsigned				group_indices[NUM_FACE_TYPES];	// Triangle indices per face type (see CellMesh)
+	rgba_t					palette[NUM_FACE_TYPES];		// Colour per face type, for packed vertices
+	mesh_state_t			state;				// What the mesh was built against
+	MeshCache::entry_id_t	cache_entry;
+};
+
 class RenderCell
 {
 private:
 	Cell*				_cell;
-	unsigned			_vbo_vertices;
-	unsigned			_vbo_indices;
-	unsigned			_n_quads;
-	uint8_t				_current_lod_level;
-	OpenGL::vertex_t*	_vertices;
+	cell_mesh_t			_meshes[NUM_LODS];	// Cached mesh for each LOD
+	uint8_t				_current;		// LOD of the mesh being drawn (LOD_NONE if none)
+	uint8_t				_lod;			// LOD selected when last drawn (LOD_NONE if never)
+	bool				_mesh_pending;	// A mesh is being built on a worker thread
 
 public:
 	RenderCell(Cell* cell);
 	~RenderCell();
 
-	void		generateVBO(uint8_t lod_level);
-	void		unloadVBO();
-	void		render(fpoint3_t cam_position);
+	Cell*		getCell() { return _cell; }
+	bool		meshPending() const { return _mesh_pending; }
+	bool		hasMesh(uint8_t lod_level) const { return _meshes[lod_level].vertex_block != ARENA_NONE; }
+	uint8_t		lod() const { return _lod; }
+	void		setLod(uint8_t lod_level) { _lod = lod_level; }
+
+	void		uploadMesh(const CellMesh& mesh, const mesh_state_t& state);
+	void		unloadMesh(uint8_t lod_level);
+	bool		useMesh(const mesh_state_t& state);
+	void		setMeshPending(bool pending) { _mesh_pending = pending; }
+	void		touchMesh();
+	void		addDraws(vector<draw_batch_t>& batches);
+
+	static bool			inViewRange(Cell* cell, fpoint3_t cam_position);
+	static fpoint3_t	boundsMin(Cell* cell);
+	static fpoint3_t	boundsMax(Cell* cell);
+	static uint8_t		selectLod(Cell* cell, fpoint3_t cam_position, float lod_scale, uint8_t current);
+	static mesh_state_t	meshState(Zone& zone, Cell* cell, uint8_t lod_level, const uint8_t* neighbour_lods);
+};
+
+// A block of distant cells drawn as one mesh, merged from each
+// member's coarsest LOD mesh. Member meshes are kept so only those
+// that change need rebuilding
+struct super_cell_t
+{
+	RenderCell*				render_cell;	// Holds the merged mesh
+	unsigned				revision;		// Incremented each time the merged mesh is rebuilt
+	bool					failed;			// Too big to merge, draw the members separately
+	vector<unsigned>		members;		// Zone indices of the cells in the block
+	vector<mesh_state_t>	member_states;	// What each member mesh was built against
+	vector<CellMesh*>		member_meshes;
 };
 
 class StandardRenderer : public Renderer
@@ -36,9 +138,29 @@ public:
 	void	renderScene(int width, int height);
 	void	renderCell(Cell* cell);
 	void	renderBlock(float x, float y, float top, float bottom, rgba_t colour, float size = 1.0f);
+	void	finishMeshing();
+	unsigned	numCellsMeshed();
+	uint64_t	numBytesUploaded();
 
 private:
-	std::unordered_map<uint64_t, RenderCell*> _render_cells;
+	vector<RenderCell*>	_render_cells;	// Indexed the same as the zone's cells
+	vector<mesh_job_t*>	_mesh_uploads;	// Finished meshes waiting for upload, oldest first
+	vector<draw_batch_t>	_draw_batches;	// This frame's visible cells, by vertex format and colour
+	Frustum				_frustum;
+	float				_lod_scale;		// Pixels per world unit at distance 1, for LOD selection
+	vector<super_cell_t*>	_super_cells;	// Indexed by quadtree node at _super_level
+	unsigned			_super_level;
+
+	uint8_t	selectLod(unsigned index);
+	void	visitNode(unsigned level, unsigned index, uint8_t lod_level, bool inside);
+	void	drawCell(unsigned index, uint8_t lod_level);
+	void	drawSuperCell(unsigned index);
+	mesh_state_t	memberState(unsigned cell_index, unsigned node_index);
+	void	queueSuperMesh(super_cell_t* sc, const vector<unsigned>& members, const vector<mesh_state_t>& states);
+	void	clearSuperCells();
+	void	drawBatches();
+	void	queueMesh(RenderCell* rc, unsigned index, const mesh_state_t& state);
+	void	uploadMeshes();
 };
 
 #endif//__STANDARD_RENDERER_H__
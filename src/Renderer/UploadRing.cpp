@@ -0,0 +1,266 @@
+
+#include "Main.h"
+#include "glew/glew.h"
+#include "UploadRing.h"
+#include "GLState.h"
+#include <cstring>
+
+// GL_ARB_buffer_storage (GL 4.4) is newer than the bundled GLEW, so
+// glBufferStorage is looked up by hand
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT	0x0040
+#define GL_MAP_COHERENT_BIT		0x0080
+#endif
+typedef void (GLAPIENTRY * buffer_storage_fn_t)(GLenum target, GLsizeiptr size, const GLvoid* data, GLbitfield flags);
+
+#ifdef _WIN32
+#define getGLProc(name) wglGetProcAddress(name)
+#else
+extern "C" void (*glXGetProcAddressARB(const GLubyte* name))(void);
+#define getGLProc(name) glXGetProcAddressARB((const GLubyte*)name)
+#endif
+
+// Uploads start at a multiple of this in the ring
+#define UPLOAD_ALIGN	16
+
+// Returns true if the GL implementation reports extension [name]
+static bool extensionSupported(const char* name)
+{
+	if (GLEW_VERSION_3_0)
+	{
+		GLint n_extensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &n_extensions);
+		for (GLint a = 0; a < n_extensions; a++)
+		{
+			const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, a);
+			if (extension && strcmp(extension, name) == 0)
+				return true;
+		}
+
+		return false;
+	}
+
+	const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+	return extensions && strstr(extensions, name);
+}
+
+UploadRing::UploadRing(unsigned size)
+{
+	_buffer = 0;
+	_size = size;
+	_mapped = nullptr;
+	_head = 0;
+	_region_start = 0;
+	_frame_bytes = 0;
+	_frame_uploads = 0;
+	_frame_stalls = 0;
+	_last_bytes = 0;
+	_last_uploads = 0;
+	_last_stalls = 0;
+	_total_bytes = 0;
+	_n_stalls = 0;
+	_n_orphans = 0;
+}
+
+UploadRing::~UploadRing()
+{
+	for (unsigned a = 0; a < _fences.size(); a++)
+		glDeleteSync(_fences[a].sync);
+
+	if (_buffer != 0)
+	{
+		if (_mapped)
+		{
+			GLState::bindBuffer(GL_COPY_READ_BUFFER, _buffer);
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+		}
+		glDeleteBuffers(1, &_buffer);
+		GLState::bufferDeleted(_buffer);
+	}
+}
+
+/* UploadRing::init
+ * Creates the ring buffer, mapping it persistently if possible.
+ * Returns false if buffer copies aren't supported, in which case
+ * uploads have to go straight to their destination
+ *******************************************************************/
+bool UploadRing::init()
+{
+	if (!(GLEW_VERSION_3_1 || GLEW_ARB_copy_buffer) || !(GLEW_VERSION_3_0 || GLEW_ARB_map_buffer_range))
+		return false;
+
+	glGenBuffers(1, &_buffer);
+	GLState::bindBuffer(GL_COPY_READ_BUFFER, _buffer);
+
+	// Persistent mapping needs fences to know when the GPU is done
+	// with each part of the ring
+	buffer_storage_fn_t buffer_storage = nullptr;
+	if ((GLEW_VERSION_3_2 || GLEW_ARB_sync) && extensionSupported("GL_ARB_buffer_storage"))
+		buffer_storage = (buffer_storage_fn_t)getGLProc("glBufferStorage");
+
+	if (buffer_storage)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		buffer_storage(GL_COPY_READ_BUFFER, _size, nullptr, flags);
+		_mapped = (uint8_t*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, _size, flags);
+		GLState::countCalls(2);
+
+		// Buffer storage is immutable, so start again with a normal
+		// buffer if the mapping failed
+		if (!_mapped)
+		{
+			glDeleteBuffers(1, &_buffer);
+			GLState::bufferDeleted(_buffer);
+			glGenBuffers(1, &_buffer);
+			GLState::bindBuffer(GL_COPY_READ_BUFFER, _buffer);
+		}
+	}
+
+	if (!_mapped)
+	{
+		glBufferData(GL_COPY_READ_BUFFER, _size, nullptr, GL_STREAM_DRAW);
+		GLState::countCalls();
+	}
+
+	return true;
+}
+
+/* UploadRing::fenceRegion
+ * Places a fence after the copies for everything written since the
+ * last fence
+ *******************************************************************/
+void UploadRing::fenceRegion()
+{
+	if (_head == _region_start)
+		return;
+
+	fence_t fence = { glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), _region_start, _head };
+	_fences.push_back(fence);
+	_region_start = _head;
+	GLState::countCalls();
+}
+
+/* UploadRing::waitForRange
+ * Waits until the GPU has finished copying everything that was written
+ * to [start]-[end] before. Fences complete in order, so waiting on the
+ * newest overlapping one is enough
+ *******************************************************************/
+void UploadRing::waitForRange(unsigned start, unsigned end)
+{
+	int newest = -1;
+	for (unsigned a = 0; a < _fences.size(); a++)
+		if (_fences[a].start < end && _fences[a].end > start)
+			newest = a;
+
+	if (newest < 0)
+		return;
+
+	GLsync sync = _fences[newest].sync;
+	GLenum result = glClientWaitSync(sync, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		// The GPU is behind, this is a stall
+		_frame_stalls++;
+		_n_stalls++;
+		while (result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+	}
+
+	for (int a = 0; a <= newest; a++)
+		glDeleteSync(_fences[a].sync);
+	_fences.erase(_fences.begin(), _fences.begin() + newest + 1);
+}
+
+/* UploadRing::reserve
+ * Returns the offset of [size] bytes in the ring that are safe to
+ * write to, wrapping (persistent) or orphaning the buffer if the end
+ * has been reached. The ring must be bound to GL_COPY_READ_BUFFER
+ *******************************************************************/
+unsigned UploadRing::reserve(unsigned size)
+{
+	unsigned start = ((_head + UPLOAD_ALIGN - 1) / UPLOAD_ALIGN) * UPLOAD_ALIGN;
+	if (start + size > _size)
+	{
+		if (_mapped)
+		{
+			fenceRegion();
+			_region_start = 0;
+		}
+		else
+		{
+			// Orphaning gives a fresh buffer while the GPU finishes
+			// with the old one
+			glBufferData(GL_COPY_READ_BUFFER, _size, nullptr, GL_STREAM_DRAW);
+			GLState::countCalls();
+			_n_orphans++;
+		}
+		start = 0;
+	}
+
+	if (_mapped)
+		waitForRange(start, start + size);
+
+	_head = start + size;
+	return start;
+}
+
+/* UploadRing::upload
+ * Writes [size] bytes of [data] to the ring and copies them to
+ * [dest_offset] in buffer [dest]. Returns false if the ring can't be
+ * used for this, and the data must be uploaded some other way
+ *******************************************************************/
+bool UploadRing::upload(GLuint dest, unsigned dest_offset, const void* data, unsigned size)
+{
+	if (_buffer == 0 || size > _size)
+		return false;
+
+	GLState::bindBuffer(GL_COPY_READ_BUFFER, _buffer);
+	unsigned offset = reserve(size);
+	if (_mapped)
+		memcpy(_mapped + offset, data, size);
+	else
+	{
+		// Nothing written since the last orphan is in use, so there's
+		// no need for the driver to synchronise
+		void* ptr = glMapBufferRange(GL_COPY_READ_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		GLState::countCalls();
+		if (!ptr)
+			return false;
+		memcpy(ptr, data, size);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		GLState::countCalls();
+	}
+
+	GLState::bindBuffer(GL_COPY_WRITE_BUFFER, dest);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, dest_offset, size);
+	GLState::countCalls();
+
+	_frame_bytes += size;
+	_frame_uploads++;
+	_total_bytes += size;
+	return true;
+}
+
+/* UploadRing::endFrame
+ * Fences the frame's uploads, forgets fences the GPU has passed and
+ * ends the frame's stats
+ *******************************************************************/
+void UploadRing::endFrame()
+{
+	if (_mapped)
+	{
+		fenceRegion();
+		while (!_fences.empty() && glClientWaitSync(_fences[0].sync, 0, 0) != GL_TIMEOUT_EXPIRED)
+		{
+			glDeleteSync(_fences[0].sync);
+			_fences.erase(_fences.begin());
+		}
+	}
+
+	_last_bytes = _frame_bytes;
+	_last_uploads = _frame_uploads;
+	_last_stalls = _frame_stalls;
+	_frame_bytes = 0;
+	_frame_uploads = 0;
+	_frame_stalls = 0;
+}
@@ -0,0 +1,64 @@
+
+#ifndef __UPLOAD_RING_H__
+#define __UPLOAD_RING_H__
+
+// Staging buffer that mesh data is streamed through on its way to the
+// arenas. Data is written into mapped memory and then copied to its
+// destination on the GPU, so the driver never has to take its own copy
+// or wait for the destination buffer to be idle. The ring is mapped
+// persistently if GL_ARB_buffer_storage is available, with fences
+// keeping writes off data the GPU hasn't copied yet. Otherwise it is
+// orphaned each time it fills up
+class UploadRing
+{
+private:
+	struct fence_t
+	{
+		GLsync		sync;
+		unsigned	start;
+		unsigned	end;
+	};
+
+	GLuint				_buffer;
+	unsigned			_size;
+	uint8_t*			_mapped;		// Persistent mapping, if any
+	unsigned			_head;			// Next write offset
+	unsigned			_region_start;	// Start of the writes not fenced yet
+	vector<fence_t>		_fences;		// Oldest first
+
+	// Stats
+	unsigned	_frame_bytes;
+	unsigned	_frame_uploads;
+	unsigned	_frame_stalls;
+	unsigned	_last_bytes;
+	unsigned	_last_uploads;
+	unsigned	_last_stalls;
+	uint64_t	_total_bytes;
+	unsigned	_n_stalls;
+	unsigned	_n_orphans;
+
+	unsigned	reserve(unsigned size);
+	void		fenceRegion();
+	void		waitForRange(unsigned start, unsigned end);
+
+public:
+	UploadRing(unsigned size);
+	~UploadRing();
+
+	bool	init();
+	bool	upload(GLuint dest, unsigned dest_offset, const void* data, unsigned size);
+	void	endFrame();
+
+	// Stats
+	bool		isPersistent() const { return _mapped != nullptr; }
+	unsigned	size() const { return _size; }
+	unsigned	lastFrameBytes() const { return _last_bytes; }
+	unsigned	lastFrameUploads() const { return _last_uploads; }
+	unsigned	lastFrameStalls() const { return _last_stalls; }
+	uint64_t	totalBytes() const { return _total_bytes; }
+	unsigned	numStalls() const { return _n_stalls; }
+	unsigned	numOrphans() const { return _n_orphans; }
+	unsigned	numFences() const { return _fences.size(); }
+};
+
+#endif//__UPLOAD_RING_H__
@@ -0,0 +1,71 @@
+
+#ifndef __LOCK_FREE_QUEUE_H__
+#define __LOCK_FREE_QUEUE_H__
+
+#include <atomic>
+
+// A lock-free multiple producer, single consumer queue. Any thread can
+// push, but only one thread may take items off with popAll
+template<class T> class LockFreeQueue
+{
+private:
+	struct node_t
+	{
+		T		value;
+		node_t*	next;
+	};
+
+	std::atomic<node_t*>	_head;	// Most recently pushed item
+
+public:
+	LockFreeQueue() : _head(nullptr) {}
+	~LockFreeQueue()
+	{
+		node_t* node = _head.exchange(nullptr);
+		while (node)
+		{
+			node_t* next = node->next;
+			delete node;
+			node = next;
+		}
+	}
+
+	void push(const T& value)
+	{
+		node_t* node = new node_t;
+		node->value = value;
+		node->next = _head.load(std::memory_order_relaxed);
+		while (!_head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {}
+	}
+
+	// Appends everything pushed so far to [out], oldest first. Returns
+	// the number of items added
+	unsigned popAll(vector<T>& out)
+	{
+		node_t* node = _head.exchange(nullptr, std::memory_order_acquire);
+
+		// The list is newest first, reverse it
+		node_t* prev = nullptr;
+		while (node)
+		{
+			node_t* next = node->next;
+			node->next = prev;
+			prev = node;
+			node = next;
+		}
+
+		unsigned count = 0;
+		while (prev)
+		{
+			node_t* next = prev->next;
+			out.push_back(prev->value);
+			delete prev;
+			prev = next;
+			count++;
+		}
+
+		return count;
+	}
+};
+
+#endif//__LOCK_FREE_QUEUE_H__
@@ -135,3 +135,49 @@ double Math::radToDeg(double angle)
 {
 	return angle * RAD_TO_DEG;
 }
+
+/* Math::mortonEncode
+ * Interleaves the bits of [x] and [y] into a Morton (Z-order) code,
+ * with [x] in the even bits and [y] in the odd bits. Only 16 bits of
+ * each fit, so both must be under 65536
+ *******************************************************************/
+uint32_t Math::mortonEncode(uint16_t x, uint16_t y)
+{
+	uint32_t mx = x;
+	uint32_t my = y;
+
+	// Spread the bits of each coordinate out so there is a 0 between each
+	mx = (mx | (mx << 8)) & 0x00FF00FF;
+	mx = (mx | (mx << 4)) & 0x0F0F0F0F;
+	mx = (mx | (mx << 2)) & 0x33333333;
+	mx = (mx | (mx << 1)) & 0x55555555;
+	my = (my | (my << 8)) & 0x00FF00FF;
+	my = (my | (my << 4)) & 0x0F0F0F0F;
+	my = (my | (my << 2)) & 0x33333333;
+	my = (my | (my << 1)) & 0x55555555;
+
+	return mx | (my << 1);
+}
+
+/* Math::mortonDecode
+ * Splits the Morton (Z-order) [code] back into its [x] and [y]
+ * coordinates
+ *******************************************************************/
+void Math::mortonDecode(uint32_t code, unsigned& x, unsigned& y)
+{
+	uint32_t mx = code & 0x55555555;
+	uint32_t my = (code >> 1) & 0x55555555;
+
+	// Compact every other bit back together
+	mx = (mx | (mx >> 1)) & 0x33333333;
+	mx = (mx | (mx >> 2)) & 0x0F0F0F0F;
+	mx = (mx | (mx >> 4)) & 0x00FF00FF;
+	mx = (mx | (mx >> 8)) & 0x0000FFFF;
+	my = (my | (my >> 1)) & 0x33333333;
+	my = (my | (my >> 2)) & 0x0F0F0F0F;
+	my = (my | (my >> 4)) & 0x00FF00FF;
+	my = (my | (my >> 8)) & 0x0000FFFF;
+
+	x = mx;
+	y = my;
+}
@@ -19,6 +19,8 @@ namespace Math
 	fpoint3_t	rotateVector3D(fpoint3_t vector, fpoint3_t axis, double angle);
 	double		degToRad(double angle);
 	double		radToDeg(double angle);
+	uint32_t	mortonEncode(uint16_t x, uint16_t y);
+	void		mortonDecode(uint32_t code, unsigned& x, unsigned& y);
 }
 
 #endif//__MATH_H__
@@ -0,0 +1,690 @@
+/*******************************************************************
+ * Voxigine - A simple voxel engine
+ * Copyright(C) 2014 Simon Judd
+ *
+ * Email:       sirjuddington@gmail.com
+ * Web:         https://github.com/sirjuddington/Voxigine
+ * Filename:    Profiler.cpp
+ * Description: Scoped frame profiler. Scopes are recorded into a
+ *              ring buffer per thread and collected into a tree of
+ *              per-frame timings by the main thread, and optionally
+ *              into a Chrome trace (chrome://tracing or Perfetto)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************/
+
+
+/*******************************************************************
+ * INCLUDES
+ *******************************************************************/
+#include "Main.h"
+#include "Profiler.h"
+#include "Console.h"
+#include "Utilities/Math.h"
+#include <mutex>
+#include <algorithm>
+#include <cstring>
+#ifndef _WIN32
+#include <chrono>
+#endif
+
+
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+CVAR(Bool, prof_enabled, false, CVAR_SAVE)
+CVAR(Int, prof_frames, 300, CVAR_SAVE)
+
+// VS2013 has no thread_local
+#ifdef _MSC_VER
+#define PROF_THREAD_LOCAL __declspec(thread)
+#else
+#define PROF_THREAD_LOCAL __thread
+#endif
+
+// Events each thread can have waiting to be collected, a power of 2
+#define PROF_BUFFER_EVENTS	8192
+#define PROF_BUFFER_MASK	(PROF_BUFFER_EVENTS - 1)
+#define PROF_MAX_FRAMES		2000
+#define TRACE_FRAME			0xFFFFFFFF
+
+namespace Profiler
+{
+	// A scope starting (name set) or ending (name null)
+	struct event_t
+	{
+		const char*	name;
+		uint64_t	time;
+	};
+
+	struct open_scope_t
+	{
+		unsigned	node;
+		uint64_t	start;
+	};
+
+	// Events recorded by a single thread. Only the thread itself
+	// writes to it and only the main thread reads from it
+	struct thread_buffer_t
+	{
+		event_t					events[PROF_BUFFER_EVENTS];
+		std::atomic<unsigned>	write;
+		std::atomic<unsigned>	read;
+		std::atomic<unsigned>	dropped;
+		unsigned				reserved;	// Ends owed by open scopes, written by the owner only
+		string					name;
+
+		// Main thread only
+		unsigned				root;		// Tree node
+		vector<open_scope_t>	stack;		// Scopes begun but not ended yet
+	};
+
+	// A finished scope (or frame marker if [thread] is TRACE_FRAME)
+	// recorded for the trace
+	struct trace_event_t
+	{
+		const char*	name;
+		uint64_t	start;
+		uint64_t	end;
+		unsigned	thread;
+	};
+
+	// A scope at a particular place in the tree, with its inclusive
+	// time and call count for each of the last [prof_frames] frames
+	struct node_t
+	{
+		const char*			name;
+		int					parent;
+		vector<unsigned>	children;
+		uint64_t			frame_ticks;
+		unsigned			frame_calls;
+		vector<float>		history_ms;
+		vector<unsigned>	history_calls;
+	};
+
+	std::atomic<bool>			active(false);
+	bool						profiling = false;
+	std::mutex					buffers_mutex;
+	vector<thread_buffer_t*>	buffers;
+	vector<node_t>				nodes;
+	unsigned					history_size = 0;
+	unsigned					history_pos = 0;
+	unsigned					history_count = 0;
+
+	// Trace being recorded
+	bool					tracing = false;
+	unsigned				trace_frames = 0;	// Frames left to record, 0 = until stopped
+	unsigned				trace_frame = 0;
+	uint64_t				trace_start = 0;
+	vector<trace_event_t>	trace_events;
+
+	PROF_THREAD_LOCAL thread_buffer_t*	thread_buffer = nullptr;
+	PROF_THREAD_LOCAL const char*		thread_name = nullptr;
+
+	/* Profiler::addNode
+	 * Adds a node for scope [name] under [parent] (-1 for a thread
+	 * root) and returns its index
+	 *******************************************************************/
+	unsigned addNode(const char* name, int parent)
+	{
+		node_t node;
+		node.name = name;
+		node.parent = parent;
+		node.frame_ticks = 0;
+		node.frame_calls = 0;
+		node.history_ms.resize(history_size, 0.0f);
+		node.history_calls.resize(history_size, 0);
+		nodes.push_back(node);
+
+		unsigned index = nodes.size() - 1;
+		if (parent >= 0)
+			nodes[parent].children.push_back(index);
+		return index;
+	}
+
+	/* Profiler::childNode
+	 * Returns the child of [parent] for scope [name], adding it if it
+	 * doesn't exist yet
+	 *******************************************************************/
+	unsigned childNode(unsigned parent, const char* name)
+	{
+		for (unsigned a = 0; a < nodes[parent].children.size(); a++)
+		{
+			unsigned child = nodes[parent].children[a];
+			if (nodes[child].name == name || strcmp(nodes[child].name, name) == 0)
+				return child;
+		}
+
+		return addNode(name, parent);
+	}
+
+	/* Profiler::threadBuffer
+	 * Returns the calling thread's event buffer, creating it on first
+	 * use
+	 *******************************************************************/
+	thread_buffer_t* threadBuffer()
+	{
+		if (thread_buffer)
+			return thread_buffer;
+
+		thread_buffer_t* buffer = new thread_buffer_t();
+		buffer->write = 0;
+		buffer->read = 0;
+		buffer->dropped = 0;
+		buffer->reserved = 0;
+		buffer->root = 0xFFFFFFFF;
+
+		std::lock_guard<std::mutex> lock(buffers_mutex);
+		buffer->name = S_FMT("%s %d", thread_name ? thread_name : "Thread", buffers.size());
+		buffers.push_back(buffer);
+		thread_buffer = buffer;
+		return buffer;
+	}
+
+	/* Profiler::push
+	 * Adds [event] to [buffer]. Beginning a scope keeps space for its
+	 * end, so only begins can fail (if the buffer is full)
+	 *******************************************************************/
+	bool push(thread_buffer_t* buffer, const event_t& event)
+	{
+		unsigned write = buffer->write.load(std::memory_order_relaxed);
+		if (event.name)
+		{
+			unsigned used = write - buffer->read.load(std::memory_order_acquire);
+			if (PROF_BUFFER_EVENTS - used < buffer->reserved + 2)
+			{
+				buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			buffer->reserved++;
+		}
+		else
+			buffer->reserved--;
+
+		buffer->events[write & PROF_BUFFER_MASK] = event;
+		buffer->write.store(write + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* Profiler::collect
+	 * Adds all events waiting in [buffer] (thread [index]) to the tree,
+	 * and to the trace if one is being recorded
+	 *******************************************************************/
+	void collect(thread_buffer_t* buffer, unsigned index)
+	{
+		if (buffer->root == 0xFFFFFFFF)
+			buffer->root = addNode(buffer->name.c_str(), -1);
+
+		unsigned read = buffer->read.load(std::memory_order_relaxed);
+		unsigned write = buffer->write.load(std::memory_order_acquire);
+		for (; read != write; read++)
+		{
+			const event_t& event = buffer->events[read & PROF_BUFFER_MASK];
+			if (event.name)
+			{
+				unsigned parent = buffer->stack.empty() ? buffer->root : buffer->stack.back().node;
+				open_scope_t scope = { childNode(parent, event.name), event.time };
+				buffer->stack.push_back(scope);
+			}
+			else if (!buffer->stack.empty())
+			{
+				const open_scope_t& scope = buffer->stack.back();
+				node_t& node = nodes[scope.node];
+				node.frame_ticks += event.time - scope.start;
+				node.frame_calls++;
+				if (tracing && scope.start >= trace_start)
+				{
+					trace_event_t trace_event = { node.name, scope.start, event.time, index };
+					trace_events.push_back(trace_event);
+				}
+				buffer->stack.pop_back();
+			}
+		}
+		buffer->read.store(read, std::memory_order_release);
+	}
+
+	/* Profiler::setHistorySize
+	 * Sets the number of frames of history kept for each node, which
+	 * clears it
+	 *******************************************************************/
+	void setHistorySize(unsigned size)
+	{
+		history_size = size;
+		for (unsigned a = 0; a < nodes.size(); a++)
+		{
+			nodes[a].history_ms.assign(size, 0.0f);
+			nodes[a].history_calls.assign(size, 0);
+		}
+		history_pos = 0;
+		history_count = 0;
+	}
+
+	// Timing stats for a scope over the frames it ran in
+	struct stats_t
+	{
+		unsigned	frames;
+		double		min;
+		double		avg;
+		double		p99;
+		double		max;
+		double		calls;
+	};
+
+	/* Profiler::calcStats
+	 * Calculates stats from [samples] (ms per frame) and [calls] (per
+	 * frame), ignoring frames with no calls. Returns false if there
+	 * weren't any
+	 *******************************************************************/
+	bool calcStats(const vector<float>& samples, const vector<unsigned>& calls, stats_t& stats)
+	{
+		vector<float> ran;
+		unsigned total_calls = 0;
+		for (unsigned a = 0; a < history_count; a++)
+		{
+			if (calls[a] == 0)
+				continue;
+			ran.push_back(samples[a]);
+			total_calls += calls[a];
+		}
+		if (ran.empty())
+			return false;
+
+		std::sort(ran.begin(), ran.end());
+		double sum = 0;
+		for (unsigned a = 0; a < ran.size(); a++)
+			sum += ran[a];
+
+		stats.frames = ran.size();
+		stats.min = ran.front();
+		stats.max = ran.back();
+		stats.avg = sum / ran.size();
+		stats.p99 = ran[min((unsigned)ran.size() - 1, (unsigned)(ran.size() * 0.99))];
+		stats.calls = (double)total_calls / ran.size();
+		return true;
+	}
+
+	/* Profiler::dumpNode
+	 * Logs the stats for [index] and its children, indented by [depth]
+	 *******************************************************************/
+	void dumpNode(unsigned index, unsigned depth)
+	{
+		stats_t stats;
+		node_t& node = nodes[index];
+		if (!calcStats(node.history_ms, node.history_calls, stats))
+			return;
+
+		Console::logMessage(S_FMT("%s%s: avg %1.3f, min %1.3f, p99 %1.3f, max %1.3f (%1.1f calls, %d frames)",
+			string(depth * 2, ' ').c_str(), node.name, stats.avg, stats.min, stats.p99, stats.max, stats.calls, stats.frames));
+
+		for (unsigned a = 0; a < node.children.size(); a++)
+			dumpNode(node.children[a], depth + 1);
+	}
+}
+
+
+/*******************************************************************
+ * PROFILER NAMESPACE FUNCTIONS
+ *******************************************************************/
+
+/* Profiler::now
+ * Returns the current time in profiler ticks
+ *******************************************************************/
+uint64_t Profiler::now()
+{
+#ifdef _WIN32
+	// VS2013's high_resolution_clock only has millisecond resolution
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/* Profiler::ticksToMs
+ * Converts [ticks] to milliseconds
+ *******************************************************************/
+double Profiler::ticksToMs(uint64_t ticks)
+{
+#ifdef _WIN32
+	static double ticks_per_ms = 0;
+	if (ticks_per_ms == 0)
+	{
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		ticks_per_ms = (double)frequency.QuadPart / 1000.0;
+	}
+	return (double)ticks / ticks_per_ms;
+#else
+	return (double)ticks / 1000000.0;
+#endif
+}
+
+/* Profiler::beginScope
+ * Records the start of scope [name] on the calling thread. Returns
+ * false if it couldn't be recorded, in which case endScope must not
+ * be called for it
+ *******************************************************************/
+bool Profiler::beginScope(const char* name)
+{
+	event_t event = { name, now() };
+	return push(threadBuffer(), event);
+}
+
+/* Profiler::endScope
+ * Records the end of the calling thread's innermost scope
+ *******************************************************************/
+void Profiler::endScope()
+{
+	event_t event = { nullptr, now() };
+	push(thread_buffer, event);
+}
+
+/* Profiler::setThreadName
+ * Sets the name the calling thread's scopes are grouped under. Must
+ * be called before the thread records anything
+ *******************************************************************/
+void Profiler::setThreadName(const char* name)
+{
+	thread_name = name;
+}
+
+/* Profiler::init
+ * Sets up the profiler, the calling thread is the main thread
+ *******************************************************************/
+void Profiler::init()
+{
+	setThreadName("Main");
+	setHistorySize((unsigned)Math::clamp(prof_frames, 10, PROF_MAX_FRAMES));
+	profiling = prof_enabled;
+	active = profiling;
+}
+
+/* Profiler::nextFrame
+ * Collects everything recorded since the last call and adds it to
+ * the history as one frame
+ *******************************************************************/
+void Profiler::nextFrame()
+{
+	bool was_profiling = profiling;
+	profiling = prof_enabled;
+	active = profiling || tracing;
+
+	unsigned size = (unsigned)Math::clamp(prof_frames, 10, PROF_MAX_FRAMES);
+	if (size != history_size)
+		setHistorySize(size);
+
+	// Always collect, so scopes still open when the profiler was
+	// turned off can end
+	{
+		std::lock_guard<std::mutex> lock(buffers_mutex);
+		for (unsigned a = 0; a < buffers.size(); a++)
+			collect(buffers[a], a);
+	}
+
+	if (tracing)
+	{
+		trace_event_t marker = { "Frame", now(), 0, TRACE_FRAME };
+		trace_events.push_back(marker);
+		trace_frame++;
+		if (trace_frame == trace_frames)
+			stopTrace();
+	}
+
+	if (!was_profiling)
+	{
+		// Only traced, don't add it to the history
+		for (unsigned a = 0; a < nodes.size(); a++)
+		{
+			nodes[a].frame_ticks = 0;
+			nodes[a].frame_calls = 0;
+		}
+		return;
+	}
+
+	// Thread roots take the total of their top-level scopes
+	for (unsigned a = 0; a < nodes.size(); a++)
+	{
+		if (nodes[a].parent >= 0)
+			continue;
+		nodes[a].frame_ticks = 0;
+		nodes[a].frame_calls = 0;
+		for (unsigned c = 0; c < nodes[a].children.size(); c++)
+		{
+			nodes[a].frame_ticks += nodes[nodes[a].children[c]].frame_ticks;
+			if (nodes[nodes[a].children[c]].frame_calls > 0)
+				nodes[a].frame_calls = 1;
+		}
+	}
+
+	for (unsigned a = 0; a < nodes.size(); a++)
+	{
+		nodes[a].history_ms[history_pos] = (float)ticksToMs(nodes[a].frame_ticks);
+		nodes[a].history_calls[history_pos] = nodes[a].frame_calls;
+		nodes[a].frame_ticks = 0;
+		nodes[a].frame_calls = 0;
+	}
+	history_pos = (history_pos + 1) % history_size;
+	history_count = min(history_count + 1, history_size);
+}
+
+/* Profiler::reset
+ * Clears the frame history
+ *******************************************************************/
+void Profiler::reset()
+{
+	setHistorySize(history_size);
+}
+
+/* Profiler::startTrace
+ * Starts recording a trace of every scope on every thread for the
+ * next [frames] frames (or until stopTrace if 0)
+ *******************************************************************/
+void Profiler::startTrace(unsigned frames)
+{
+	trace_events.clear();
+	trace_frames = frames;
+	trace_frame = 0;
+	trace_start = now();
+	tracing = true;
+	active = true;
+}
+
+/* Profiler::stopTrace
+ * Stops recording the trace and writes it to [filename] in Chrome's
+ * trace event format. Returns false if the file couldn't be written
+ *******************************************************************/
+bool Profiler::stopTrace(string filename)
+{
+	if (!tracing)
+		return false;
+
+	tracing = false;
+	active = profiling;
+
+	FILE* fp = fopen(CHR(filename), "wt");
+	if (!fp)
+	{
+		logMessage(1, "Unable to write trace to %s", CHR(filename));
+		return false;
+	}
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	// Thread names, in the order they were first seen
+	{
+		std::lock_guard<std::mutex> lock(buffers_mutex);
+		for (unsigned a = 0; a < buffers.size(); a++)
+		{
+			fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n", a, CHR(buffers[a]->name));
+			fprintf(fp, "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}},\n", a, a);
+		}
+	}
+
+	// Scopes as complete events and frames as global instant events,
+	// times in microseconds from the start of the trace
+	for (unsigned a = 0; a < trace_events.size(); a++)
+	{
+		const trace_event_t& event = trace_events[a];
+		double ts = ticksToMs(event.start - trace_start) * 1000.0;
+		if (event.thread == TRACE_FRAME)
+			fprintf(fp, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%1.3f,\"pid\":1,\"tid\":0},\n", event.name, ts);
+		else
+			fprintf(fp, "{\"name\":\"%s\",\"cat\":\"scope\",\"ph\":\"X\",\"ts\":%1.3f,\"dur\":%1.3f,\"pid\":1,\"tid\":%d},\n",
+				event.name, ts, ticksToMs(event.end - event.start) * 1000.0, event.thread);
+	}
+
+	// The process name last, as JSON doesn't allow a trailing comma
+	fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Voxigine\"}}\n]}\n");
+	fclose(fp);
+
+	logMessage(1, "Wrote %d trace events over %d frames to %s", (unsigned)trace_events.size(), trace_frame, CHR(filename));
+	trace_events.clear();
+	return true;
+}
+
+/* Profiler::isTracing
+ * Returns true if a trace is being recorded
+ *******************************************************************/
+bool Profiler::isTracing()
+{
+	return tracing;
+}
+
+
+/*******************************************************************
+ * CONSOLE COMMANDS
+ *******************************************************************/
+
+/* prof_dump
+ * Logs the scope tree with per-frame times (ms) over the recorded
+ * frames
+ *******************************************************************/
+CONSOLE_COMMAND(prof_dump, 0, true)
+{
+	if (Profiler::history_count == 0)
+	{
+		Console::logMessage("Nothing profiled yet (see prof_enabled)");
+		return;
+	}
+
+	Console::logMessage(S_FMT("Last %d frames, ms per frame:", Profiler::history_count));
+	for (unsigned a = 0; a < Profiler::nodes.size(); a++)
+		if (Profiler::nodes[a].parent < 0)
+			Profiler::dumpNode(a, 0);
+
+	std::lock_guard<std::mutex> lock(Profiler::buffers_mutex);
+	for (unsigned a = 0; a < Profiler::buffers.size(); a++)
+		if (Profiler::buffers[a]->dropped > 0)
+			Console::logMessage(S_FMT("%s: %d scopes dropped (buffer full)", Profiler::buffers[a]->name.c_str(), (unsigned)Profiler::buffers[a]->dropped));
+}
+
+/* prof_top
+ * Logs the scopes taking the most time per frame, not counting time
+ * in nested scopes. Scopes with the same name in different places are
+ * combined. The number to show can be given (default 10)
+ *******************************************************************/
+CONSOLE_COMMAND(prof_top, 0, true)
+{
+	using namespace Profiler;
+
+	if (history_count == 0)
+	{
+		Console::logMessage("Nothing profiled yet (see prof_enabled)");
+		return;
+	}
+
+	unsigned count = args.size() > 0 ? atoi(args[0].c_str()) : 10;
+
+	// Self time per frame, by scope name
+	vector<const char*> names;
+	vector<vector<float>> self_ms;
+	vector<vector<unsigned>> calls;
+	for (unsigned a = 0; a < nodes.size(); a++)
+	{
+		if (nodes[a].parent < 0)
+			continue;
+
+		unsigned index = 0;
+		while (index < names.size() && strcmp(names[index], nodes[a].name) != 0)
+			index++;
+		if (index == names.size())
+		{
+			names.push_back(nodes[a].name);
+			self_ms.push_back(vector<float>(history_size, 0.0f));
+			calls.push_back(vector<unsigned>(history_size, 0));
+		}
+
+		for (unsigned f = 0; f < history_count; f++)
+		{
+			float self = nodes[a].history_ms[f];
+			for (unsigned c = 0; c < nodes[a].children.size(); c++)
+				self -= nodes[nodes[a].children[c]].history_ms[f];
+			self_ms[index][f] += self;
+			calls[index][f] += nodes[a].history_calls[f];
+		}
+	}
+
+	vector<stats_t> stats(names.size());
+	vector<unsigned> order;
+	for (unsigned a = 0; a < names.size(); a++)
+		if (calcStats(self_ms[a], calls[a], stats[a]))
+			order.push_back(a);
+	std::sort(order.begin(), order.end(), [&stats](unsigned l, unsigned r) { return stats[l].avg > stats[r].avg; });
+
+	Console::logMessage(S_FMT("Top scopes by self time over the last %d frames, ms per frame:", history_count));
+	for (unsigned a = 0; a < order.size() && a < count; a++)
+	{
+		const stats_t& s = stats[order[a]];
+		Console::logMessage(S_FMT("%s: avg %1.3f, min %1.3f, p99 %1.3f, max %1.3f (%1.1f calls, %d frames)",
+			names[order[a]], s.avg, s.min, s.p99, s.max, s.calls, s.frames));
+	}
+}
+
+/* prof_reset
+ * Clears the profiler's frame history
+ *******************************************************************/
+CONSOLE_COMMAND(prof_reset, 0, true)
+{
+	Profiler::reset();
+}
+
+/* trace_start
+ * Records a trace of the next [frames] frames (default 60, 0 to keep
+ * going until trace_stop), then writes it to trace.json
+ *******************************************************************/
+CONSOLE_COMMAND(trace_start, 0, true)
+{
+	unsigned frames = args.size() > 0 ? atoi(args[0].c_str()) : 60;
+	Profiler::startTrace(frames);
+	if (frames > 0)
+		Console::logMessage(S_FMT("Tracing the next %d frames", frames));
+	else
+		Console::logMessage("Tracing until trace_stop");
+}
+
+/* trace_stop
+ * Stops recording the trace and writes it to trace.json (or the given
+ * filename)
+ *******************************************************************/
+CONSOLE_COMMAND(trace_stop, 0, true)
+{
+	if (!Profiler::isTracing())
+	{
+		Console::logMessage("Not tracing");
+		return;
+	}
+
+	Profiler::stopTrace(args.size() > 0 ? args[0] : "trace.json");
+}
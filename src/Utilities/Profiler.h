@@ -0,0 +1,45 @@
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <atomic>
+
+// Scoped timing. PROF_SCOPE("name") times the rest of the enclosing
+// block on whatever thread it runs on. Scopes are identified by their
+// name, which must be a string literal (or otherwise never go away).
+// When the profiler is off a scope costs a single relaxed atomic load,
+// so they can be left in
+#define PROF_CONCAT2(a, b)	a##b
+#define PROF_CONCAT(a, b)	PROF_CONCAT2(a, b)
+#define PROF_SCOPE(name)	Profiler::Scope PROF_CONCAT(prof_scope_, __LINE__)(name)
+
+namespace Profiler
+{
+	extern std::atomic<bool>	active;
+
+	uint64_t	now();
+	double		ticksToMs(uint64_t ticks);
+	bool		beginScope(const char* name);
+	void		endScope();
+	void		setThreadName(const char* name);
+
+	// Main thread only
+	void	init();
+	void	nextFrame();
+	void	reset();
+	void	startTrace(unsigned frames);
+	bool	stopTrace(string filename = "trace.json");
+	bool	isTracing();
+
+	class Scope
+	{
+	private:
+		bool	_recording;
+
+	public:
+		Scope(const char* name) { _recording = active.load(std::memory_order_relaxed) && beginScope(name); }
+		~Scope() { if (_recording) endScope(); }
+	};
+}
+
+#endif//__PROFILER_H__
@@ -0,0 +1,154 @@
+/*******************************************************************
+ * Voxigine - A simple voxel engine
+ * Copyright(C) 2014 Simon Judd
+ *
+ * Email:       sirjuddington@gmail.com
+ * Web:         https://github.com/sirjuddington/Voxigine
+ * Filename:    ThreadPool.cpp
+ * Description: A simple pool of worker threads that pull jobs off a
+ *              shared queue
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************/
+
+
+/*******************************************************************
+ * INCLUDES
+ *******************************************************************/
+#include "Main.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+
+/*******************************************************************
+ * THREADPOOL CLASS FUNCTIONS
+ *******************************************************************/
+
+/* ThreadPool::ThreadPool
+ * ThreadPool class constructor. Starts [n_threads] worker threads,
+ * or one per hardware thread if [n_threads] is 0
+ *******************************************************************/
+ThreadPool::ThreadPool(unsigned n_threads)
+{
+	_n_running = 0;
+	_quit = false;
+
+	if (n_threads == 0)
+		n_threads = hardwareThreads();
+
+	for (unsigned a = 0; a < n_threads; a++)
+		_threads.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+/* ThreadPool::~ThreadPool
+ * ThreadPool class destructor. Any jobs still queued are run before
+ * the worker threads exit
+ *******************************************************************/
+ThreadPool::~ThreadPool()
+{
+	wait();
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_cv_job.notify_all();
+
+	for (unsigned a = 0; a < _threads.size(); a++)
+		_threads[a].join();
+}
+
+/* ThreadPool::numPending
+ * Returns the number of jobs that are queued or currently running
+ *******************************************************************/
+unsigned ThreadPool::numPending()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _jobs.size() + _n_running;
+}
+
+/* ThreadPool::addJob
+ * Queues [job] to be run on the next available worker thread
+ *******************************************************************/
+void ThreadPool::addJob(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_jobs.push_back(job);
+	}
+	_cv_job.notify_one();
+}
+
+/* ThreadPool::wait
+ * Blocks until all queued jobs have finished running
+ *******************************************************************/
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (!_jobs.empty() || _n_running > 0)
+		_cv_done.wait(lock);
+}
+
+/* ThreadPool::workerLoop
+ * The main loop for each worker thread, waits for jobs and runs them
+ * until the pool is shut down
+ *******************************************************************/
+void ThreadPool::workerLoop()
+{
+	Profiler::setThreadName("Worker");
+
+	while (true)
+	{
+		std::function<void()> job;
+
+		// Wait for a job
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			while (_jobs.empty() && !_quit)
+				_cv_job.wait(lock);
+
+			if (_jobs.empty())
+				return;
+
+			job = _jobs.front();
+			_jobs.pop_front();
+			_n_running++;
+		}
+
+		// Run it
+		job();
+
+		// Let anything waiting know if we're out of work
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_n_running--;
+			if (_jobs.empty() && _n_running == 0)
+				_cv_done.notify_all();
+		}
+	}
+}
+
+
+/*******************************************************************
+ * THREADPOOL STATIC FUNCTIONS
+ *******************************************************************/
+
+/* ThreadPool::hardwareThreads
+ * Returns the number of hardware threads available (at least 1)
+ *******************************************************************/
+unsigned ThreadPool::hardwareThreads()
+{
+	unsigned n = std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
@@ -0,0 +1,36 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+
+class ThreadPool
+{
+private:
+	vector<std::thread>					_threads;
+	std::deque<std::function<void()>>	_jobs;			// Queued jobs, not yet picked up by a worker
+	std::mutex							_mutex;
+	std::condition_variable				_cv_job;		// Signalled when a job is queued (or on shutdown)
+	std::condition_variable				_cv_done;		// Signalled when the pool runs out of work
+	unsigned							_n_running;		// Jobs currently being executed
+	bool								_quit;
+
+	void	workerLoop();
+
+public:
+	ThreadPool(unsigned n_threads = 0);
+	~ThreadPool();
+
+	unsigned	numThreads() const { return _threads.size(); }
+	unsigned	numPending();
+
+	void	addJob(std::function<void()> job);
+	void	wait();
+
+	static unsigned	hardwareThreads();
+};
+
+#endif//__THREAD_POOL_H__
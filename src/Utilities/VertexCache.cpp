@@ -0,0 +1,244 @@
+
+#include "Main.h"
+#include "VertexCache.h"
+#include <cmath>
+
+// Size of the simulated post-transform cache used for scoring. The
+// scoring favours the most recent entries so this doesn't need to match
+// the hardware exactly
+#define VC_CACHE_SIZE		16
+#define VC_CACHE_DECAY		1.5
+#define VC_LAST_TRI_SCORE	0.75
+#define VC_VALENCE_SCALE	2.0
+#define VC_VALENCE_POWER	0.5
+#define VC_MAX_VALENCE		32
+
+namespace VertexCache
+{
+	struct vc_vertex_t
+	{
+		int			cache_pos;		// -1 if not in the cache
+		unsigned	n_remaining;	// Triangles using this vertex not yet added
+		unsigned	first_tri;		// Offset into the triangle list
+		unsigned	n_tris;
+		float		score;
+	};
+
+	// Precalculated parts of the vertex score, see vertexScore
+	struct vc_score_table_t
+	{
+		float	cache[VC_CACHE_SIZE];
+		float	valence[VC_MAX_VALENCE];
+
+		vc_score_table_t()
+		{
+			for (unsigned a = 0; a < VC_CACHE_SIZE; a++)
+			{
+				// Vertices of the last triangle get a fixed score so that
+				// it isn't favoured just for being the most recent
+				if (a < 3)
+					cache[a] = (float)VC_LAST_TRI_SCORE;
+				else
+				{
+					float scale = 1.0f / (VC_CACHE_SIZE - 3);
+					cache[a] = (float)pow(1.0f - (a - 3) * scale, VC_CACHE_DECAY);
+				}
+			}
+
+			// Boost vertices with few triangles left, to clear them out
+			valence[0] = 0.0f;
+			for (unsigned a = 1; a < VC_MAX_VALENCE; a++)
+				valence[a] = (float)(VC_VALENCE_SCALE * pow((double)a, -VC_VALENCE_POWER));
+		}
+	};
+
+	/* VertexCache::vertexScore
+	 * Returns the score for a vertex at [cache_pos] in the cache (-1
+	 * if not in it) with [n_remaining] triangles still to be added
+	 *******************************************************************/
+	float vertexScore(const vc_score_table_t& table, int cache_pos, unsigned n_remaining)
+	{
+		if (n_remaining == 0)
+			return -1.0f;
+
+		float score = cache_pos >= 0 ? table.cache[cache_pos] : 0.0f;
+		if (n_remaining < VC_MAX_VALENCE)
+			score += table.valence[n_remaining];
+		else
+			score += (float)(VC_VALENCE_SCALE * pow((double)n_remaining, -VC_VALENCE_POWER));
+
+		return score;
+	}
+}
+
+/* VertexCache::optimize
+ * Reorders the triangles in [indices] to make better use of the GPU's
+ * post-transform vertex cache, using Tom Forsyth's 'Linear-Speed
+ * Vertex Cache Optimisation' algorithm. Triangle winding is kept
+ *******************************************************************/
+void VertexCache::optimize(uint16_t* indices, unsigned n_indices, unsigned n_vertices)
+{
+	unsigned n_tris = n_indices / 3;
+	if (n_tris < 2)
+		return;
+
+	vc_score_table_t table;
+
+	// Build vertex -> triangle adjacency
+	vector<vc_vertex_t> vertices(n_vertices);
+	for (unsigned a = 0; a < n_vertices; a++)
+	{
+		vertices[a].cache_pos = -1;
+		vertices[a].n_remaining = 0;
+		vertices[a].n_tris = 0;
+	}
+	for (unsigned a = 0; a < n_tris * 3; a++)
+		vertices[indices[a]].n_remaining++;
+
+	unsigned offset = 0;
+	for (unsigned a = 0; a < n_vertices; a++)
+	{
+		vertices[a].first_tri = offset;
+		offset += vertices[a].n_remaining;
+		vertices[a].score = vertexScore(table, -1, vertices[a].n_remaining);
+	}
+
+	vector<unsigned> vertex_tris(n_tris * 3);
+	for (unsigned t = 0; t < n_tris; t++)
+	{
+		for (unsigned c = 0; c < 3; c++)
+		{
+			vc_vertex_t& v = vertices[indices[t * 3 + c]];
+			vertex_tris[v.first_tri + v.n_tris++] = t;
+		}
+	}
+
+	vector<float> tri_scores(n_tris);
+	vector<bool> tri_added(n_tris, false);
+	for (unsigned t = 0; t < n_tris; t++)
+		tri_scores[t] = vertices[indices[t * 3]].score + vertices[indices[t * 3 + 1]].score + vertices[indices[t * 3 + 2]].score;
+
+	vector<uint16_t> output;
+	output.reserve(n_tris * 3);
+
+	int cache[VC_CACHE_SIZE + 3];
+	unsigned cache_used = 0;
+	unsigned scan_pos = 0;
+	int best_tri = -1;
+	while (output.size() < n_tris * 3)
+	{
+		// Nothing in the cache to go on, take the next triangle in the
+		// original order. Scanning for the best scoring one instead is
+		// quadratic on meshes with many disconnected pieces
+		if (best_tri < 0)
+		{
+			while (tri_added[scan_pos])
+				scan_pos++;
+			best_tri = scan_pos;
+		}
+
+		// Add the triangle
+		tri_added[best_tri] = true;
+		for (unsigned c = 0; c < 3; c++)
+		{
+			uint16_t index = indices[best_tri * 3 + c];
+			output.push_back(index);
+
+			// Remove it from the vertex's list of remaining triangles
+			vc_vertex_t& v = vertices[index];
+			for (unsigned a = 0; a < v.n_remaining; a++)
+			{
+				if (vertex_tris[v.first_tri + a] == (unsigned)best_tri)
+				{
+					vertex_tris[v.first_tri + a] = vertex_tris[v.first_tri + v.n_remaining - 1];
+					break;
+				}
+			}
+			v.n_remaining--;
+		}
+
+		// Move the triangle's vertices to the front of the cache
+		int new_cache[VC_CACHE_SIZE + 3];
+		unsigned new_used = 0;
+		for (unsigned c = 0; c < 3; c++)
+			new_cache[new_used++] = indices[best_tri * 3 + c];
+		for (unsigned a = 0; a < cache_used; a++)
+		{
+			int index = cache[a];
+			if (index != indices[best_tri * 3] && index != indices[best_tri * 3 + 1] && index != indices[best_tri * 3 + 2])
+				new_cache[new_used++] = index;
+		}
+
+		// Anything pushed off the end is no longer cached
+		for (unsigned a = VC_CACHE_SIZE; a < new_used; a++)
+		{
+			vertices[new_cache[a]].cache_pos = -1;
+			vertices[new_cache[a]].score = vertexScore(table, -1, vertices[new_cache[a]].n_remaining);
+		}
+
+		cache_used = min(new_used, (unsigned)VC_CACHE_SIZE);
+		for (unsigned a = 0; a < cache_used; a++)
+		{
+			cache[a] = new_cache[a];
+			vertices[cache[a]].cache_pos = a;
+			vertices[cache[a]].score = vertexScore(table, a, vertices[cache[a]].n_remaining);
+		}
+
+		// Rescore triangles touching the cache and pick the best for next
+		best_tri = -1;
+		float best_score = -1.0f;
+		for (unsigned a = 0; a < new_used; a++)
+		{
+			vc_vertex_t& v = vertices[new_cache[a]];
+			for (unsigned b = 0; b < v.n_remaining; b++)
+			{
+				unsigned t = vertex_tris[v.first_tri + b];
+				float score = vertices[indices[t * 3]].score + vertices[indices[t * 3 + 1]].score + vertices[indices[t * 3 + 2]].score;
+				tri_scores[t] = score;
+				if (score > best_score)
+				{
+					best_score = score;
+					best_tri = t;
+				}
+			}
+		}
+	}
+
+	memcpy(indices, &output[0], n_tris * 3 * sizeof(uint16_t));
+}
+
+/* VertexCache::acmr
+ * Returns the average cache miss ratio (transformed vertices per
+ * triangle) of [indices] with a FIFO cache of [cache_size] entries
+ *******************************************************************/
+double VertexCache::acmr(const uint16_t* indices, unsigned n_indices, unsigned cache_size)
+{
+	unsigned n_tris = n_indices / 3;
+	if (n_tris == 0)
+		return 0.0;
+
+	vector<int> cache(cache_size, -1);
+	unsigned next = 0;
+	unsigned misses = 0;
+	for (unsigned a = 0; a < n_tris * 3; a++)
+	{
+		bool hit = false;
+		for (unsigned c = 0; c < cache_size; c++)
+		{
+			if (cache[c] == indices[a])
+			{
+				hit = true;
+				break;
+			}
+		}
+
+		if (!hit)
+		{
+			cache[next] = indices[a];
+			next = (next + 1) % cache_size;
+			misses++;
+		}
+	}
+
+	return (double)misses / (double)n_tris;
+}
@@ -0,0 +1,11 @@
+
+#ifndef __VERTEX_CACHE_H__
+#define __VERTEX_CACHE_H__
+
+namespace VertexCache
+{
+	void	optimize(uint16_t* indices, unsigned n_indices, unsigned n_vertices);
+	double	acmr(const uint16_t* indices, unsigned n_indices, unsigned cache_size = 16);
+}
+
+#endif//__VERTEX_CACHE_H__
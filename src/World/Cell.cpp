@@ -3,6 +3,7 @@
 #include "Cell.h"
 #include "Utilities/Math.h"
 #include "Utilities/Random.h"
+#include "Utilities/Profiler.h"
 
 
 Cell::Cell(int zone_x, int zone_y)
@@ -14,18 +15,22 @@ Cell::Cell(int zone_x, int zone_y)
 	memset(_height_lod1, 0, 16 * 16);
 	memset(_height_lod2, 0, 8 * 8);
 	memset(_height_lod3, 0, 4 * 4);
-	_lod_generated = false;
+	_revision = 0;
+	_max_height = 0;
+	memset(_lod_error, 0, 4);
 }
 
 Cell::~Cell()
 {
 }
 
-float Cell::heightAt(uint8_t lod, uint8_t x, uint8_t y)
+/* Cell::heightAt
+ * Returns the height at [x,y] in [lod]. Only reads, the LODs are kept
+ * up to date whenever the heights change, so this is safe to call from
+ * the mesh building threads
+ *******************************************************************/
+float Cell::heightAt(uint8_t lod, uint8_t x, uint8_t y) const
 {
-	if (lod > 0 && !_lod_generated)
-		generateLod();
-
 	if (lod == 0)
 		return _base_height + (float)_height[x][y];
 	else if (lod == 1)
@@ -38,13 +43,24 @@ float Cell::heightAt(uint8_t lod, uint8_t x, uint8_t y)
 	return _base_height;
 }
 
+/* Cell::setHeightAt
+ * Sets the full detail height at [x,y] and regenerates the LODs from
+ * it. To change many heights at once, write them through heightData
+ * and call generateLod once afterwards instead
+ *******************************************************************/
 void Cell::setHeightAt(uint8_t x, uint8_t y, uint8_t height)
 {
+	if (_height[x][y] == height)
+		return;
+
 	_height[x][y] = height;
+	generateLod();
 }
 
 void Cell::generateLod()
 {
+	PROF_SCOPE("Cell::generateLod");
+
 	memset(_height_lod1, 0, 16 * 16);
 	memset(_height_lod2, 0, 8 * 8);
 	memset(_height_lod3, 0, 4 * 4);
@@ -56,6 +72,7 @@ void Cell::generateLod()
 	memset(lod2, 0, 8*8*sizeof(double));
 	memset(lod3, 0, 4*4*sizeof(double));
 
+	uint8_t max_height = 0;
 	unsigned x_l1 = 0;
 	unsigned x_l2 = 0;
 	unsigned x_l3 = 0;
@@ -86,6 +103,9 @@ void Cell::generateLod()
 					y_l3++;
 			}
 
+			if (_height[x][y] > max_height)
+				max_height = _height[x][y];
+
 			lod1[x_l1][y_l1] += _height[x][y];
 			lod2[x_l2][y_l2] += _height[x][y];
 			lod3[x_l3][y_l3] += _height[x][y];
@@ -107,7 +127,28 @@ void Cell::generateLod()
 		for (unsigned y = 0; y < 4; y++)
 			_height_lod3[x][y] = (uint8_t)Math::clamp(lod3[x][y] / 64.0, 0.0, 255.0);
 
-	_lod_generated = true;
+	// LODs are averages so the full detail max covers them all
+	_max_height = max_height;
+
+	// Geometric error of each LOD, the furthest any full detail sample
+	// is from the LOD sample covering it. Each LOD's error is at least
+	// that of the one before so that coarser never means more accurate
+	uint8_t error[4] = { 0, 0, 0, 0 };
+	for (unsigned x = 0; x < 32; x++)
+	{
+		for (unsigned y = 0; y < 32; y++)
+		{
+			int h = _height[x][y];
+			error[1] = max(error[1], (uint8_t)abs(h - _height_lod1[x / 2][y / 2]));
+			error[2] = max(error[2], (uint8_t)abs(h - _height_lod2[x / 4][y / 4]));
+			error[3] = max(error[3], (uint8_t)abs(h - _height_lod3[x / 8][y / 8]));
+		}
+	}
+	_lod_error[0] = 0;
+	for (unsigned a = 1; a < 4; a++)
+		_lod_error[a] = max(error[a], _lod_error[a - 1]);
+
+	_revision++;
 }
 
 uint8_t Cell::average(unsigned x1, unsigned y1, unsigned x2, unsigned y2)
@@ -133,6 +174,8 @@ void Cell::generateRandom(uint8_t min, uint8_t max)
 	for (unsigned x = 0; x < 32; x++)
 		for (unsigned y = 0; y < 32; y++)
 			_height[x][y] = heights[x * 32 + y];
+
+	generateLod();
 }
 
 void Cell::generateBump()
@@ -145,4 +188,6 @@ void Cell::generateBump()
 			_height[x][y] = Math::clamp(6 - (dist * 0.7 * 0.5), 0, 6) + 1;
 		}
 	}
+
+	generateLod();
 }
@@ -12,15 +12,23 @@ private:
 	uint8_t	_height_lod1[16][16];
 	uint8_t	_height_lod2[8][8];
 	uint8_t	_height_lod3[4][4];
-	bool	_lod_generated;
+	unsigned	_revision;	// Incremented whenever the heights change
+	uint8_t	_max_height;
+	uint8_t	_lod_error[4];	// Max height difference from full detail at each LOD
 
 public:
 	Cell(int zone_x, int zone_y);
 	~Cell();
 
-	int		zoneX() { return _zone_x; }
-	int		zoneY() { return _zone_y; }
-	float	heightAt(uint8_t lod, uint8_t x, uint8_t y);
+	int		zoneX() const { return _zone_x; }
+	int		zoneY() const { return _zone_y; }
+	float	heightAt(uint8_t lod, uint8_t x, uint8_t y) const;
+	uint8_t*	heightData() { return &_height[0][0]; }	// Call generateLod after writing
+	unsigned	revision() const { return _revision; }
+	float		baseHeight() const { return _base_height; }
+	float		maxHeight() const { return _base_height + _max_height; }
+	float		lodError(uint8_t lod) const { return _lod_error[lod]; }
+	float		maxLodError() const { return _lod_error[3]; }
 
 	void	setHeightAt(uint8_t x, uint8_t y, uint8_t height);
 
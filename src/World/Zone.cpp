@@ -4,86 +4,272 @@
 #include "Cell.h"
 #include "Utilities/Random.h"
 #include "Utilities/Math.h"
+#include "Utilities/ThreadPool.h"
 #include "External/libnoise/noise.h"
+#include "Utilities/Profiler.h"
+#include <chrono>
+#include <cfloat>
+#include <cassert>
+
+CVAR(Int, gen_threads, 0, CVAR_SAVE)
 
 Zone::Zone(unsigned width, unsigned height)
 {
+	// Cell coordinates are 16 bits each in a Morton code, and the cell
+	// count has to fit in 32 bits, so 65535 is the most either way
+	assert(width > 0 && height > 0 && width < 65536 && height < 65536);
 	_width = width;
 	_height = height;
+
+	// Morton codes increase along both axes, so the far corner has the
+	// highest code in the zone. Storage goes up to it, which for zones
+	// that aren't a power-of-two square includes some slots outside
+	unsigned n_cells = Math::mortonEncode(width - 1, height - 1) + 1;
+
+	// Create all cells up front, in Morton order
+	_cells.reserve(n_cells);
+	for (unsigned a = 0; a < n_cells; a++)
+	{
+		unsigned x, y;
+		Math::mortonDecode(a, x, y);
+		_cells.push_back(Cell(x, y));
+	}
+
+	// Build the bounds quadtree, up to a single node covering the
+	// smallest power-of-two square containing the zone
+	unsigned n_levels = 1;
+	while ((1u << (n_levels - 1)) < width || (1u << (n_levels - 1)) < height)
+		n_levels++;
+	_bounds_min.resize(n_levels);
+	_bounds_max.resize(n_levels);
+	_bounds_error.resize(n_levels);
+	for (unsigned a = 0; a < n_levels; a++)
+	{
+		_bounds_min[a].resize(numNodes(a));
+		_bounds_max[a].resize(numNodes(a));
+		_bounds_error[a].resize(numNodes(a));
+	}
+	updateBounds();
 }
 
 Zone::~Zone()
 {
 }
 
+unsigned Zone::cellIndex(unsigned x, unsigned y) const
+{
+	return Math::mortonEncode(x, y);
+}
+
 Cell* Zone::getCell(unsigned x, unsigned y)
 {
-	// Get cell at coordinate
-	Cell* c = _cells[x * _width + y];
+	if (!contains(x, y))
+		return nullptr;
 
-	// Create if needed
-	if (c == nullptr)
-	{
-		c = new Cell(x, y);
-		_cells[x * _width + y] = c;
-	}
+	return &_cells[Math::mortonEncode(x, y)];
+}
+
+const Cell* Zone::getCell(unsigned x, unsigned y) const
+{
+	if (!contains(x, y))
+		return nullptr;
 
-	return c;
+	return &_cells[Math::mortonEncode(x, y)];
 }
 
 float Zone::heightAt(unsigned x, unsigned y)
 {
 	Cell* cell = getCell(x / 32, y / 32);
+	if (!cell)
+		return 0.0f;
+
 	return cell->heightAt(0, x % 32, y % 32);
 }
 
 void Zone::setHeightAt(unsigned x, unsigned y, uint8_t height)
 {
 	Cell* cell = getCell(x / 32, y / 32);
-	cell->setHeightAt(x % 32, y % 32, height);
+	if (cell)
+	{
+		cell->setHeightAt(x % 32, y % 32, height);
+		updateBounds(cellIndex(x / 32, y / 32));
+	}
+}
+
+/* Zone::updateNode
+ * Recalculates the height bounds and LOD error of node [index] at
+ * [level] from its cell (level 0) or its four child nodes
+ *******************************************************************/
+void Zone::updateNode(unsigned level, unsigned index)
+{
+	float min_height = FLT_MAX;
+	float max_height = -FLT_MAX;
+	float max_error = 0.0f;
+	if (level == 0)
+	{
+		const Cell& cell = _cells[index];
+		if (contains(cell.zoneX(), cell.zoneY()))
+		{
+			min_height = cell.baseHeight();
+			max_height = cell.maxHeight();
+			max_error = cell.maxLodError();
+		}
+	}
+	else
+	{
+		const vector<float>& child_min = _bounds_min[level - 1];
+		const vector<float>& child_max = _bounds_max[level - 1];
+		const vector<float>& child_error = _bounds_error[level - 1];
+		for (unsigned a = index * 4; a < index * 4 + 4 && a < child_min.size(); a++)
+		{
+			min_height = min(min_height, child_min[a]);
+			max_height = max(max_height, child_max[a]);
+			max_error = max(max_error, child_error[a]);
+		}
+	}
+
+	_bounds_min[level][index] = min_height;
+	_bounds_max[level][index] = max_height;
+	_bounds_error[level][index] = max_error;
+}
+
+/* Zone::updateBounds
+ * Rebuilds the whole bounds quadtree, bottom up
+ *******************************************************************/
+void Zone::updateBounds()
+{
+	for (unsigned level = 0; level < _bounds_min.size(); level++)
+		for (unsigned a = 0; a < numNodes(level); a++)
+			updateNode(level, a);
+}
+
+/* Zone::updateBounds
+ * Updates the height bounds of the cell at [cell_index] and the nodes
+ * above it, after its heights have changed
+ *******************************************************************/
+void Zone::updateBounds(unsigned cell_index)
+{
+	for (unsigned level = 0; level < _bounds_min.size(); level++)
+		updateNode(level, cell_index >> (level * 2));
 }
 
 void Zone::fillWithRandomNoise()
 {
-	for (unsigned x = 0; x < _width; x++)
+	for (unsigned a = 0; a < _cells.size(); a++)
+	{
+		Cell& c = _cells[a];
+		if (!contains(c.zoneX(), c.zoneY()))
+			continue;
+
+		c.generateRandom(0, 4);
+	}
+
+	updateBounds();
+}
+
+/* generateTestCell
+ * Fills [cell]'s heights from the test landscape generators. Only
+ * touches [cell] so it is safe to run for different cells in
+ * parallel
+ *******************************************************************/
+static void generateTestCell(Cell& cell, const noise::module::Module& mountains, const noise::module::Module& land)
+{
+	PROF_SCOPE("Zone::generateTestCell");
+
+	double noise_scale = 0.001;
+
+	// Build the sample coordinates for the whole cell so each generator
+	// can evaluate them in one batch
+	double mx[32 * 32], my[32 * 32], lx[32 * 32], ly[32 * 32], z[32 * 32];
+	for (unsigned cx = 0; cx < 32; cx++)
 	{
-		for (unsigned y = 0; y < _height; y++)
+		unsigned x = cell.zoneX() * 32 + cx;
+		for (unsigned cy = 0; cy < 32; cy++)
 		{
-			Cell* c = getCell(x, y);
-			c->generateRandom(0, 4);
-			c->generateLod();
+			unsigned y = cell.zoneY() * 32 + cy;
+			unsigned i = cx * 32 + cy;
+			mx[i] = x*noise_scale;
+			my[i] = y*noise_scale;
+			lx[i] = x*noise_scale*4;
+			ly[i] = y*noise_scale*4;
+			z[i] = 0.5;	// Ignored by the 2D generators
 		}
 	}
+
+	double values_mountains[32 * 32];
+	double values_land[32 * 32];
+	mountains.GetValues(mx, my, z, values_mountains, 32 * 32);
+	land.GetValues(lx, ly, z, values_land, 32 * 32);
+
+	uint8_t* heights = cell.heightData();
+	for (unsigned i = 0; i < 32 * 32; i++)
+	{
+		double mult1 = values_mountains[i] - 0.3;
+		mult1 = Math::clamp(mult1, 0, 1.2);
+		double mult2 = 0.5 + (values_land[i] * 0.5);
+		mult2 = Math::clamp(mult2, 0, 1.2);
+
+		uint8_t hm = uint8_t(255.0 * mult1);
+		uint8_t hl = uint8_t(50 * mult2);
+		heights[i] = max(hm, hl);
+	}
+
+	cell.generateLod();
 }
 
-void Zone::generateTestLandscape()
+double Zone::generateTestLandscape(unsigned n_threads)
 {
+	PROF_SCOPE("Zone::generateTestLandscape");
+
 	noise::module::RidgedMulti generator_mountains;
 	generator_mountains.SetSeed(Random::generateInt(-5000, 5000));
 	generator_mountains.SetFrequency(0.5);
 	generator_mountains.SetNoiseQuality(noise::NoiseQuality::QUALITY_FAST);
+	generator_mountains.Set2D(true);
 
 	noise::module::Billow generator_land;
 	generator_land.SetSeed(Random::generateInt(-5000, 5000));
 	generator_land.SetFrequency(0.5);
 	generator_land.SetPersistence(0.4);
+	generator_land.Set2D(true);
 
-	double noise_scale = 0.001;
-	double max_height = 240.0;
-	for (unsigned x = 0; x < _width * 32; x++)
+	if (n_threads == 0)
+		n_threads = gen_threads > 0 ? gen_threads : ThreadPool::hardwareThreads();
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (n_threads == 1)
 	{
-		for (unsigned y = 0; y < _height * 32; y++)
+		// Single threaded, just go through cells in storage order
+		for (unsigned a = 0; a < _cells.size(); a++)
 		{
-			double mult1 = (generator_mountains.GetValue(x*noise_scale, y*noise_scale, 0.5)) - 0.3;
-			mult1 = Math::clamp(mult1, 0, 1.2);
-			double mult2 = 0.5 + (generator_land.GetValue(x*noise_scale*4, y*noise_scale*4, 0.5) * 0.5);
-			mult2 = Math::clamp(mult2, 0, 1.2);
-
-			uint8_t hm = uint8_t(255.0 * mult1);
-			uint8_t hl = uint8_t(50 * mult2);
-			setHeightAt(x, y, max(hm, hl));
+			if (contains(_cells[a].zoneX(), _cells[a].zoneY()))
+				generateTestCell(_cells[a], generator_mountains, generator_land);
 		}
 	}
+	else
+	{
+		// Queue a job for each cell, the noise modules are read-only
+		// so can be shared between workers
+		ThreadPool pool(n_threads);
+		for (unsigned a = 0; a < _cells.size(); a++)
+		{
+			Cell* cell = &_cells[a];
+			if (contains(cell->zoneX(), cell->zoneY()))
+				pool.addJob([cell, &generator_mountains, &generator_land]() { generateTestCell(*cell, generator_mountains, generator_land); });
+		}
+		pool.wait();
+	}
+	updateBounds();
+
+	// Log throughput
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	double samples = (double)_width * (double)_height * 32.0 * 32.0;
+	double rate = seconds > 0 ? samples / seconds : 0;
+	logMessage(1, "Generated %dx%d zone in %dms using %d thread(s) (%1.2f million samples/s)",
+		_width, _height, (int)(seconds * 1000.0), n_threads, rate / 1000000.0);
+
+	return rate;
 
 	//uint32_t n_height_points = Random::generateUnsigned(30, 80);
 
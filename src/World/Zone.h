@@ -1,11 +1,8 @@
-
 #ifndef __ZONE_H__
 #define __ZONE_H__
 
-#include <unordered_map>
-
-class Cell;
-typedef std::unordered_map<uint64_t, Cell*> CellMap;
+#include "Cell.h"
+#include <cfloat>
 
 class Zone
 {
@@ -13,21 +10,56 @@ public:
 	Zone(unsigned width, unsigned height);
 	~Zone();
 
-	unsigned	getWidth() { return _width; }
-	unsigned	getHeight() { return _height; }
+	unsigned	getWidth() const { return _width; }
+	unsigned	getHeight() const { return _height; }
+	bool		contains(unsigned x, unsigned y) const { return x < _width && y < _height; }
 	Cell*		getCell(unsigned x, unsigned y);
+	const Cell*	getCell(unsigned x, unsigned y) const;
 	float		heightAt(unsigned x, unsigned y);
 
+	// Cells are stored in Morton (Z-order) order, iterating over
+	// [0, numCells()) visits them in spatial order. For zones that
+	// aren't a power-of-two square some slots are outside the zone.
+	// Zones can be at most 65535 cells on each side, though only zones
+	// up to MAX_PACKED_ZONE_CELLS across can be drawn with packed
+	// vertices (see CellMesh)
+	unsigned	numCells() const { return _cells.size(); }
+	unsigned	cellIndex(unsigned x, unsigned y) const;
+	Cell*		cellAt(unsigned index) { return &_cells[index]; }
+	const Cell*	cellAt(unsigned index) const { return &_cells[index]; }
+
 	void	setHeightAt(unsigned x, unsigned y, uint8_t height);
 
+	// Bounds quadtree. Level 0 is the cells themselves and each level
+	// up has a quarter as many nodes, up to a single root node. Each
+	// node has the height range and largest coarsest-LOD error of the
+	// cells under it. Because the cells are in Morton order, node
+	// [index] at [level] covers cells [index << 2*level,
+	// (index + 1) << 2*level), clipped to numCells(). Nodes with no
+	// cells in the zone (including any past the end of storage) have
+	// min > max
+	unsigned	numLevels() const { return _bounds_min.size(); }
+	unsigned	numNodes(unsigned level) const { return (_cells.size() + (1u << (level * 2)) - 1) >> (level * 2); }
+	float		nodeMinHeight(unsigned level, unsigned index) const { return index < _bounds_min[level].size() ? _bounds_min[level][index] : FLT_MAX; }
+	float		nodeMaxHeight(unsigned level, unsigned index) const { return index < _bounds_max[level].size() ? _bounds_max[level][index] : -FLT_MAX; }
+	float		nodeMaxError(unsigned level, unsigned index) const { return _bounds_error[level][index]; }
+	void		updateBounds();
+	void		updateBounds(unsigned cell_index);
+
 	// Testing
 	void	fillWithRandomNoise();
-	void	generateTestLandscape();
+	double	generateTestLandscape(unsigned n_threads = 0);
 
 private:
-	unsigned	_width;
-	unsigned	_height;
-	CellMap		_cells;
+	unsigned		_width;
+	unsigned		_height;
+	vector<Cell>	_cells;
+
+	vector< vector<float> >	_bounds_min;	// Lowest base height per node, by level
+	vector< vector<float> >	_bounds_max;	// Highest terrain height per node, by level
+	vector< vector<float> >	_bounds_error;	// Highest coarsest-LOD error per node, by level
+
+	void	updateNode(unsigned level, unsigned index);
 };
 
 #endif//__ZONE_H__